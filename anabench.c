@@ -0,0 +1,338 @@
+/*******************************************************************************
+***
+*** Filename         : anabench.c
+*** Purpose          : End-to-end throughput benchmark of the analyser driver
+***                    against the simulated analyser.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : Each measurement is run twice: once untraced for wall
+***                    and CPU time, and once under ptrace (Linux only) to
+***                    count the system calls the driver makes. The syscall
+***                    count of a bare query (-q) run is subtracted so the
+***                    per-line figure reflects the read loop only.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ptrace.h>
+#include <sys/prctl.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include "config.h"
+
+#include "global.h"
+#include "sim.h"
+
+#define ArgMax 16
+#define ArgLen 160
+
+typedef struct {
+  double Wall;
+  double Cpu;
+  long Points;
+  long Syscalls;
+} BenchResult;
+
+static char *progname;
+static char *analyserPath = "./analyser";
+
+
+static void usage()
+{
+  printf("anabench v%s - analyser driver throughput benchmark\n\n", VERSION);
+  printf("Syntax:\n");
+  printf("  %s [options]\n", progname);
+  printf("Options:\n");
+  printf("  -a<hz>    Set scan start frequency in Hertz. Default 1000000.\n");
+  printf("  -b<hz>    Set scan stop frequency in Hertz. Default 30000000.\n");
+  printf("  -n<num>   Set number of scan steps. Default 2000.\n");
+  printf("  -s<ms>    Set settle delay passed to the driver. Default 0.\n");
+  printf("  -o<num>   Set number of oscilloscope samples. Default 2000.\n");
+  printf("  -r<bps>   Set simulated line rate in bits/sec, 0 for unlimited. Default 0.\n");
+  printf("  -l<us>    Set simulated DDS latency per step in microseconds. Default 0.\n");
+  printf("  -x<path>  Set path of the analyser binary. Default %s.\n", analyserPath);
+  exit(1);
+}
+
+
+static double tv_seconds(struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+
+static pid_t spawn(char **args, bool traced)
+{
+pid_t pid;
+int devnull;
+
+  if ((pid = fork()) != 0) {
+    return pid;
+  }
+  devnull = open("/dev/null", O_WRONLY);
+  if (devnull != -1) {
+    dup2(devnull, 1);
+    dup2(devnull, 2);
+  }
+#ifdef __linux__
+  if (traced) {
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+  }
+#endif
+  execv(args[0], args);
+  _exit(127);
+}
+
+
+/* Run the driver untraced, measuring wall and CPU time. */
+static bool run_timed(char **args, BenchResult *result)
+{
+struct timeval started, finished;
+struct rusage usage;
+int status;
+pid_t pid;
+
+  gettimeofday(&started, NULL);
+  pid = spawn(args, FALSE);
+  if (pid == -1 || wait4(pid, &status, 0, &usage) == -1) {
+    return FALSE;
+  }
+  gettimeofday(&finished, NULL);
+
+  result->Wall = tv_seconds(&finished) - tv_seconds(&started);
+  result->Cpu = tv_seconds(&usage.ru_utime) + tv_seconds(&usage.ru_stime);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+/* Run the driver under ptrace, counting system call entries. Returns -1 if
+   this platform can't trace. */
+static long run_counted(char **args)
+{
+#ifdef __linux__
+int status, sig = 0;
+long stops = 0L;
+pid_t pid;
+
+  if ((pid = spawn(args, TRUE)) == -1) {
+    return -1L;
+  }
+  /* First stop is the SIGTRAP from execv */
+  if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status)) {
+    return -1L;
+  }
+  ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *) PTRACE_O_TRACESYSGOOD);
+  for (;;) {
+    if (ptrace(PTRACE_SYSCALL, pid, NULL, (void *) (long) sig) == -1) {
+      break;
+    }
+    sig = 0;
+    if (waitpid(pid, &status, 0) == -1 || WIFEXITED(status) || WIFSIGNALED(status)) {
+      break;
+    }
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      stops++;
+    } else {
+      sig = WSTOPSIG(status);
+    }
+  }
+  /* Entry and exit stops, except for the final exit_group */
+  return (stops + 1L) / 2L;
+#else
+  return -1L;
+#endif
+}
+
+
+static long count_lines(char *fileName)
+{
+FILE *in;
+int ch;
+long lines = 0L;
+
+  if ((in = fopen(fileName, "r")) == NULL) {
+    return 0L;
+  }
+  while ((ch = getc(in)) != EOF) {
+    if (ch == '\n') {
+      lines++;
+    }
+  }
+  fclose(in);
+  return lines;
+}
+
+
+/* Point args back at argbuf after a previous run NULL-terminated it, and
+   fill in the driver path. Returns the next free argument index. */
+static int reset_args(char **args, char argbuf[][ArgLen])
+{
+int i;
+  for (i = 0; i < ArgMax; i++) {
+    args[i] = argbuf[i];
+  }
+  strcpy(args[0], analyserPath);
+  return 1;
+}
+
+
+static bool bench(char *name, char **args, char *outputFileName,
+  long baseline, BenchResult *result)
+{
+  if (!run_timed(args, result)) {
+    printf("%s: driver run failed\n", name);
+    return FALSE;
+  }
+  result->Points = count_lines(outputFileName);
+  result->Syscalls = run_counted(args);
+
+  printf("%-12s %7ld points %8.3f s wall %8.3f s CPU %10.1f points/sec",
+    name, result->Points, result->Wall, result->Cpu,
+    result->Wall > 0.0 ? result->Points / result->Wall : 0.0);
+  if (result->Syscalls >= 0L && baseline >= 0L && result->Points > 0L) {
+    printf(" %7.1f syscalls/line\n",
+      (double) (result->Syscalls - baseline) / result->Points);
+  } else {
+    printf("       n/a syscalls/line\n");
+  }
+  return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+int i, n, fd;
+char *p;
+char slave[128];
+char outputFileName[128];
+char argbuf[ArgMax][ArgLen];
+char *args[ArgMax];
+long startFreq = 1000000L, stopFreq = 30000000L;
+int numSteps = 2000, settleDelay = 0;
+int master;
+pid_t simPid;
+long baseline;
+BenchResult result;
+SimParams params;
+bool ok;
+
+  progname = argv[0];
+  sim_defaults(&params);
+  params.Samples = 2000L;
+
+  for (i=1; i<argc; i++) {
+    if (argv[i][0]=='-') {
+      p=&argv[i][2];
+      switch (argv[i][1]) {
+        case 'a':
+          sscanf(p, "%ld", &startFreq);
+          break;
+        case 'b':
+          sscanf(p, "%ld", &stopFreq);
+          break;
+        case 'l':
+          sscanf(p, "%ld", &params.StepLatency);
+          break;
+        case 'n':
+          sscanf(p, "%d", &numSteps);
+          break;
+        case 'o':
+          sscanf(p, "%ld", &params.Samples);
+          break;
+        case 'r':
+          sscanf(p, "%ld", &params.LineRate);
+          break;
+        case 's':
+          sscanf(p, "%d", &settleDelay);
+          break;
+        case 'x':
+          analyserPath = p;
+          break;
+        default:
+          usage();
+      }
+    }
+    else
+      usage();
+  }
+
+  if (access(analyserPath, X_OK) == -1) {
+    printf("Cannot run the analyser driver at %s\n", analyserPath);
+    exit(-1);
+  }
+
+  if ((master = sim_open(slave, sizeof(slave))) == -1) {
+    printf("Cannot open a pseudo-terminal\n");
+    exit(-1);
+  }
+  if ((simPid = fork()) == 0) {
+#ifdef __linux__
+    /* Don't outlive the benchmark if it's interrupted */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+    sim_serve(master, &params);
+    _exit(0);
+  }
+  close(master);
+
+  strcpy(outputFileName, "/tmp/anabench.XXXXXX");
+  if ((fd = mkstemp(outputFileName)) == -1) {
+    printf("Cannot create temporary file name\n");
+    kill(simPid, SIGTERM);
+    exit(-1);
+  }
+  close(fd);
+
+
+  printf("Simulator on %s, line rate %ld bps, latency %ld us/step\n",
+    slave, params.LineRate, params.StepLatency);
+
+  /* Baseline: startup and the q handshake */
+  n = reset_args(args, argbuf);
+  snprintf(args[n++], ArgLen, "-p%s", slave);
+  strcpy(args[n++], "-q");
+  args[n] = NULL;
+  baseline = run_counted(args);
+
+  /* Scan */
+  n = reset_args(args, argbuf);
+  snprintf(args[n++], ArgLen, "-p%s", slave);
+  snprintf(args[n++], ArgLen, "-a%ld", startFreq);
+  snprintf(args[n++], ArgLen, "-b%ld", stopFreq);
+  snprintf(args[n++], ArgLen, "-n%d", numSteps);
+  snprintf(args[n++], ArgLen, "-s%d", settleDelay);
+  snprintf(args[n++], ArgLen, "-f%s", outputFileName);
+  args[n] = NULL;
+  ok = bench("scan", args, outputFileName, baseline, &result);
+
+  /* Oscilloscope */
+  n = reset_args(args, argbuf);
+  snprintf(args[n++], ArgLen, "-p%s", slave);
+  strcpy(args[n++], "-c");
+  strcpy(args[n++], "-df");
+  snprintf(args[n++], ArgLen, "-s%d", settleDelay);
+  snprintf(args[n++], ArgLen, "-f%s", outputFileName);
+  args[n] = NULL;
+  ok = bench("oscilloscope", args, outputFileName, baseline, &result) && ok;
+
+  unlink(outputFileName);
+  kill(simPid, SIGTERM);
+  waitpid(simPid, NULL, 0);
+  return ok ? 0 : 1;
+}
@@ -3,16 +3,27 @@
 *** Filename         : analyser.c
 *** Purpose          : Antenna analyser scan to gnuplot output.
 *** Author           : Matt J. Gumbley
-*** Last updated     : 21/11/14
+*** Last updated     : 16/10/26
 ***
 ********************************************************************************
 ***
 *** Modification Record
+*** 16/10/26 agent Fixed point scan parsing, binary scan files and the
+***                CRC-checked binary sweep protocol; live plotting; scans
+***                across several analysers, split or adaptive; sharing an
+***                analyser over a socket; monitoring with drift alarms;
+***                oscilloscope statistics and rotating captures; native
+***                png/svg plots, batch plots, smoothing and decimation;
+***                sweep metrics and resonance fitting; protocol timing;
+***                settle delay and open/short/load calibration; resumable
+***                scans with retries; the sweep history store; tuning mode.
 ***
 *******************************************************************************/
 
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
@@ -21,15 +32,55 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <glob.h>
+#include <math.h>
+#include <limits.h>
 
 #include "config.h"
 
 #include "global.h"
 #include "util.h"
 #include "asy.h"
+#include "scanline.h"
+#include "scanfile.h"
+#include "liveplot.h"
+#include "multiscan.h"
+#include "refine.h"
+#include "server.h"
+#include "monitor.h"
+#include "oscstats.h"
+#include "render.h"
+#include "metrics.h"
+#include "smooth.h"
+#include "resonance.h"
+#include "trace.h"
+#include "calibrate.h"
+#include "checkpoint.h"
+#include "osl.h"
+#include "history.h"
+#include "capture.h"
+#include "tune.h"
 
 // use a preprocessor definition to get round error: variably modified ‘scanFileName’ at file scope
 #define fileNameMax 128 // get this from limits.h?
+#define MaxPlotWorkers 16
+// A read that times out during a scan asks for the rest of the sweep again,
+// up to this many times without a point arriving.
+#define ScanRetries 3
+
+// How far a scan file's frequencies may be from evenly spaced, in Hz, to be
+// added to the history store: text scan files give them to the Hz.
+#define HistoryFreqTolerance 1.0
+
+// How far to look for the next frame after a corrupt one, in bytes, before
+// treating it as a failed read.
+#define FrameResyncMax (ScanFrameSize * 8)
+
+// What readScanPoint read.
+#define READ_POINT 0
+#define READ_END 1
+#define READ_MALFORMED 2
+#define READ_FAILED 3
 
 static int quit = FALSE;
 static char *progname;
@@ -44,14 +95,33 @@ static char *defport = "/dev/tty.usbmodemmfd111";
 static int defbps=B57600;
 static int defsettle=10;
 static int defsteps=100;
+#ifdef RASPBIAN
+static bool defnative=TRUE;   // gnuplot is slow to start on a Pi
+#else
+static bool defnative=FALSE;
+#endif
 static char portfd = -1;
 static const int linemax = 256;
 static char *tempScanFileName = NULL;
 static char scanFileName[fileNameMax];
 static char plotFileName[fileNameMax];
+static char serverSocket[fileNameMax];  // -U: use the analyser through a server
+static char metricsFileName[fileNameMax];  // -x: write derived metrics here
+static char historyFileName[fileNameMax];  // -H: keep every sweep in this store
+static int smoothMethod = SMOOTH_NONE;     // -k: how plots are smoothed
+static int smoothWindow = 0;
+static bool findResonances = FALSE;        // -R: report every dip
 static bool scanFileTemporary = TRUE;
 static FILE *scanOutput = NULL;
 static FILE *gnuplotCommandsOutput = NULL;
+static LivePlot livePlot;
+static bool livePlotting = FALSE;
+static Trace trace;                        // -T: time the protocol
+static bool tracing = FALSE;
+static OslCorrection correction;           // -L: open/short/load calibration
+static bool correcting = FALSE;
+static bool asciiOnly = FALSE;             // -B: never use the binary protocol
+static bool binaryProtocol = FALSE;        // Scans reply with frames, not lines
 
 static const int PLOT_TYPE_VSWR = 0;
 static const int PLOT_TYPE_FWD = 1;
@@ -91,18 +161,74 @@ static void usage(const char *term)
   printf("Syntax:\n");
   printf("  %s [options]\n", progname);
   printf("Options:\n");
+  printf("  -D<sock>  Run as a server: keep the -p analyser open, and share it\n");
+  printf("            between clients connecting to the Unix socket <sock>.\n");
   printf("  -h        Enable hardware flow control. Default off.\n");
+  printf("  -B        Scan with the ASCII protocol even if the analyser offers\n");
+  printf("            the binary one.\n");
   printf("  -q        Query the analyser for its command set.\n");
+  printf("  -T<file>  Time every command sent and line received, and write\n");
+  printf("            them to <file> as JSON, with the time to first point,\n");
+  printf("            gaps between points (percentiles and histogram) and\n");
+  printf("            bytes/sec of each scan or oscilloscope capture.\n");
+  printf("  -U<sock>  Use the analyser through the server on <sock>, rather\n");
+  printf("            than opening the port.\n");
   printf("  -v        Enable verbose operation.\n");
   printf("Scan options:\n");
   printf("  -a<hz>    Set start frequency in Hertz.\n");
   printf("  -b<hz>    Set stop frequency in Hertz.\n");
   printf("  -f<file>  Set name of analyser output capture file. Default is a\n");
   printf("            temp file that's deleted. Use this to keep the output.\n");
+  printf("  -F<fmt>   Set format of the scan file: text (frequency and SWR, the\n");
+  printf("            default), or bin (binary, with detector readings too).\n");
   printf("  -n<num>   Set number of steps between start and stop frequency. Default %d.\n", defsteps);
   printf("  -p<port>  Set analyser port. <port> is something like /dev/tty.usbmodemmfd111.\n");
   printf("            Default is %s.\n", defport);
-  printf("  -s<ms>    Set settle delay in Milliseconds. Default %d.\n", defsettle);
+  printf("            Give several -p options to scan with several analysers at\n");
+  printf("            once. -a/-b/-f/-n/-s after a -p apply to that port only;\n");
+  printf("            before any -p they're the defaults for all ports.\n");
+  printf("  -S        Split the -a/-b scan between all the -p analysers, scanning\n");
+  printf("            their parts at once, and join the results into one scan.\n");
+  printf("  -M<num>   Monitor: sweep over and over until interrupted, keeping\n");
+  printf("            the last <num> sweeps. The scan file is rewritten after\n");
+  printf("            each sweep with frequency, latest, average, min-hold and\n");
+  printf("            max-hold SWR.\n");
+  printf("  -A<hz>    When monitoring, alarm if the resonance moves more than\n");
+  printf("            <hz> from that of the first sweep.\n");
+  printf("  -W<swr>   When monitoring, alarm if the SWR at resonance changes by\n");
+  printf("            more than <swr> from that of the first sweep, e.g. -W0.5\n");
+  printf("  -u<rate>[,<khz>] Tune: after a scan of -a to -b, sweep a window\n");
+  printf("            <khz> wide (default a fifth of the scan) around the dip\n");
+  printf("            <rate> times a second (e.g. -u5) until interrupted, moving\n");
+  printf("            it with the dip, and show it and the resonance in the\n");
+  printf("            terminal. The points and settle delay (at most -s) are\n");
+  printf("            chosen to keep up the rate.\n");
+  printf("  -r<hz>    Scan adaptively: after a coarse scan of -n steps, rescan\n");
+  printf("            around the dips and steep sides until they're resolved\n");
+  printf("            to <hz>.\n");
+  printf("  -s<ms>    Set settle delay in Milliseconds. Default %d, or as\n", defsettle);
+  printf("            calibrated with -C for the port.\n");
+  printf("  -C<swr>   Calibrate the settle delay: measure how long the detectors\n");
+  printf("            take to settle after the frequency jumps between -a and -b,\n");
+  printf("            and save the shortest delay that keeps the SWR within\n");
+  printf("            <swr> (default %.2f) for the port's future scans.\n", CalibrateTolerance);
+  printf("  -x<file>  Also write each point's frequency, SWR, detector readings,\n");
+  printf("            |reflection coefficient|, return loss and mismatch loss\n");
+  printf("            to <file>, and print the resonance, 1.5:1 and 2:1 SWR\n");
+  printf("            bandwidths and an estimate of Q.\n");
+  printf("  -R        Print every resonance (dip in the SWR) found by the scan,\n");
+  printf("            located between its steps, with its SWR and 2:1\n");
+  printf("            bandwidth, and mark them on SWR plots.\n");
+  printf("  -e<file>  Resume the interrupted scan to <file>, from its last point.\n");
+  printf("            If a scan times out it's asked for again from the last\n");
+  printf("            point received, up to %d times; if it's interrupted, it\n", ScanRetries);
+  printf("            is kept to be resumed, even if it was to a temp file.\n");
+  printf("  -H<store> Also add each complete sweep (of a scan, or when\n");
+  printf("            monitoring) to the history store <store>, titled -t.\n");
+  printf("  -L<std>   Calibrate the bridge and cable: scan with the open, short\n");
+  printf("            or load (-Lload,<ohms>, default %g) standard connected\n", OslLoadOhms);
+  printf("            in place of the antenna. Once all three are measured,\n");
+  printf("            scans of the range are corrected. -Loff doesn't correct.\n");
   printf("(You must give -a/-b to run a scan.)\n");
   printf("\n");
   printf("Detector voltage oscilloscope:\n");
@@ -113,6 +239,14 @@ static void usage(const char *term)
   printf("  -dr       Read/plot reverse detector voltages.\n");
   printf("  -f<file>  Set name of analyser output capture file. Default is a\n");
   printf("            temp file that's deleted. Use this to keep the output.\n");
+  printf("  -i        Print the mean, standard deviation, mode, min and max of\n");
+  printf("            the readings (and with -v, their histogram).\n");
+  printf("  -I<file>  Just print those statistics for a previous capture file,\n");
+  printf("            or all the segments listed in a -K capture's <file>.manifest.\n");
+  printf("  -K<bytes>[,<secs>] Capture over and over until interrupted, into\n");
+  printf("            segments <file>.0001 etc. of the -f<file> of at most <bytes>\n");
+  printf("            (k and M suffixes) or <secs> seconds (-K,3600 for time\n");
+  printf("            alone), listed in <file>.manifest.\n");
   printf("  -p<port>  Set analyser port. <port> is something like /dev/tty.usbmodemmfd111.\n");
   printf("            Default is %s.\n", defport);
   printf("(Use -c to query the analyser; omit it if plotting previous data using\n");
@@ -122,6 +256,17 @@ static void usage(const char *term)
   printf("Plot options:\n");
   printf("  -m<term>  Use this terminal type with gnuplot, e.g.\n");
   printf("            qt, aqua, x11, png, canvas, eps. Default is %s.\n", term);
+  printf("  -k<how>   Smooth the plot by: bezier (gnuplot's, the default), sg\n");
+  printf("            (Savitzky-Golay), spline (natural cubic spline through the\n");
+  printf("            points) or median (for oscilloscope noise). e.g. -ksg,15\n");
+  printf("            gives the number of points to smooth over. The smoothed\n");
+  printf("            curve of %d points is written to the scan file's name\n", SmoothCurvePoints);
+  printf("            with .curve appended, and plotted.\n");
+  printf("  -G        Always plot with gnuplot.%s\n", defnative ? " (Not the default here.)" : " The default.");
+  printf("  -l        Plot live in a window while scanning or measuring,\n");
+  printf("            updating as the points arrive.\n");
+  printf("  -N        Draw png and svg plots here, rather than with gnuplot.\n");
+  printf("            Much quicker on a small machine.%s\n", defnative ? " The default here." : "");
   printf("  -o<file>  Set name of plot output file. e.g. dipole.png\n");
   printf("  -t<title> Set the title shown in the plot output.\n");
   printf("  -w        Display the plot in a window, using an appropriate\n");
@@ -131,10 +276,45 @@ static void usage(const char *term)
   printf(" or -w to display interactively without saving the plot.\n");
   printf(" If you have used -f to scan to a file and want to plot that file,\n");
   printf(" just give -f and the plot options.\n");
+  printf("\n");
+  printf("Batch plotting:\n");
+  printf("  %s [plot options] <scan file or pattern>...\n", progname);
+  printf("  Plots each scan file to an image named after it, using a few\n");
+  printf("  long-running gnuplots. Quote patterns like '*.scan' to have them\n");
+  printf("  expanded here rather than by the shell.\n");
+  printf("  -m<terms> Terminal types, comma separated, e.g. png,svg, giving an\n");
+  printf("            image of each type. Default png.\n");
+  printf("  -o<dir>   Directory for the images. Default the current directory.\n");
+  printf("  -O<name>  Also plot all the scans on one graph, to <name>.png etc.\n");
+  printf("  -t<title> Set the title of that graph.\n");
+  printf("  -j<num>   Plot with <num> gnuplots at once. Default 1, at most %d.\n", MaxPlotWorkers);
+  printf("\n");
+  printf("History store:\n");
+  printf("  %s -H<store> [-t<title>] <scan file or pattern>...\n", progname);
+  printf("  Adds scan files to the store, titled <title>, or their own title\n");
+  printf("  or name. Their frequencies must be evenly spaced.\n");
+  printf("  -E<from>,<to> Write the sweeps made between the times (seconds\n");
+  printf("            since the epoch, or YYYY-MM-DD[THH:MM[:SS]]; either may\n");
+  printf("            be left out) to the -f file, or the screen, as lines of\n");
+  printf("            time, MHz and SWR.\n");
+  printf("  -Z<from>,<to> As -E, but resampled onto the -a/-b/-n frequencies\n");
+  printf("            (by default, -n steps across all the sweeps' range).\n");
+  printf("  -t<title> Only the sweeps of this antenna.\n");
   exit(1);
 }
 
 
+// The gnuplot terminal to use when displaying in a window.
+static char *windowTerm()
+{
+#if defined(MACOSX)
+  return "aqua";
+#else
+  return "x11";
+#endif
+}
+
+
 static void spinner()
 {
 static char chars[]="\\-/|";
@@ -151,9 +331,19 @@ static void close_serial() {
   }
 }
 
+static void stopLivePlot();
+
 static void finish(int code)
 {
   close_serial();
+  stopLivePlot();
+
+  if (tracing) {
+    tracing = FALSE;
+    if (!trace_close(&trace)) {
+      printf("Cannot write trace file: %s\n", strerror(errno));
+    }
+  }
 
   if (scanOutput != NULL) {
     fclose(scanOutput);
@@ -161,6 +351,7 @@ static void finish(int code)
 
   if (scanFileTemporary) {
     unlink(scanFileName);
+    checkpoint_remove(scanFileName);
   }
   if (tempScanFileName != NULL) {
     free(tempScanFileName);
@@ -173,33 +364,43 @@ static void finish(int code)
 static bool write_line(char *line)
 {
 int len = strlen(line);
-int written = asy_write(portfd, (byte *) line, len);
+int written;
+  if (tracing) {
+    trace_command(&trace, line);
+  }
+  written = asy_write(portfd, (byte *) line, len);
   return len == written;
 }
 
 
 static bool read_line(char *line, int maxlen)
 {
-int i = 0;
-int ch = -1;
-  bzero(line, maxlen);
-  while (i < maxlen) {
-    ch = asy_getc(portfd);
-    if (ch < 0) {
-      printf("Timeout!\n");
-      return FALSE;
-    }
-    line[i++] = ch;
-    if (ch == '\n') {
-      return TRUE;
-    }
+int len;
+  if (tracing) {
+    trace_reading(&trace);
   }
-
-  if (i == maxlen) {
+  /* A server only replies when it's our turn, and times the analyser out
+     itself, so keep waiting for it unless interrupted */
+  while ((len = asy_readline(portfd, line, maxlen)) == -1 &&
+         serverSocket[0] != '\0' && !quit) {
+    /* still queued */
+  }
+  if (len == -2 && serverSocket[0] != '\0') {
+    printf("Lost the connection to the analyser server\n");
+    return FALSE;
+  }
+  if (len < 0) {
+    printf("Timeout!\n");
+    return FALSE;
+  }
+  if (len == 0) {
     printf("Buffer overflow detected\n");
     finish(99);
   }
-  return FALSE;
+  if (tracing) {
+    trace_line(&trace, line);
+  }
+  return TRUE;
 }
 
 
@@ -256,14 +457,19 @@ void openSerialAndScanOutput(bool verbose, char *port, char *scanFileName,
 char line[linemax];
 
   if (verbose) {
-    printf("port: %s\n", port);
+    printf("port: %s\n", serverSocket[0] != '\0' ? serverSocket : port);
   }
 
   /* Trap CTRL-C */
   signal(SIGINT, &sighandler);
 
-  /* Open port */
-  if ((portfd=asy_open(port, defbps, hardwareFlowControl)) == -1) {
+  /* Open port, or connect to the server that has it open */
+  if (serverSocket[0] != '\0') {
+    if ((portfd=asy_connect(serverSocket)) == -1) {
+      printf("Cannot connect to the analyser server at %s\n", serverSocket);
+      exit(-1);
+    }
+  } else if ((portfd=asy_open(port, defbps, hardwareFlowControl)) == -1) {
     printf("port %s open failed\n", port);
     exit(-1);
   }
@@ -289,6 +495,14 @@ char line[linemax];
   if (verbose) {
     printf("Query from analyser: %s", line);
   }
+
+  /* Firmware that can send scans as binary frames lists the P command. A
+     server relays lines, so scans through one stay in ASCII. */
+  binaryProtocol = !asciiOnly && serverSocket[0] == '\0' &&
+                   strncmp(line, "Commands:", 9) == 0 && strchr(line + 9, 'P') != NULL;
+  if (verbose) {
+    printf("Scan protocol: %s\n", binaryProtocol ? "binary" : "ASCII");
+  }
 }
 
 
@@ -302,19 +516,17 @@ void closeSerialAndScanOutput() {
 }
 
 
-void scan(bool verbose, char* port, long startFreq, long stopFreq,
-  int numSteps, int settleDelay, char *scanFileName, bool hardwareFlowControl) {
-bool scan_end = FALSE;
-char line[linemax];
-long scan_freq, scan_vswr, scan_fwdv, scan_revv;
-char scanLineOutput[linemax];
+// Done with the correction prepareCorrection made, if any.
+static void freeCorrection() {
+  if (correcting) {
+    osl_free_correction(&correction);
+    correcting = FALSE;
+  }
+}
 
-  openSerialAndScanOutput(verbose, port, scanFileName, hardwareFlowControl);
 
-  if (verbose) {
-    printf("start freq: %ld Hz, end freq: %ld Hz, steps: %d, settle: %d ms\n",
-      startFreq, stopFreq, numSteps, settleDelay);
-  }
+static void startSweep(long startFreq, long stopFreq, int numSteps, int settleDelay) {
+char line[linemax];
 
   sprintf(line, "%ldA", startFreq);
   write_line_successfully(line, "Could not set start frequency\n", 3);
@@ -328,17 +540,323 @@ char scanLineOutput[linemax];
   sprintf(line, "%dD", settleDelay);
   write_line_successfully(line, "Could not set settle delay\n", 6);
 
-  write_line_successfully("s", "Could not start scan\n", 7);
+  write_line_successfully(binaryProtocol ? "P" : "s", "Could not start scan\n", 7);
+  if (tracing) {
+    trace_start(&trace);
+  }
+}
+
+
+// Read the next binary frame of a scan, finding the start of the next good
+// one after a corrupt one. line is set to the scan line it stands for.
+static int readScanFrame(char *line, ScanPoint *point) {
+byte frame[ScanFrameSize];
+int type, len, skipped = 0;
+
+  if (tracing) {
+    trace_reading(&trace);
+  }
+  if ((len = asy_read(portfd, frame, ScanFrameSize)) != ScanFrameSize) {
+    printf(len == -2 ? "Lost the connection to the analyser\n" : "Timeout!\n");
+    return READ_FAILED;
+  }
+  while ((type = parse_scan_frame(frame, point)) == SCAN_FRAME_BAD) {
+    if (++skipped > FrameResyncMax || quit) {
+      printf("Lost the binary protocol framing\n");
+      return READ_FAILED;
+    }
+    memmove(frame, frame + 1, ScanFrameSize - 1);
+    if (asy_read(portfd, frame + ScanFrameSize - 1, 1) != 1) {
+      printf("Timeout!\n");
+      return READ_FAILED;
+    }
+  }
+  if (skipped > 0) {
+    printf("Skipped %d bytes of a corrupt scan frame\n", skipped);
+  }
+  if (type == SCAN_FRAME_END) {
+    strcpy(line, "End\r\n");
+  } else {
+    sprintf(line, "%ld.%02ld,0,%ld,%ld.%02ld,%ld.%02ld\r\n",
+            point->Freq / 100L, point->Freq % 100L, point->Vswr,
+            point->Fwd / 100L, point->Fwd % 100L, point->Rev / 100L, point->Rev % 100L);
+  }
+  if (tracing) {
+    trace_frame(&trace, line, ScanFrameSize);
+  }
+  return type == SCAN_FRAME_END ? READ_END : READ_POINT;
+}
+
+
+// Read the next point of a scan started by startSweep, as a line or a
+// frame; line is set to the scan line received (or that a frame stands
+// for). Timeouts and lost framing have been reported when READ_FAILED.
+static int readScanPoint(char *line, ScanPoint *point) {
+  if (binaryProtocol) {
+    return readScanFrame(line, point);
+  }
+  if (!read_line(line, linemax)) {
+    return READ_FAILED;
+  }
+  if (strncmp("End", line, 3) == 0) {
+    return READ_END;
+  }
+  return parse_scan_line(line, point) ? READ_POINT : READ_MALFORMED;
+}
+
+
+// Whether scans keep their points, for -x or -R.
+static bool keepingPoints() {
+  return metricsFileName[0] != '\0' || findResonances;
+}
+
+
+// Derive the metrics of a complete sweep, print its summary and write them
+// to the -x file.
+static void writeMetrics(Metrics *metrics) {
+MetricsSummary summary;
+FILE *out;
+
+  metrics_compute(metrics);
+  if (metrics_summarise(metrics, &summary)) {
+    metrics_print(&summary, stdout);
+  }
+  if ((out = fopen(metricsFileName, "w")) == NULL) {
+    printf("Cannot open metrics file '%s' for write: %s\n", metricsFileName, strerror(errno));
+    finish(-1);
+  }
+  if (!metrics_write(metrics, out) | (fclose(out) != 0)) {
+    printf("Cannot write metrics file '%s': %s\n", metricsFileName, strerror(errno));
+    finish(-1);
+  }
+}
+
+
+// Report a complete sweep as -x and -R ask.
+static void reportSweep(Metrics *metrics) {
+Resonance found[ResonanceMax];
+
+  if (metricsFileName[0] != '\0') {
+    writeMetrics(metrics);
+  }
+  if (findResonances) {
+    resonance_print(found, resonance_find(metrics->Freq, metrics->Vswr, metrics->Count,
+      found, ResonanceMax), stdout);
+  }
+}
+
+
+// Ask for the rest of a sweep of which done points have arrived, the last
+// at lastFreq (Hz x 100). It restarts at the last point, so the steps fall
+// where they would have; that point is measured again, and is to be
+// ignored.
+static void sweepRest(long startFreq, long stopFreq, int numSteps, int settleDelay,
+  long done, long lastFreq) {
+  if (done == 0L) {
+    startSweep(startFreq, stopFreq, numSteps, settleDelay);
+    return;
+  }
+  startSweep((lastFreq + 50L) / 100L, stopFreq, numSteps - (int) done + 1, settleDelay);
+}
+
+
+// Read the points already in a scan file into metrics, when resuming it.
+// Text scan files don't keep the detector readings.
+static bool loadScanPoints(char *scanFileName, int scanFormat, Metrics *metrics) {
+ScanFile scan;
+ScanPoint point;
+RenderData data;
+long i;
+bool ok = TRUE;
+
+  if (scanFormat == SCAN_FORMAT_BIN) {
+    if (!scanfile_map(scanFileName, &scan)) {
+      return FALSE;
+    }
+    for (i = 0L; i < scan.Count && ok; i++) {
+      scanfile_record(&scan, i, &point);
+      ok = metrics_add(metrics, &point);
+    }
+    scanfile_unmap(&scan);
+    return ok;
+  }
+  if (!render_load(scanFileName, &data)) {
+    return FALSE;
+  }
+  for (i = 0L; i < data.Count && ok; i++) {
+    point.Freq = (long) (data.X[i] * 100000000.0 + 0.5);
+    point.Vswr = (long) (data.Y[i] * 1000.0 + 0.5);
+    point.Fwd = point.Rev = 0L;
+    ok = metrics_add(metrics, &point);
+  }
+  render_free(&data);
+  return ok;
+}
+
+
+// Add the sweep in data, read from fileName, to the -H history store. Its
+// frequencies must be evenly spaced, as the store doesn't keep them.
+static bool appendSweep(RenderData *data, char *fileName, char *title, long timestamp) {
+long *vswr;
+long startFreq, stopFreq, steps = data->Count - 1L, i;
+double expected;
+bool ok;
+
+  if (steps < 1L) {
+    printf("'%s' has too few points to add to the history\n", fileName);
+    return FALSE;
+  }
+  if ((vswr = malloc(data->Count * sizeof(long))) == NULL) {
+    printf("Cannot allocate memory for scan points\n");
+    finish(-1);
+  }
+  startFreq = (long) (data->X[0] * 1000000.0 + 0.5);
+  stopFreq = (long) (data->X[steps] * 1000000.0 + 0.5);
+  for (i = 0L; i <= steps; i++) {
+    expected = startFreq + (double) (stopFreq - startFreq) * i / steps;
+    if (fabs(data->X[i] * 1000000.0 - expected) > HistoryFreqTolerance) {
+      printf("'%s' isn't evenly spaced in frequency, so can't be added to the history\n",
+        fileName);
+      free(vswr);
+      return FALSE;
+    }
+    vswr[i] = (long) (data->Y[i] * 1000.0 + 0.5);
+  }
+  ok = history_append(historyFileName, title, timestamp, startFreq, stopFreq, steps, vswr);
+  if (!ok) {
+    printf("Cannot add '%s' to the history store '%s': %s\n", fileName, historyFileName,
+      strerror(errno));
+  }
+  free(vswr);
+  return ok;
+}
+
+
+// Add a complete scan to the -H history store.
+static void storeSweep(char *scanFileName, char *title) {
+RenderData data;
+
+  if (!render_load(scanFileName, &data)) {
+    printf("Cannot read scan file '%s': %s\n", scanFileName, strerror(errno));
+    return;
+  }
+  appendSweep(&data, scanFileName, title, (long) time(NULL));
+  render_free(&data);
+}
+
+
+// Scan, writing the points to scanFileName as they arrive. If resume is
+// given, it's an interrupted scan to that file, which is continued from its
+// last point. Each point must be the next step of the plan: if any are
+// lost, or the scan times out, the sweep is stopped and the rest asked for
+// again at once. If it's interrupted, or too many retries fail, what's been
+// received so far is kept for -e to resume.
+void scan(bool verbose, char* port, long startFreq, long stopFreq,
+  int numSteps, int settleDelay, char *scanFileName, bool hardwareFlowControl,
+  int scanFormat, char *title, Checkpoint *resume) {
+bool scan_end = FALSE;
+char line[linemax];
+ScanPoint point;
+char scanLineOutput[FormattedLineMax];
+long records = 0L, step;
+long lastFreq = 0L;
+int retries = 0, status;
+bool restarting = FALSE;
+Metrics metrics;
+Checkpoint checkpoint;
+
+  if (keepingPoints() && !metrics_init(&metrics, numSteps + 1L)) {
+    printf("Cannot allocate memory for scan points\n");
+    finish(-1);
+  }
+  if (resume == NULL) {
+    openSerialAndScanOutput(verbose, port, scanFileName, hardwareFlowControl);
+  } else {
+    openSerialAndScanOutput(verbose, port, NULL, hardwareFlowControl);
+    if ((scanOutput = fopen(scanFileName, "r+")) == NULL || fseek(scanOutput, 0L, SEEK_END) != 0) {
+      printf("Cannot open scan file '%s' for update: %s\n", scanFileName, strerror(errno));
+      finish(-1);
+    }
+    records = resume->Done;
+    lastFreq = resume->LastFreq;
+    if (records > 0L && keepingPoints() && !loadScanPoints(scanFileName, scanFormat, &metrics)) {
+      printf("Cannot read scan file '%s': %s\n", scanFileName, strerror(errno));
+      finish(-1);
+    }
+    printf("Resuming the scan to '%s' after %ld of %d points\n", scanFileName, records,
+      numSteps + 1);
+  }
+
+  if (records == 0L && ftell(scanOutput) == 0L &&
+      !scanfile_begin(scanOutput, scanFormat, startFreq, stopFreq, numSteps,
+                      settleDelay, title)) {
+    printf("Cannot write scan file header: %s\n", strerror(errno));
+    finish(-1);
+  }
+  if (resume == NULL) {
+    checkpoint.StartFreq = startFreq;
+    checkpoint.StopFreq = stopFreq;
+    checkpoint.NumSteps = numSteps;
+    checkpoint.SettleDelay = settleDelay;
+    checkpoint.Format = scanFormat;
+    strncpy(checkpoint.Title, title, ScanFileTitleMax - 1);
+    checkpoint.Title[ScanFileTitleMax - 1] = '\0';
+    if (!checkpoint_save(scanFileName, &checkpoint)) {
+      printf("Cannot save a checkpoint for '%s'; it can't be resumed: %s\n", scanFileName,
+        strerror(errno));
+    }
+  }
+
+  if (verbose) {
+    printf("start freq: %ld Hz, end freq: %ld Hz, steps: %d, settle: %d ms\n",
+      startFreq, stopFreq, numSteps, settleDelay);
+  }
+
+  sweepRest(startFreq, stopFreq, numSteps, settleDelay, records, lastFreq);
 
   if (verbose) {
     puts("Starting scan\n");
   }
   scan_end = FALSE;
   while (!quit && !scan_end) {
-    read_line_successfully(line, linemax, "Did not read the scan response\n", 8);
+    if ((status = readScanPoint(line, &point)) == READ_FAILED) {
+      if (quit) {
+        break;
+      }
+      // All the points, but not the End?
+      if (records > numSteps) {
+        scan_end = TRUE;
+        break;
+      }
+      if (++retries > ScanRetries) {
+        printf("Did not read the scan response\n");
+        break;
+      }
+      printf("Asking again for the scan from %ld Hz (retry %d of %d)\n",
+        records == 0L ? startFreq : (lastFreq + 50L) / 100L, retries, ScanRetries);
+      write_line("z");
+      asy_flush(portfd);
+      sweepRest(startFreq, stopFreq, numSteps, settleDelay, records, lastFreq);
+      restarting = TRUE;
+      continue;
+    }
 
-    if (strncmp("End", line, 3) == 0) {
-      scan_end = TRUE;
+    if (status == READ_END) {
+      if (restarting) {
+        // The end of the sweep that was stopped
+        continue;
+      }
+      if (records > numSteps) {
+        scan_end = TRUE;
+        break;
+      }
+      if (++retries > ScanRetries) {
+        printf("Did not read all the scan points\n");
+        break;
+      }
+      printf("Asking again for the scan from %ld Hz, after missing points (retry %d of %d)\n",
+        records == 0L ? startFreq : (lastFreq + 50L) / 100L, retries, ScanRetries);
+      sweepRest(startFreq, stopFreq, numSteps, settleDelay, records, lastFreq);
     }
     else {
 
@@ -347,152 +865,1590 @@ char scanLineOutput[linemax];
       } else {
         spinner();
       }
-      // Ignore the .00 parts of the fields for now...
-      sscanf(line, "%ld.00,0,%ld,%ld.00,%ld.00\n",
-             &scan_freq, &scan_vswr, &scan_fwdv, &scan_revv);
-      sprintf(scanLineOutput, "%f %f\n", scan_freq / 1000000.0, scan_vswr / 1000.0);
-      fputs(scanLineOutput, scanOutput);
+      if (status == READ_MALFORMED) {
+        printf("Ignoring malformed scan line: %s", line);
+        continue;
+      }
+      step = osl_step(startFreq, stopFreq, numSteps, point.Freq);
+      if (step == -1L) {
+        printf("Ignoring a point off the scan's steps: %s", line);
+        continue;
+      }
+      if (restarting) {
+        // Left over from the sweep that was stopped, until the one asked
+        // for starts, with the last point again (or the first)
+        if (step != (records == 0L ? 0L : records - 1L)) {
+          continue;
+        }
+        restarting = FALSE;
+      }
+      if (step < records) {
+        // Measured again, when the rest was asked for
+        continue;
+      }
+      if (step > records) {
+        // Lost some: stop the sweep, and ask for the rest again
+        if (++retries > ScanRetries) {
+          printf("Did not read all the scan points\n");
+          break;
+        }
+        printf("Missing scan points before %ld Hz; asking again from %ld Hz (retry %d of %d)\n",
+          point.Freq / 100L, records == 0L ? startFreq : (lastFreq + 50L) / 100L, retries,
+          ScanRetries);
+        write_line("z");
+        asy_flush(portfd);
+        sweepRest(startFreq, stopFreq, numSteps, settleDelay, records, lastFreq);
+        restarting = TRUE;
+        continue;
+      }
+      if (correcting && !osl_correct(&correction, &point)) {
+        printf("Ignoring a point off the calibrated steps: %s", line);
+        continue;
+      }
+      retries = 0;
+      lastFreq = point.Freq;
+      if (livePlotting) {
+        liveplot_add(&livePlot, point.Freq, point.Vswr);
+      }
+      scanfile_write(scanOutput, scanFormat, &point);
+      records++;
+      if (keepingPoints() && !metrics_add(&metrics, &point)) {
+        printf("Cannot allocate memory for scan points\n");
+        finish(-1);
+      }
       if (verbose) {
-        printf("Freq: %ld VSWR: %ld Fwd: %ld Rev: %ld\n",
-               scan_freq, scan_vswr, scan_fwdv, scan_revv);
-        printf("Output to gnuplot: %s", scanLineOutput);
+        printf("Freq: %ld.%02ld VSWR: %ld Fwd: %ld.%02ld Rev: %ld.%02ld\n",
+               point.Freq / 100, point.Freq % 100, point.Vswr,
+               point.Fwd / 100, point.Fwd % 100, point.Rev / 100, point.Rev % 100);
+        if (scanFormat == SCAN_FORMAT_TEXT) {
+          format_scan_point(scanLineOutput, &point);
+          printf("Output to gnuplot: %s", scanLineOutput);
+        }
       }
     }
   }
 
-  if (quit) {
+  if (scanFormat == SCAN_FORMAT_BIN && scan_end) {
+    scanfile_finish(scanOutput, records);
+  }
+
+  if (!scan_end) {
     puts("Terminating scan...\n");
     write_line("z");
     asy_flush(portfd);
   }
 
   closeSerialAndScanOutput();
+
+  if (scan_end) {
+    checkpoint_remove(scanFileName);
+    if (historyFileName[0] != '\0') {
+      storeSweep(scanFileName, title);
+    }
+  } else {
+    // Keep what's been received, to resume
+    scanFileTemporary = FALSE;
+    printf("Scan interrupted after %ld of %d points; resume it with -e%s\n",
+      records, numSteps + 1, scanFileName);
+  }
+
+  if (keepingPoints()) {
+    if (scan_end) {
+      reportSweep(&metrics);
+    }
+    metrics_free(&metrics);
+  }
+  freeCorrection();
+  if (!scan_end && !quit) {
+    finish(8);
+  }
 }
 
-void oscilloscope(bool verbose, char* port, long startFreq, int settleDelay, char *scanFileName, int plotType, bool hardwareFlowControl) {
-bool scan_end = FALSE;
+
+// Run one sweep, adding its points to refining. FALSE if interrupted.
+static bool sweepInto(bool verbose, Refinement *refining, long startFreq,
+  long stopFreq, int numSteps, int settleDelay) {
 char line[linemax];
-long sample_num, voltage;
-char scanLineOutput[linemax];
+ScanPoint point;
+int status;
 
-  openSerialAndScanOutput(verbose, port, scanFileName, hardwareFlowControl); 
   if (verbose) {
-    printf("Start freq: %ld Hz, settle: %d ms\n", startFreq, settleDelay);
+    printf("Sweep: start freq: %ld Hz, end freq: %ld Hz, steps: %d\n",
+      startFreq, stopFreq, numSteps);
   }
-
-  if (startFreq != 0L) {
-    sprintf(line, "%ldA", startFreq);
-    write_line_successfully(line, "Could not set start frequency\n", 3);
+  startSweep(startFreq, stopFreq, numSteps, settleDelay);
+  while (!quit) {
+    if ((status = readScanPoint(line, &point)) == READ_FAILED) {
+      puts("Did not read the scan response\n");
+      finish(8);
+    }
+    if (status == READ_END) {
+      return TRUE;
+    }
+    if (verbose) {
+      printf("Scan Line: %s", line);
+    } else {
+      spinner();
+    }
+    if (status == READ_MALFORMED) {
+      printf("Ignoring malformed scan line: %s", line);
+      continue;
+    }
+    if (!refine_add(refining, &point)) {
+      printf("Cannot allocate memory for scan points\n");
+      finish(-1);
+    }
   }
+  return FALSE;
+}
 
-  sprintf(line, "%dD", settleDelay);
-  write_line_successfully(line, "Could not set settle delay\n", 6);
 
-  if (plotType == PLOT_TYPE_FWD) {
-    write_line_successfully("F", "Could not request forward measurement\n", 7);
-    if (verbose) {
-      puts("Measuring forward detector\n");
-    }
-  } else if (plotType == PLOT_TYPE_REV) {
-    write_line_successfully("E", "Could not request reverse measurement\n", 7);
-    if (verbose) {
-      puts("Measuring reverse detector\n");
+// Scan adaptively: a coarse sweep of numSteps, then follow-up sweeps around
+// the dips and steep sides until they're resolved to resolution Hz. All the
+// points are written, in frequency order, to the scan file.
+void refineScan(bool verbose, char* port, long startFreq, long stopFreq,
+  int numSteps, int settleDelay, char *scanFileName, bool hardwareFlowControl,
+  int scanFormat, char *title, long resolution) {
+Refinement refining;
+Sweep sweeps[RefineMaxSweeps];
+Metrics metrics;
+bool complete;
+int passes = 0, sweepCount = 1, n, i;
+long best;
+
+  openSerialAndScanOutput(verbose, port, scanFileName, hardwareFlowControl);
+  refine_init(&refining, resolution);
+
+  complete = sweepInto(verbose, &refining, startFreq, stopFreq, numSteps, settleDelay);
+  while (complete && passes < RefineMaxPasses &&
+         (n = refine_next(&refining, sweeps, RefineMaxSweeps)) > 0) {
+    passes++;
+    for (i = 0; i < n && complete; i++) {
+      complete = sweepInto(verbose, &refining, sweeps[i].StartFreq, sweeps[i].StopFreq,
+                           sweeps[i].NumSteps, settleDelay);
+      sweepCount++;
     }
   }
- 
-  write_line_successfully("o", "Could not start oscilloscope\n", 7);
+  refine_sort(&refining);
 
-  if (verbose) {
-    puts("Starting oscilloscope\n");
+  if (!scanfile_begin(scanOutput, scanFormat, startFreq, stopFreq, refining.Count - 1L,
+                      settleDelay, title)) {
+    printf("Cannot write scan file header: %s\n", strerror(errno));
+    finish(-1);
+  }
+  for (i = 0; i < refining.Count; i++) {
+    scanfile_write(scanOutput, scanFormat, &refining.Points[i]);
+  }
+  if (scanFormat == SCAN_FORMAT_BIN && complete) {
+    scanfile_finish(scanOutput, refining.Count);
   }
-  scan_end = FALSE;
-  while (!quit && !scan_end) {
-    read_line_successfully(line, linemax, "Did not read the oscilloscope response\n", 8);
 
-    if (strncmp("End", line, 3) == 0) {
-      scan_end = TRUE;
+  if (keepingPoints() && complete) {
+    if (!metrics_init(&metrics, refining.Count + 1L)) {
+      printf("Cannot allocate memory for scan points\n");
+      finish(-1);
     }
-    else {
-
-      if (verbose) {
-        printf("Oscilloscope Line: %s", line);
-      } else {
-        spinner();
-      }
-      // Ignore the .00 parts of the fields for now...
-      sscanf(line, "%ld %ld\n", &sample_num, &voltage);
-      sprintf(scanLineOutput, "%ld %ld\n", sample_num, voltage);
-      fputs(scanLineOutput, scanOutput);
-      if (verbose) {
-        printf("Sample: %ld Voltage: %ld\n", sample_num, voltage);
-        printf("Output to gnuplot: %s", scanLineOutput);
-      }
+    for (i = 0; i < refining.Count; i++) {
+      metrics_add(&metrics, &refining.Points[i]);
     }
+    reportSweep(&metrics);
+    metrics_free(&metrics);
+  }
+
+  best = refine_best(&refining);
+  if (best != -1L) {
+    printf("Refined: %ld points from %d sweeps in %d passes; lowest VSWR %ld.%03ld at %ld Hz\n",
+      refining.Count, sweepCount, passes,
+      refining.Points[best].Vswr / 1000L, refining.Points[best].Vswr % 1000L,
+      refining.Points[best].Freq / 100L);
+  }
+  refine_free(&refining);
+
+  if (quit) {
+    puts("Terminating scan...\n");
+    write_line("z");
+    asy_flush(portfd);
   }
 
   closeSerialAndScanOutput();
 }
 
 
-void plot(bool window, char *title, char *term, 
-  char *plotFileName, char *scanFileName, int plotType) {
-char gnuplotCommand[linemax];
-char *gnuplotCommandsFileName = allocateTempFileName();
-char termTitleCommand[linemax];
-
-  // Include the title in the plot if the terminal type supports it in the 
-  // term command. gif, jpeg, png don't. 
-  termTitleCommand[0] = '\0';
-  if (strcmp(term, "aqua") == 0 ||
-      strcmp(term, "x11") == 0) {
-    sprintf(termTitleCommand, " title \"%s\"", title);
+// Rewrite the monitor file: frequency, then the latest, average, min-hold
+// and max-hold VSWRs. It's replaced in one go, so readers never see a
+// partial sweep.
+static void writeMonitorFile(char *scanFileName, Monitor *mon) {
+char tempName[fileNameMax + 8];
+char line[FormattedLineMax * 2];
+ScanPoint point;
+FILE *out;
+long i, held[3];
+int len, j;
+
+  snprintf(tempName, sizeof(tempName), "%s.new", scanFileName);
+  if ((out = fopen(tempName, "w")) == NULL) {
+    printf("Cannot open monitor file '%s' for write: %s\n", tempName, strerror(errno));
+    return;
   }
+  point.Fwd = point.Rev = 0L;
+  for (i = 0L; i < mon->Points; i++) {
+    point.Freq = mon->Freq[i];
+    point.Vswr = monitor_latest(mon, i);
+    len = format_scan_point(line, &point) - 1;
+    held[0] = monitor_average(mon, i);
+    held[1] = mon->MinHold[i];
+    held[2] = mon->MaxHold[i];
+    for (j = 0; j < 3; j++) {
+      line[len++] = ' ';
+      len += format_fixed(line + len, held[j], 3);
+      /* The same "%f" precision as the latest */
+      memcpy(line + len, "000", 3);
+      len += 3;
+    }
+    line[len++] = '\n';
+    fwrite(line, 1, len, out);
+  }
+  if (fclose(out) == EOF || rename(tempName, scanFileName) == -1) {
+    printf("Cannot write monitor file '%s': %s\n", scanFileName, strerror(errno));
+    unlink(tempName);
+  }
+}
 
-  // Generate the plot
-  gnuplotCommandsOutput = fopen(gnuplotCommandsFileName, "w+");
-  if (gnuplotCommandsOutput == NULL) {
-    printf("Cannot open gnuplot commands file '%s' for write: %s\n", gnuplotCommandsFileName, strerror(errno));
+
+// Sweep back to back until interrupted, keeping the last history sweeps,
+// and warning when the resonance drifts from that of the first sweep.
+void monitorScan(bool verbose, char* port, long startFreq, long stopFreq,
+  int numSteps, int settleDelay, char *scanFileName, bool hardwareFlowControl,
+  char *title, int history, long driftFreq, long driftVswr) {
+char line[linemax];
+ScanPoint point;
+Monitor mon;
+long *freq, *vswr;
+long points = numSteps + 1L, n;
+bool sweep_end;
+int state, status;
+
+  freq = malloc(points * sizeof(long));
+  vswr = malloc(points * sizeof(long));
+  if (freq == NULL || vswr == NULL ||
+      !monitor_init(&mon, points, history, driftFreq * 100L, driftVswr)) {
+    printf("Cannot allocate memory for %d sweeps of %ld points\n", history, points);
     finish(-1);
   }
 
-  fprintf(gnuplotCommandsOutput, "set term %s size 600,400%s\n", 
-    term, termTitleCommand);
-  if (plotFileName[0] != '\0') {
-    fprintf(gnuplotCommandsOutput, "set output \"%s\"\n", plotFileName);
-  }
-  fprintf(gnuplotCommandsOutput, "set xtics scale 2,1\n");
-  fprintf(gnuplotCommandsOutput, "set mxtics 5\n");
-  fprintf(gnuplotCommandsOutput, "set linetype 1 lw 1 lc rgb \"blue\" pointtype 0\n");
-  if (plotType == PLOT_TYPE_VSWR) {
-    fprintf(gnuplotCommandsOutput, "set xlabel 'Frequency (MHz)'\n");
-    fprintf(gnuplotCommandsOutput, "set ylabel 'SWR'\n");
-    fprintf(gnuplotCommandsOutput, "plot '%s' smooth bezier title '%s'\n", 
-      scanFileName, title);
-  } else if (plotType == PLOT_TYPE_FWD) {
-    fprintf(gnuplotCommandsOutput, "set xlabel 'Samples'\n");
-    fprintf(gnuplotCommandsOutput, "set ylabel 'Forward Detector'\n");
-    fprintf(gnuplotCommandsOutput, "plot '%s' smooth bezier title 'Approximate', '%s' with points title 'Measurements'\n",
-      scanFileName, scanFileName);
-  } else if (plotType == PLOT_TYPE_REV) {
-    fprintf(gnuplotCommandsOutput, "set xlabel 'Samples'\n");
-    fprintf(gnuplotCommandsOutput, "set ylabel 'Reverse Detector'\n");
-    fprintf(gnuplotCommandsOutput, "plot '%s' smooth bezier title 'Approximate', '%s' with points title 'Measurements'\n",
-      scanFileName, scanFileName);
+  openSerialAndScanOutput(verbose, port, NULL, hardwareFlowControl);
+  if (verbose) {
+    printf("Monitoring: start freq: %ld Hz, end freq: %ld Hz, steps: %d, settle: %d ms, history: %d\n",
+      startFreq, stopFreq, numSteps, settleDelay, history);
   }
-  fclose(gnuplotCommandsOutput);
-    
-  sprintf(gnuplotCommand, "gnuplot %s --persist", gnuplotCommandsFileName);
-  system(gnuplotCommand);
+
+  while (!quit) {
+    startSweep(startFreq, stopFreq, numSteps, settleDelay);
+    n = 0L;
+    sweep_end = FALSE;
+    while (!quit && !sweep_end) {
+      if ((status = readScanPoint(line, &point)) == READ_FAILED) {
+        puts("Did not read the scan response\n");
+        finish(8);
+      }
+      if (status == READ_END) {
+        sweep_end = TRUE;
+      } else if (status == READ_MALFORMED) {
+        printf("Ignoring malformed scan line: %s", line);
+      } else if (correcting && !osl_correct(&correction, &point)) {
+        printf("Ignoring a point off the calibrated steps: %s", line);
+      } else {
+        if (n < points) {
+          freq[n] = point.Freq;
+          vswr[n] = point.Vswr;
+        }
+        n++;
+      }
+    }
+    if (!sweep_end) {
+      break;
+    }
+    if (n != points) {
+      printf("Sweep %ld: expected %ld points, got %ld; ignored\n", mon.Sweeps + 1L, points, n);
+      continue;
+    }
+
+    state = monitor_add(&mon, freq, vswr);
+    printf("Sweep %ld: resonance %ld Hz, SWR %ld.%03ld",
+      mon.Sweeps, mon.ResonanceFreq / 100L, mon.ResonanceVswr / 1000L, mon.ResonanceVswr % 1000L);
+    if (state == MONITOR_RAISED || state == MONITOR_ALARM) {
+      printf("; ALARM: drifted from %ld Hz, SWR %ld.%03ld",
+        mon.BaselineFreq / 100L, mon.BaselineVswr / 1000L, mon.BaselineVswr % 1000L);
+    } else if (state == MONITOR_CLEARED) {
+      printf("; alarm cleared");
+    }
+    printf("\n");
+    fflush(stdout);
+    writeMonitorFile(scanFileName, &mon);
+    if (historyFileName[0] != '\0' &&
+        !history_append(historyFileName, title, (long) time(NULL), startFreq, stopFreq,
+                        numSteps, vswr)) {
+      printf("Cannot add the sweep to the history store '%s': %s\n", historyFileName,
+        strerror(errno));
+    }
+  }
+
+  puts("Terminating monitoring...\n");
+  write_line("z");
+  asy_flush(portfd);
+  closeSerialAndScanOutput();
+  monitor_free(&mon);
+  free(freq);
+  free(vswr);
+  freeCorrection();
+}
+
+
+// Make one sweep for tuning, putting its points in freq (MHz) and vswr,
+// which have room for them. The number of points, or -1 if interrupted.
+static long tuneSweep(long startFreq, long stopFreq, int numSteps, int settleDelay,
+  double *freq, double *vswr) {
+char line[linemax];
+ScanPoint point;
+long n = 0L;
+int status;
+
+  startSweep(startFreq, stopFreq, numSteps, settleDelay);
+  while (!quit) {
+    if ((status = readScanPoint(line, &point)) == READ_FAILED) {
+      puts("Did not read the scan response\n");
+      finish(8);
+    }
+    if (status == READ_END) {
+      return n;
+    }
+    if (status == READ_POINT && n <= numSteps) {
+      freq[n] = point.Freq / 100000000.0;
+      vswr[n] = point.Vswr / 1000.0;
+      n++;
+    }
+  }
+  return -1L;
+}
+
+
+// The resonance of a tuning sweep: its lowest dip. NULL if it has none,
+// when *lowest is set to the frequency (Hz) of its lowest point.
+static Resonance *tuneDip(double *freq, double *vswr, long n, Resonance *found,
+  long *lowest) {
+int count, i, best = -1;
+long j, low = 0L;
+
+  count = resonance_find(freq, vswr, n, found, ResonanceMax);
+  for (i = 0; i < count; i++) {
+    if (best == -1 || found[i].Vswr < found[best].Vswr) {
+      best = i;
+    }
+  }
+  if (best != -1) {
+    *lowest = (long) (found[best].Freq * 1000000.0 + 0.5);
+    return &found[best];
+  }
+  for (j = 1L; j < n; j++) {
+    if (vswr[j] < vswr[low]) {
+      low = j;
+    }
+  }
+  *lowest = (long) (freq[low] * 1000000.0 + 0.5);
+  return NULL;
+}
+
+
+static double secondsSince(struct timespec *started) {
+struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - started->tv_sec) + (now.tv_nsec - started->tv_nsec) / 1e9;
+}
+
+
+// Tune: scan startFreq to stopFreq to find the dip, then sweep a window of
+// span Hz around it rate times a second until interrupted, following it,
+// and draw each sweep in the terminal.
+void tuneScan(bool verbose, char* port, long startFreq, long stopFreq,
+  int numSteps, int settleDelay, bool hardwareFlowControl, double rate, long span) {
+Tuner tuner;
+TuneScreen screen;
+Resonance found[ResonanceMax], *dip;
+struct timespec started;
+double *freq, *vswr;
+long points = (numSteps > TuneMaxPoints ? numSteps : TuneMaxPoints) + 1L;
+long n, lowest;
+int steps, settle;
+bool window = FALSE;
+
+  freq = malloc(points * sizeof(double));
+  vswr = malloc(points * sizeof(double));
+  if (freq == NULL || vswr == NULL) {
+    printf("Cannot allocate memory for %ld points\n", points);
+    finish(-1);
+  }
+  tune_init(&tuner, rate, startFreq, stopFreq, span, settleDelay);
+  memset(&screen, 0, sizeof(screen));
+
+  openSerialAndScanOutput(verbose, port, NULL, hardwareFlowControl);
+  if (verbose) {
+    printf("Tuning: start freq: %ld Hz, end freq: %ld Hz, window: %ld Hz, rate: %.1f/s\n",
+      startFreq, stopFreq, tuner.Span, rate);
+  }
+
+  // The whole range, to find the dip and time the analyser
+  steps = numSteps;
+  settle = settleDelay;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  n = tuneSweep(startFreq, stopFreq, steps, settle, freq, vswr);
+  while (n > 1L) {
+    tune_plan(&tuner, secondsSince(&started), n, settle);
+    dip = tuneDip(freq, vswr, n, found, &lowest);
+    if (window) {
+      tune_draw(&screen, stdout, &tuner, freq, vswr, n, dip);
+    }
+    tune_recentre(&tuner, lowest);
+    window = TRUE;
+    steps = tuner.Points - 1;
+    settle = tuner.Settle;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    n = tuneSweep(tune_start(&tuner), tune_stop(&tuner), steps, settle, freq, vswr);
+  }
+
+  tune_end(&screen, stdout);
+  puts("Terminating tuning...\n");
+  write_line("z");
+  asy_flush(portfd);
+  closeSerialAndScanOutput();
+  free(freq);
+  free(vswr);
+}
+
+
+// Capture the detector voltage. If rotateBytes or rotateSeconds is given,
+// capture over and over until interrupted, numbering the samples on from
+// one capture to the next, into segments of scanFileName of at most that
+// size or duration.
+void oscilloscope(bool verbose, char* port, long startFreq, int settleDelay, char *scanFileName, int plotType, bool hardwareFlowControl,
+  bool statistics, long rotateBytes, long rotateSeconds) {
+bool scan_end = FALSE;
+bool rotating = rotateBytes > 0L || rotateSeconds > 0L;
+char line[linemax];
+OscPoint point;
+char scanLineOutput[FormattedLineMax];
+int len;
+long firstSample = 0L, nextSample = 0L;
+OscStats stats;
+Capture capture;
+
+  oscstats_init(&stats);
+  if (rotating && !capture_open(&capture, scanFileName, rotateBytes, rotateSeconds)) {
+    printf("Cannot allocate memory for the capture\n");
+    finish(-1);
+  }
+  openSerialAndScanOutput(verbose, port, rotating ? NULL : scanFileName, hardwareFlowControl);
+  if (verbose) {
+    printf("Start freq: %ld Hz, settle: %d ms\n", startFreq, settleDelay);
+  }
+
+  if (startFreq != 0L) {
+    sprintf(line, "%ldA", startFreq);
+    write_line_successfully(line, "Could not set start frequency\n", 3);
+  }
+
+  sprintf(line, "%dD", settleDelay);
+  write_line_successfully(line, "Could not set settle delay\n", 6);
+
+  if (plotType == PLOT_TYPE_FWD) {
+    write_line_successfully("F", "Could not request forward measurement\n", 7);
+    if (verbose) {
+      puts("Measuring forward detector\n");
+    }
+  } else if (plotType == PLOT_TYPE_REV) {
+    write_line_successfully("E", "Could not request reverse measurement\n", 7);
+    if (verbose) {
+      puts("Measuring reverse detector\n");
+    }
+  }
+ 
+  write_line_successfully("o", "Could not start oscilloscope\n", 7);
+  if (tracing) {
+    trace_start(&trace);
+  }
+
+  if (verbose) {
+    puts("Starting oscilloscope\n");
+  }
+  scan_end = FALSE;
+  while (!quit && !scan_end) {
+    read_line_successfully(line, linemax, "Did not read the oscilloscope response\n", 8);
+
+    if (strncmp("End", line, 3) == 0 && rotating) {
+      // And the next capture
+      firstSample = nextSample;
+      write_line_successfully("o", "Could not start oscilloscope\n", 7);
+      if (tracing) {
+        trace_start(&trace);
+      }
+    }
+    else if (strncmp("End", line, 3) == 0) {
+      scan_end = TRUE;
+    }
+    else {
+
+      if (verbose) {
+        printf("Oscilloscope Line: %s", line);
+      } else {
+        spinner();
+      }
+      if (!parse_osc_line(line, &point)) {
+        printf("Ignoring malformed oscilloscope line: %s", line);
+        continue;
+      }
+      if (livePlotting) {
+        liveplot_add(&livePlot, point.Sample, point.Value);
+      }
+      if (statistics) {
+        oscstats_add(&stats, point.Value);
+      }
+      if (rotating) {
+        point.Sample += firstSample;
+        nextSample = point.Sample + 1L;
+        len = format_osc_point(scanLineOutput, &point);
+        if (!capture_write(&capture, point.Sample, scanLineOutput, len)) {
+          printf("Cannot write capture segment '%s': %s\n", capture.Name, strerror(errno));
+          finish(-1);
+        }
+      } else {
+        len = format_osc_point(scanLineOutput, &point);
+        fwrite(scanLineOutput, 1, len, scanOutput);
+      }
+      if (verbose) {
+        printf("Sample: %ld Voltage: %ld\n", point.Sample, point.Value);
+        printf("Output to gnuplot: %s", scanLineOutput);
+      }
+    }
+  }
+
+  if (rotating) {
+    puts("Terminating capture...\n");
+    write_line("z");
+    asy_flush(portfd);
+  }
+  closeSerialAndScanOutput();
+
+  if (rotating) {
+    if (!capture_close(&capture)) {
+      printf("Cannot write capture segment '%s': %s\n", capture.Name, strerror(errno));
+      finish(-1);
+    }
+    printf("Captured %ld samples in %d segments, listed in %s.manifest\n", nextSample,
+      capture.Segments, scanFileName);
+  }
+
+  if (statistics) {
+    oscstats_report(&stats, stdout, verbose);
+  }
+}
+
+
+// How long the DDS is held at a frequency before calibrating the change
+// from it, and the settle delay while capturing the change: the smallest,
+// so the capture samples as fast as the analyser can.
+#define CalibrateParkDelay 200
+#define CalibrateCaptureDelay 1
+
+// Capture a detector (F or E) as the DDS moves from fromFreq to toFreq.
+// values has room for CalibrateSamplesMax; periodMs is set to the time
+// between samples. FALSE if interrupted.
+static bool captureChange(long fromFreq, long toFreq, char *detector, long *values,
+  long *count, double *periodMs) {
+char line[linemax];
+OscPoint point;
+ScanPoint parked;
+struct timespec first, last;
+int status;
+
+  startSweep(fromFreq, fromFreq, 1, CalibrateParkDelay);
+  do {
+    if ((status = readScanPoint(line, &parked)) == READ_FAILED) {
+      puts("Did not read the scan response\n");
+      finish(8);
+    }
+  } while (!quit && status != READ_END);
+
+  sprintf(line, "%ldA", toFreq);
+  write_line_successfully(line, "Could not set start frequency\n", 3);
+  sprintf(line, "%dD", CalibrateCaptureDelay);
+  write_line_successfully(line, "Could not set settle delay\n", 6);
+  write_line_successfully(detector, "Could not choose the detector\n", 7);
+  write_line_successfully("o", "Could not start oscilloscope\n", 7);
+  if (tracing) {
+    trace_start(&trace);
+  }
+
+  *count = 0L;
+  while (!quit) {
+    read_line_successfully(line, linemax, "Did not read the oscilloscope response\n", 8);
+    if (strncmp("End", line, 3) == 0) {
+      break;
+    }
+    if (!parse_osc_line(line, &point) || *count == CalibrateSamplesMax) {
+      continue;
+    }
+    clock_gettime(CLOCK_MONOTONIC, *count == 0L ? &first : &last);
+    values[(*count)++] = point.Value;
+  }
+  *periodMs = *count < 2L ? 0.0 :
+    ((last.tv_sec - first.tv_sec) * 1000.0 + (last.tv_nsec - first.tv_nsec) / 1000000.0) /
+    (*count - 1L);
+  return !quit;
+}
+
+
+// Measure how long the detectors take to settle after the DDS jumps between
+// startFreq and stopFreq (each way), and save the shortest settle delay that
+// keeps the SWR within tolerance, for this port's future scans. oldSettle
+// is the settle delay scans would have used, to compare.
+void calibrate(bool verbose, char *port, bool hardwareFlowControl, long startFreq,
+  long stopFreq, double tolerance, int oldSettle, int numSteps) {
+static long fwd[CalibrateSamplesMax], rev[CalibrateSamplesMax];
+char fileName[fileNameMax * 2];
+CalibrateStep steps[2];
+long fwdCount, revCount, from, to;
+double fwdPeriod, revPeriod, worst = 0.0, oldWait, newWait;
+int i, settle;
+
+  openSerialAndScanOutput(verbose, port, NULL, hardwareFlowControl);
+  for (i = 0; i < 2; i++) {
+    from = i == 0 ? startFreq : stopFreq;
+    to = i == 0 ? stopFreq : startFreq;
+    if (!captureChange(from, to, "F", fwd, &fwdCount, &fwdPeriod) ||
+        !captureChange(from, to, "E", rev, &revCount, &revPeriod)) {
+      puts("Calibration interrupted\n");
+      write_line("z");
+      asy_flush(portfd);
+      closeSerialAndScanOutput();
+      finish(1);
+    }
+    if (!calibrate_step(fwd, rev, fwdCount < revCount ? fwdCount : revCount,
+                        (fwdPeriod + revPeriod) / 2.0, tolerance, &steps[i])) {
+      printf("Too few oscilloscope readings to calibrate with\n");
+      closeSerialAndScanOutput();
+      finish(1);
+    }
+    printf("%f MHz -> %f MHz: SWR %.3f, ", from / 1000000.0, to / 1000000.0, steps[i].FinalSwr);
+    if (!steps[i].Settled) {
+      printf("did not settle within %.0f ms\n", fwdCount * fwdPeriod * 0.75);
+    } else {
+      printf("settled to within %.3f in %.1f ms (sampled every %.2f ms)\n",
+        steps[i].Allowed, steps[i].SettleMs, (fwdPeriod + revPeriod) / 2.0);
+    }
+    if (steps[i].SettleMs > worst) {
+      worst = steps[i].SettleMs;
+    }
+  }
+  closeSerialAndScanOutput();
+  if (!steps[0].Settled || !steps[1].Settled) {
+    printf("The detectors did not settle; keeping a settle delay of %d ms\n", oldSettle);
+    finish(1);
+  }
+
+  settle = (int) ceil(worst);
+  calibrate_file_name(fileName, sizeof(fileName));
+  if (!calibrate_save(fileName, serverSocket[0] != '\0' ? serverSocket : port, settle)) {
+    printf("Cannot save the settle delay in '%s': %s\n", fileName, strerror(errno));
+    finish(1);
+  }
+  printf("Settle delay: %d ms, saved in %s for scans with %s\n", settle, fileName,
+    serverSocket[0] != '\0' ? serverSocket : port);
+  oldWait = (numSteps + 1) * oldSettle / 1000.0;
+  newWait = (numSteps + 1) * settle / 1000.0;
+  printf("A %d step scan will spend %.2f s settling rather than %.2f s with %d ms",
+    numSteps, newWait, oldWait, oldSettle);
+  if (oldWait > 0.0) {
+    printf(": %.2f s (%.0f%%) %s", fabs(oldWait - newWait),
+      fabs(oldWait - newWait) * 100.0 / oldWait, newWait <= oldWait ? "less" : "more");
+  }
+  printf("\n");
+}
+
+
+// The settle delay for scans with port: as calibrated by -C, or given.
+static int portSettle(char *port, int given) {
+char fileName[fileNameMax * 2];
+int settle;
+
+  calibrate_file_name(fileName, sizeof(fileName));
+  settle = calibrate_load(fileName, serverSocket[0] != '\0' ? serverSocket : port);
+  return settle >= 0 ? settle : given;
+}
+
+
+// Correct scans of the plan with the open/short/load calibration that
+// covers it, if there is one.
+static void prepareCorrection(long startFreq, long stopFreq, int numSteps) {
+OslTable table;
+
+  if (!osl_find(startFreq, stopFreq, numSteps, &table)) {
+    return;
+  }
+  if (!osl_prepare(&table, startFreq, stopFreq, numSteps, &correction)) {
+    printf("Cannot allocate memory for the calibration\n");
+    finish(-1);
+  }
+  printf("Correcting with the open/short/load calibration of %ld-%ld Hz, %d steps\n",
+    table.StartFreq, table.StopFreq, table.NumSteps);
+  osl_free(&table);
+  correcting = TRUE;
+}
+
+
+// Measure a calibration standard with a scan of the plan, and record it in
+// the plan's calibration, which is complete once all three have been.
+static void measureStandard(bool verbose, char *port, long startFreq, long stopFreq,
+  int numSteps, int settleDelay, char *scanFileName, bool hardwareFlowControl,
+  char *title, int standard, double loadOhms) {
+char fileName[fileNameMax * 2];
+OslTable table;
+ScanFile measured;
+ScanPoint point;
+long i;
+int s;
+
+  osl_file_name(fileName, sizeof(fileName), startFreq, stopFreq, numSteps);
+  if (!osl_load(fileName, &table) && !osl_init(&table, startFreq, stopFreq, numSteps)) {
+    printf("Cannot allocate memory for the calibration\n");
+    finish(-1);
+  }
+
+  // Binary, for the detector readings
+  scan(verbose, port, startFreq, stopFreq, numSteps, settleDelay, scanFileName,
+    hardwareFlowControl, SCAN_FORMAT_BIN, title, NULL);
+  if (!scanfile_map(scanFileName, &measured) || measured.Count != numSteps + 1L) {
+    printf("The %s was not measured: the scan did not complete\n", osl_standard_name(standard));
+    finish(1);
+  }
+  for (i = 0L; i < measured.Count; i++) {
+    scanfile_record(&measured, i, &point);
+    osl_record(&table, standard, osl_step(startFreq, stopFreq, numSteps, point.Freq), &point);
+  }
+  scanfile_unmap(&measured);
+  if (standard == OSL_LOAD) {
+    table.LoadOhms = loadOhms;
+  }
+
+  if (!osl_save(fileName, &table)) {
+    printf("Cannot save the calibration to '%s': %s\n", fileName, strerror(errno));
+    finish(1);
+  }
+  printf("Measured the %s from %ld to %ld Hz in %d steps\n", osl_standard_name(standard),
+    startFreq, stopFreq, numSteps);
+  if (osl_complete(&table)) {
+    printf("The calibration is complete; scans within this range will be corrected\n");
+  } else {
+    printf("Still to measure:");
+    for (s = 0; s < OslStandards; s++) {
+      if (!table.Measured[s]) {
+        printf(" %s", osl_standard_name(s));
+      }
+    }
+    printf("\n");
+  }
+  osl_free(&table);
+}
+
+
+// Scan with several analysers at once. Ports without their own -f scan to
+// <file>.1, <file>.2 ... if -f was given before the ports, or to temporary
+// files.
+bool scanDevices(Device *devices, int deviceCount, bool verbose,
+  bool hardwareFlowControl, int scanFormat, char *title) {
+char *temporary[MaxDevices];
+bool ok;
+int i;
+
+  for (i = 0; i < deviceCount; i++) {
+    temporary[i] = NULL;
+    if (devices[i].StartFreq == 0L || devices[i].StopFreq == 0L) {
+      printf("%s: You must give -a/-b to run a scan\n", devices[i].Port);
+      return FALSE;
+    }
+    if (devices[i].ScanFileName[0] != '\0') {
+      continue;
+    }
+    if (!scanFileTemporary) {
+      snprintf(devices[i].ScanFileName, DeviceFileNameMax, "%.120s.%d", scanFileName, i + 1);
+    } else {
+      temporary[i] = allocateTempFileName();
+      strncpy(devices[i].ScanFileName, temporary[i], DeviceFileNameMax - 1);
+    }
+  }
+
+  /* Trap CTRL-C */
+  signal(SIGINT, &sighandler);
+  ok = multiscan(devices, deviceCount, verbose, hardwareFlowControl, scanFormat, title, &quit);
+
+  for (i = 0; i < deviceCount; i++) {
+    if (temporary[i] != NULL) {
+      unlink(temporary[i]);
+      free(temporary[i]);
+    }
+  }
+  return ok;
+}
+
+
+// Split one scan across several analysers, scanning the sub-ranges at once,
+// then stitch their results together in frequency order into scanFileName,
+// laid out exactly as scan() would have written it.
+bool splitScan(Device *devices, int deviceCount, bool verbose,
+  bool hardwareFlowControl, int scanFormat, char *title, long startFreq,
+  long stopFreq, int numSteps, int settleDelay) {
+char *temporary[MaxDevices];
+FILE *output;
+long records = 0L;
+bool ok;
+int i;
+
+  if (startFreq >= stopFreq || numSteps < 1) {
+    printf("Cannot split a scan from %ld Hz to %ld Hz in %d steps\n", startFreq, stopFreq, numSteps);
+    return FALSE;
+  }
+  deviceCount = multiscan_split(devices, deviceCount, startFreq, stopFreq, numSteps);
+  for (i = 0; i < deviceCount; i++) {
+    devices[i].SettleDelay = settleDelay;
+    temporary[i] = allocateTempFileName();
+    strncpy(devices[i].ScanFileName, temporary[i], DeviceFileNameMax - 1);
+  }
+
+  /* Trap CTRL-C */
+  signal(SIGINT, &sighandler);
+  ok = multiscan(devices, deviceCount, verbose, hardwareFlowControl, scanFormat, title, &quit);
+
+  if (ok) {
+    if ((output = fopen(scanFileName, "w")) == NULL) {
+      printf("Cannot open scan file '%s' for write: %s\n", scanFileName, strerror(errno));
+      ok = FALSE;
+    } else {
+      ok = scanfile_begin(output, scanFormat, startFreq, stopFreq, numSteps, settleDelay, title);
+      for (i = 0; i < deviceCount && ok; i++) {
+        ok = scanfile_append(output, scanFormat, devices[i].ScanFileName, &records);
+      }
+      if (ok && scanFormat == SCAN_FORMAT_BIN) {
+        ok = scanfile_finish(output, records);
+      }
+      if (fclose(output) == EOF) {
+        ok = FALSE;
+      }
+      if (!ok) {
+        printf("Cannot write scan file '%s'\n", scanFileName);
+      } else if (verbose) {
+        printf("Stitched %ld points into %s\n", records, scanFileName);
+      }
+    }
+  }
+
+  for (i = 0; i < deviceCount; i++) {
+    unlink(temporary[i]);
+    free(temporary[i]);
+  }
+  return ok;
+}
+
+
+// The axis labels of each type of plot.
+static char *plotXLabel(int plotType) {
+  return plotType == PLOT_TYPE_VSWR ? "Frequency (MHz)" : "Samples";
+}
+
+static char *plotYLabel(int plotType) {
+  return plotType == PLOT_TYPE_VSWR ? "SWR" :
+         plotType == PLOT_TYPE_FWD ? "Forward Detector" : "Reverse Detector";
+}
+
+
+// The terminal, labels and styling common to saved and live plots.
+static void writePlotSettings(FILE *out, char *title, char *term,
+  char *plotFileName, int plotType) {
+char termTitleCommand[linemax];
+
+  // Include the title in the plot if the terminal type supports it in the 
+  // term command. gif, jpeg, png don't. 
+  termTitleCommand[0] = '\0';
+  if (strcmp(term, "aqua") == 0 ||
+      strcmp(term, "x11") == 0) {
+    sprintf(termTitleCommand, " title \"%s\"", title);
+  }
+
+  fprintf(out, "set term %s size 600,400%s\n", 
+    term, termTitleCommand);
+  if (plotFileName[0] != '\0') {
+    fprintf(out, "set output \"%s\"\n", plotFileName);
+  }
+  fprintf(out, "set xtics scale 2,1\n");
+  fprintf(out, "set mxtics 5\n");
+  fprintf(out, "set linetype 1 lw 1 lc rgb \"blue\" pointtype 0\n");
+  fprintf(out, "set xlabel '%s'\n", plotXLabel(plotType));
+  fprintf(out, "set ylabel '%s'\n", plotYLabel(plotType));
+}
+
+
+// The data source of a scan file in a plot command.
+static void writeScanSource(FILE *out, char *scanFileName) {
+  if (scanfile_is_binary(scanFileName)) {
+    // Frequency in Hz and VSWR x 1000, straight from the records
+    fprintf(out, "'%s' binary skip=%d format='%s' endian=little using ($1/1000000):($2/1000)",
+      scanFileName, ScanFileHeaderSize, ScanFileGnuplotFormat);
+  } else {
+    fprintf(out, "'%s'", scanFileName);
+  }
+}
+
+
+// The -k smoothed curve of a scan file is kept next to it.
+static void curveFileName(char *out, int outmax, char *scanFileName) {
+  snprintf(out, outmax, "%s.curve", scanFileName);
+}
+
+
+// Write the -k smoothed curve of a scan file, for the plot of plottedName
+// (the scan file, or what it's plotted from) to draw.
+static bool writeCurve(char *scanFileName, char *plottedName) {
+char curveName[fileNameMax * 2];
+double cx[SmoothCurvePoints], cy[SmoothCurvePoints];
+RenderData data;
+FILE *out;
+bool ok;
+int i;
+
+  if (!render_load(scanFileName, &data)) {
+    printf("Cannot read scan file '%s': %s\n", scanFileName, strerror(errno));
+    return FALSE;
+  }
+  if (data.Count == 0L) {
+    printf("There is nothing to plot in '%s'\n", scanFileName);
+    render_free(&data);
+    return FALSE;
+  }
+  ok = smooth_curve(smoothMethod, smoothWindow, data.X, data.Y, data.Count,
+    cx, cy, SmoothCurvePoints);
+  render_free(&data);
+  if (!ok) {
+    printf("Cannot allocate memory to smooth '%s'\n", scanFileName);
+    return FALSE;
+  }
+
+  curveFileName(curveName, sizeof(curveName), plottedName);
+  if ((out = fopen(curveName, "w")) == NULL) {
+    printf("Cannot open curve file '%s' for write: %s\n", curveName, strerror(errno));
+    return FALSE;
+  }
+  for (i = 0; i < SmoothCurvePoints; i++) {
+    fprintf(out, "%f %f\n", cx[i], cy[i]);
+  }
+  if (ferror(out) | (fclose(out) != 0)) {
+    printf("Cannot write curve file '%s': %s\n", curveName, strerror(errno));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+// A scan file's curve in a plot command: its -k smoothed curve, or gnuplot's
+// bezier smoothing of the scan.
+static void writeCurveSource(FILE *out, char *scanFileName) {
+char curveName[fileNameMax * 2];
+
+  if (smoothMethod != SMOOTH_NONE) {
+    curveFileName(curveName, sizeof(curveName), scanFileName);
+    fprintf(out, "'%s' with lines", curveName);
+  } else {
+    writeScanSource(out, scanFileName);
+    fprintf(out, " smooth bezier");
+  }
+}
+
+
+// The -R resonances of a scan file, to mark on its plot.
+static int scanResonances(char *scanFileName, Resonance *found) {
+RenderData data;
+int count;
+
+  if (!render_load(scanFileName, &data)) {
+    printf("Cannot read scan file '%s': %s\n", scanFileName, strerror(errno));
+    return 0;
+  }
+  count = resonance_find(data.X, data.Y, data.Count, found, ResonanceMax);
+  render_free(&data);
+  return count;
+}
+
+
+static void resonanceLabel(char *out, int outmax, Resonance *resonance) {
+  snprintf(out, outmax, "%.4f MHz %.2f:1", resonance->Freq, resonance->Vswr);
+}
+
+
+// Mark a scan file's resonances for its plot, if -R was given.
+static void writeResonanceLabels(FILE *out, char *scanFileName) {
+Resonance found[ResonanceMax];
+char label[RenderLabelMax];
+int count, i;
+
+  if (!findResonances) {
+    return;
+  }
+  count = scanResonances(scanFileName, found);
+  for (i = 0; i < count; i++) {
+    resonanceLabel(label, sizeof(label), &found[i]);
+    fprintf(out, "set label %d \"%s\" at %f,%f point pointtype 7 offset 1,1\n",
+      i + 1, label, found[i].Freq, found[i].Vswr);
+  }
+}
+
+
+static void writePlotCommand(FILE *out, char *title, char *scanFileName, int plotType) {
+  if (plotType == PLOT_TYPE_VSWR) {
+    writeResonanceLabels(out, scanFileName);
+    fprintf(out, "plot ");
+    writeCurveSource(out, scanFileName);
+    fprintf(out, " title '%s'\n", title);
+    if (findResonances) {
+      // Not on the next plot from the same gnuplot
+      fprintf(out, "unset label\n");
+    }
+  } else if (plotType == PLOT_TYPE_FWD || plotType == PLOT_TYPE_REV) {
+    fprintf(out, "plot ");
+    writeCurveSource(out, scanFileName);
+    fprintf(out, " title 'Approximate', '%s' with points title 'Measurements'\n", scanFileName);
+  }
+}
+
+
+// Load the curve writeCurveSource would plot, and how to draw it.
+static bool loadCurve(char *scanFileName, RenderData *data, int *style) {
+char curveName[fileNameMax * 2];
+
+  if (smoothMethod != SMOOTH_NONE) {
+    curveFileName(curveName, sizeof(curveName), scanFileName);
+    *style = RENDER_LINES;
+    if (!render_load(curveName, data)) {
+      printf("Cannot read curve file '%s': %s\n", curveName, strerror(errno));
+      return FALSE;
+    }
+    return TRUE;
+  }
+  *style = RENDER_BEZIER;
+  if (!render_load(scanFileName, data)) {
+    printf("Cannot read scan file '%s': %s\n", scanFileName, strerror(errno));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+// Draw the plot writePlotCommand would, without gnuplot. format is from
+// render_format.
+static bool nativePlot(char *title, int format, char *plotFileName, char *scanFileName,
+  int plotType) {
+RenderData curve, measurements;
+RenderSeries series[2];
+Resonance found[ResonanceMax];
+RenderLabel labels[ResonanceMax];
+int count = 1, labelCount = 0, i;
+bool ok;
+
+  if (!loadCurve(scanFileName, &curve, &series[0].Style)) {
+    return FALSE;
+  }
+  series[0].Data = &curve;
+  series[0].Title = title;
+  if (plotType == PLOT_TYPE_FWD || plotType == PLOT_TYPE_REV) {
+    // The raw data as well
+    if (smoothMethod == SMOOTH_NONE) {
+      measurements = curve;
+    } else if (!render_load(scanFileName, &measurements)) {
+      printf("Cannot read scan file '%s': %s\n", scanFileName, strerror(errno));
+      render_free(&curve);
+      return FALSE;
+    }
+    series[0].Title = "Approximate";
+    series[1].Data = &measurements;
+    series[1].Style = RENDER_POINTS;
+    series[1].Title = "Measurements";
+    count = 2;
+  }
+  if (plotType == PLOT_TYPE_VSWR && findResonances) {
+    labelCount = scanResonances(scanFileName, found);
+    for (i = 0; i < labelCount; i++) {
+      labels[i].X = found[i].Freq;
+      labels[i].Y = found[i].Vswr;
+      resonanceLabel(labels[i].Text, RenderLabelMax, &found[i]);
+    }
+  }
+  if (curve.Count == 0L) {
+    printf("There is nothing to plot in '%s'\n", scanFileName);
+    ok = FALSE;
+  } else if (!(ok = render_plot(plotFileName, format, "", plotXLabel(plotType),
+                                plotYLabel(plotType), series, count, labels, labelCount))) {
+    printf("Cannot write plot '%s': %s\n", plotFileName, strerror(errno));
+  }
+  if (count == 2 && smoothMethod != SMOOTH_NONE) {
+    render_free(&measurements);
+  }
+  render_free(&curve);
+  return ok;
+}
+
+
+// An oscilloscope capture with more samples than the plot is pixels wide is
+// plotted from a temporary file of each column's lowest and highest, which
+// is returned (free it); NULL if it's plotted as it is.
+static char *decimateCapture(char *scanFileName) {
+RenderData data;
+char *decimatedName;
+FILE *out;
+long count, i;
+
+  if (!render_load(scanFileName, &data)) {
+    return NULL;
+  }
+  count = smooth_decimate(data.X, data.Y, data.Count, RenderWidth);
+  if (count == data.Count) {
+    render_free(&data);
+    return NULL;
+  }
+  decimatedName = allocateTempFileName();
+  if ((out = fopen(decimatedName, "w")) == NULL) {
+    printf("Cannot open decimated capture '%s' for write: %s\n", decimatedName,
+      strerror(errno));
+    finish(-1);
+  }
+  for (i = 0L; i < count; i++) {
+    fprintf(out, "%.10g %.10g\n", data.X[i], data.Y[i]);
+  }
+  if (ferror(out) | (fclose(out) != 0)) {
+    printf("Cannot write decimated capture '%s': %s\n", decimatedName, strerror(errno));
+    finish(-1);
+  }
+  render_free(&data);
+  return decimatedName;
+}
+
+
+static void plotWithGnuplot(char *title, char *term, char *plotFileName,
+  char *scanFileName, int plotType);
+
+void plot(bool window, bool native, char *title, char *term, 
+  char *plotFileName, char *scanFileName, int plotType) {
+char curveName[fileNameMax * 2];
+char *decimatedName = NULL;
+bool ok;
+
+  if (plotType == PLOT_TYPE_FWD || plotType == PLOT_TYPE_REV) {
+    decimatedName = decimateCapture(scanFileName);
+  }
+  // Smoothed from every sample; only the measurements are decimated
+  if (smoothMethod != SMOOTH_NONE) {
+    if (!writeCurve(scanFileName, decimatedName != NULL ? decimatedName : scanFileName)) {
+      finish(1);
+    }
+  }
+  if (decimatedName != NULL) {
+    scanFileName = decimatedName;
+  }
+  if (native && !window && render_format(term) != -1) {
+    ok = nativePlot(title, render_format(term), plotFileName, scanFileName, plotType);
+  } else {
+    plotWithGnuplot(title, term, plotFileName, scanFileName, plotType);
+    ok = TRUE;
+  }
+  // A temporary scan's curve goes with it
+  if (smoothMethod != SMOOTH_NONE && (scanFileTemporary || decimatedName != NULL)) {
+    curveFileName(curveName, sizeof(curveName), scanFileName);
+    unlink(curveName);
+  }
+  if (decimatedName != NULL) {
+    unlink(decimatedName);
+    free(decimatedName);
+  }
+  if (!ok) {
+    finish(1);
+  }
+}
+
+
+static void plotWithGnuplot(char *title, char *term, char *plotFileName,
+  char *scanFileName, int plotType) {
+char gnuplotCommand[linemax];
+char *gnuplotCommandsFileName;
+
+  gnuplotCommandsFileName = allocateTempFileName();
+
+  // Generate the plot
+  gnuplotCommandsOutput = fopen(gnuplotCommandsFileName, "w+");
+  if (gnuplotCommandsOutput == NULL) {
+    printf("Cannot open gnuplot commands file '%s' for write: %s\n", gnuplotCommandsFileName, strerror(errno));
+    finish(-1);
+  }
+
+  writePlotSettings(gnuplotCommandsOutput, title, term, plotFileName, plotType);
+  writePlotCommand(gnuplotCommandsOutput, title, scanFileName, plotType);
+  fclose(gnuplotCommandsOutput);
+    
+  sprintf(gnuplotCommand, "gnuplot %s --persist", gnuplotCommandsFileName);
+  system(gnuplotCommand);
 
   unlink(gnuplotCommandsFileName);
   free(gnuplotCommandsFileName);
 }
 
 
+// The file name extension for images from a gnuplot terminal.
+static const char *termExtension(char *term) {
+static const char *extensions[][2] = {
+  { "pngcairo", "png" }, { "pdfcairo", "pdf" }, { "epscairo", "eps" },
+  { "jpeg", "jpg" }, { "postscript", "ps" }, { "canvas", "html" },
+  { NULL, NULL }
+};
+int i;
+
+  for (i = 0; extensions[i][0] != NULL; i++) {
+    if (strcmp(term, extensions[i][0]) == 0) {
+      return extensions[i][1];
+    }
+  }
+  return term;
+}
+
+
+// The name of a scan file without its directory or extension.
+static void baseName(char *out, int outmax, char *fileName) {
+char *slash = strrchr(fileName, '/');
+char *dot;
+
+  strncpy(out, slash != NULL ? slash + 1 : fileName, outmax - 1);
+  out[outmax - 1] = '\0';
+  if ((dot = strrchr(out, '.')) != NULL && dot != out) {
+    *dot = '\0';
+  }
+}
+
+
+// Draw the overlay of several scan files batchPlot would ask gnuplot for.
+static bool nativeOverlay(char *title, int format, char *plotFileName, glob_t *files,
+  int plotType) {
+RenderData *data = calloc(files->gl_pathc, sizeof(RenderData));
+RenderSeries *series = calloc(files->gl_pathc, sizeof(RenderSeries));
+char (*names)[fileNameMax] = calloc(files->gl_pathc, fileNameMax);
+size_t f, loaded = 0;
+bool ok = data != NULL && series != NULL && names != NULL;
+
+  for (f = 0; ok && f < files->gl_pathc; f++, loaded++) {
+    if (!(ok = loadCurve(files->gl_pathv[f], &data[f], &series[f].Style))) {
+      break;
+    }
+    baseName(names[f], fileNameMax, files->gl_pathv[f]);
+    series[f].Data = &data[f];
+    series[f].Title = names[f];
+  }
+  if (ok && !(ok = render_plot(plotFileName, format, title, plotXLabel(plotType),
+                               plotYLabel(plotType), series, files->gl_pathc, NULL, 0))) {
+    printf("Cannot write plot '%s': %s\n", plotFileName, strerror(errno));
+  }
+  for (f = 0; f < loaded; f++) {
+    render_free(&data[f]);
+  }
+  free(data);
+  free(series);
+  free(names);
+  return ok;
+}
+
+
+// Plot many scan files with a few long-lived gnuplots, rather than starting
+// one per plot: an image per file per terminal (terms is a comma separated
+// list, e.g. png,svg) in outputDir, and an overlay of them all if
+// overlayName is given. If native, png and svg images are drawn here
+// instead, and gnuplot is only started for any other terminals.
+void batchPlot(char **patterns, int patternCount, char *terms, char *outputDir,
+  char *overlayName, int workers, bool native, char *title, int plotType) {
+const int maxTerms = 8;
+char termList[linemax];
+char *termNames[maxTerms];
+int formats[maxTerms];      // render_format of each, or -1 for gnuplot
+int gnuplotTerms = 0;
+char imageName[fileNameMax * 2];
+char name[fileNameMax];
+char fileTitle[linemax];
+FILE *gnuplots[MaxPlotWorkers];
+ScanFile scan;
+glob_t files;
+struct timeval started, now;
+int termCount = 0, i, t, images = 0;
+size_t f;
+double seconds;
+FILE *g;
+char *p;
+
+  strncpy(termList, terms, linemax - 1);
+  termList[linemax - 1] = '\0';
+  for (p = strtok(termList, ","); p != NULL && termCount < maxTerms; p = strtok(NULL, ",")) {
+    formats[termCount] = native ? render_format(p) : -1;
+    if (formats[termCount] == -1) {
+      gnuplotTerms++;
+    }
+    termNames[termCount++] = p;
+  }
+
+  memset(&files, 0, sizeof(files));
+  for (i = 0; i < patternCount; i++) {
+    if (glob(patterns[i], i == 0 ? 0 : GLOB_APPEND, NULL, &files) == GLOB_NOMATCH) {
+      printf("No scan files match %s\n", patterns[i]);
+    }
+  }
+  if (files.gl_pathc == 0) {
+    finish(1);
+  }
+
+  if (workers < 1) {
+    workers = 1;
+  }
+  if (workers > MaxPlotWorkers) {
+    workers = MaxPlotWorkers;
+  }
+  if ((size_t) workers > files.gl_pathc) {
+    workers = files.gl_pathc;
+  }
+  if (gnuplotTerms == 0) {
+    workers = 0;
+  }
+  /* If gnuplot goes away, we want write errors, not death */
+  signal(SIGPIPE, SIG_IGN);
+  gettimeofday(&started, NULL);
+  for (i = 0; i < workers; i++) {
+    if ((gnuplots[i] = popen("gnuplot", "w")) == NULL) {
+      printf("Cannot start gnuplot: %s\n", strerror(errno));
+      finish(1);
+    }
+  }
+
+  for (f = 0; f < files.gl_pathc; f++) {
+    g = workers > 0 ? gnuplots[f % workers] : NULL;
+    baseName(name, sizeof(name), files.gl_pathv[f]);
+    // A binary scan file's own title, or its name
+    strcpy(fileTitle, name);
+    if (scanfile_map(files.gl_pathv[f], &scan)) {
+      if (scan.Header.Title[0] != '\0') {
+        strncpy(fileTitle, scan.Header.Title, linemax - 1);
+      }
+      scanfile_unmap(&scan);
+    }
+    if (smoothMethod != SMOOTH_NONE && !writeCurve(files.gl_pathv[f], files.gl_pathv[f])) {
+      continue;
+    }
+    for (t = 0; t < termCount; t++) {
+      snprintf(imageName, sizeof(imageName), "%s/%s.%s", outputDir, name, termExtension(termNames[t]));
+      if (formats[t] != -1) {
+        if (nativePlot(fileTitle, formats[t], imageName, files.gl_pathv[f], plotType)) {
+          images++;
+        }
+        continue;
+      }
+      writePlotSettings(g, fileTitle, termNames[t], imageName, plotType);
+      writePlotCommand(g, fileTitle, files.gl_pathv[f], plotType);
+      // Close the image now, rather than when gnuplot exits
+      fprintf(g, "unset output\n");
+      images++;
+    }
+  }
+
+  if (overlayName[0] != '\0') {
+    g = workers > 0 ? gnuplots[0] : NULL;
+    for (t = 0; t < termCount; t++) {
+      snprintf(imageName, sizeof(imageName), "%s/%s.%s", outputDir, overlayName, termExtension(termNames[t]));
+      if (formats[t] != -1) {
+        if (nativeOverlay(title, formats[t], imageName, &files, plotType)) {
+          images++;
+        }
+        continue;
+      }
+      writePlotSettings(g, title, termNames[t], imageName, plotType);
+      fprintf(g, "set title '%s'\n", title);
+      fprintf(g, "plot ");
+      for (f = 0; f < files.gl_pathc; f++) {
+        baseName(name, sizeof(name), files.gl_pathv[f]);
+        fprintf(g, f == 0 ? "" : ", ");
+        writeCurveSource(g, files.gl_pathv[f]);
+        fprintf(g, " title '%s'", name);
+      }
+      fprintf(g, "\nunset output\nunset title\n");
+      images++;
+    }
+  }
+
+  for (i = 0; i < workers; i++) {
+    if (pclose(gnuplots[i]) != 0) {
+      printf("gnuplot reported a problem; some plots may be missing\n");
+    }
+  }
+  gettimeofday(&now, NULL);
+  seconds = (now.tv_sec - started.tv_sec) + (now.tv_usec - started.tv_usec) / 1000000.0;
+  if (workers > 0) {
+    snprintf(name, sizeof(name), "with %d gnuplot%s", workers, workers == 1 ? "" : "s");
+  } else {
+    strcpy(name, "without gnuplot");
+  }
+  printf("Plotted %lu scan files, %d images, %s in %.3f s, %.1f plots/sec\n",
+    (unsigned long) files.gl_pathc, images, name, seconds,
+    seconds > 0.0 ? images / seconds : 0.0);
+  globfree(&files);
+}
+
+
+// Add the scan files matching patterns to the -H history store, timestamped
+// when they were scanned (binary) or last written (text), and titled title,
+// or if that's empty with their own title or name.
+void importScans(char **patterns, int patternCount, char *title) {
+char name[fileNameMax];
+RenderData data;
+ScanFile scan;
+glob_t files;
+struct stat st;
+long timestamp;
+int i, added = 0;
+size_t f;
+
+  memset(&files, 0, sizeof(files));
+  for (i = 0; i < patternCount; i++) {
+    if (glob(patterns[i], i == 0 ? 0 : GLOB_APPEND, NULL, &files) == GLOB_NOMATCH) {
+      printf("No scan files match %s\n", patterns[i]);
+    }
+  }
+  for (f = 0; f < files.gl_pathc; f++) {
+    if (!render_load(files.gl_pathv[f], &data)) {
+      printf("Cannot read scan file '%s': %s\n", files.gl_pathv[f], strerror(errno));
+      continue;
+    }
+    timestamp = stat(files.gl_pathv[f], &st) == 0 ? (long) st.st_mtime : (long) time(NULL);
+    if (scanfile_is_binary(files.gl_pathv[f]) && scanfile_map(files.gl_pathv[f], &scan)) {
+      timestamp = scan.Header.Timestamp;
+      scanfile_unmap(&scan);
+    }
+    if (title[0] != '\0') {
+      strncpy(name, title, fileNameMax - 1);
+      name[fileNameMax - 1] = '\0';
+    } else if (data.Title[0] != '\0') {
+      strncpy(name, data.Title, fileNameMax - 1);
+      name[fileNameMax - 1] = '\0';
+    } else {
+      baseName(name, fileNameMax, files.gl_pathv[f]);
+    }
+    if (appendSweep(&data, files.gl_pathv[f], name, timestamp)) {
+      added++;
+    }
+    render_free(&data);
+  }
+  printf("Added %d of %lu scan files to the history store '%s'\n", added,
+    (unsigned long) files.gl_pathc, historyFileName);
+  globfree(&files);
+}
+
+
+// Set query's time range from <from>[,<to>]; either may be left out.
+static bool parseTimeRange(char *range, HistoryQuery *query) {
+char *to = strchr(range, ',');
+
+  query->From = 0L;
+  query->To = LONG_MAX;
+  if (to != NULL) {
+    *to++ = '\0';
+    if (*to != '\0' && (query->To = history_parse_time(to, TRUE)) == -1L) {
+      return FALSE;
+    }
+  }
+  return *range == '\0' || (query->From = history_parse_time(range, FALSE)) != -1L;
+}
+
+
+// Write the sweeps of the -H history store that query asks for to
+// outputName, or to stdout if it's NULL.
+void queryHistory(HistoryQuery *query, char *outputName) {
+History history;
+struct timeval started, now;
+FILE *out = stdout;
+long found = 0L;
+
+  gettimeofday(&started, NULL);
+  if (!history_open(historyFileName, &history)) {
+    printf("Cannot open history store '%s': %s\n", historyFileName, strerror(errno));
+    finish(1);
+  }
+  if (outputName != NULL && (out = fopen(outputName, "w")) == NULL) {
+    printf("Cannot open '%s' for write: %s\n", outputName, strerror(errno));
+    finish(1);
+  }
+  if (query->Action == HISTORY_EXTRACT || history_grid(&history, query)) {
+    found = history_query(&history, query, out);
+  }
+  if (found == -1L) {
+    printf("Cannot read history store '%s'\n", historyFileName);
+    finish(1);
+  }
+  if (out != stdout && fclose(out) != 0) {
+    printf("Cannot write '%s': %s\n", outputName, strerror(errno));
+    finish(1);
+  }
+  gettimeofday(&now, NULL);
+  if (out != stdout) {
+    printf("Wrote %ld of %ld sweeps to '%s' in %.1f ms\n", found, history.Count, outputName,
+      (now.tv_sec - started.tv_sec) * 1000.0 + (now.tv_usec - started.tv_usec) / 1000.0);
+  }
+  history_close(&history);
+}
+
+
+// Start a gnuplot window that's fed points as scan() and oscilloscope()
+// receive them.
+void startLivePlot(char *title, int plotType, long startFreq, long stopFreq) {
+char plotCommand[LivePlotCommandMax];
+FILE *gnuplot;
+
+  if (plotType == PLOT_TYPE_VSWR) {
+    snprintf(plotCommand, sizeof(plotCommand), "plot '-' smooth bezier title '%s'", title);
+    // Frequencies are in hundredths of a Hz, plotted in MHz
+    gnuplot = liveplot_open(&livePlot, plotCommand, 8, 3);
+  } else {
+    snprintf(plotCommand, sizeof(plotCommand), "plot '-' with points title 'Measurements'");
+    gnuplot = liveplot_open(&livePlot, plotCommand, 0, 0);
+  }
+  if (gnuplot == NULL) {
+    printf("Cannot start gnuplot for live plotting: %s\n", strerror(errno));
+    return;
+  }
+
+  writePlotSettings(gnuplot, title, windowTerm(), "", plotType);
+  if (plotType == PLOT_TYPE_VSWR && stopFreq > startFreq) {
+    // Fix the axis so it doesn't jump about as points arrive
+    fprintf(gnuplot, "set xrange [%f:%f]\n", startFreq / 1000000.0, stopFreq / 1000000.0);
+  }
+  livePlotting = TRUE;
+}
+
+
+static void stopLivePlot() {
+  if (livePlotting) {
+    liveplot_close(&livePlot);
+    livePlotting = FALSE;
+  }
+}
+
+
 int main(int argc, char *argv[])
 {
 int i;
-char *p;
+char *p, *q, *end;
 const int portmax = 64;
 char port[portmax];
 long startFreq = 0L;
@@ -507,6 +2463,44 @@ bool oscMode = FALSE;
 int plotType = PLOT_TYPE_VSWR;
 bool verbose = FALSE;
 bool hardwareFlowControl = FALSE;
+int scanFormat = SCAN_FORMAT_TEXT;
+bool live = FALSE;
+bool livePlotted = FALSE;
+bool split = FALSE;
+bool settleGiven = FALSE;
+bool calibrating = FALSE;
+bool resuming = FALSE;
+Checkpoint checkpoint;
+int standard = -1;
+double loadOhms = OslLoadOhms;
+bool correct = TRUE;
+HistoryQuery historyQuery;
+bool historyQuerying = FALSE;
+double tolerance = CalibrateTolerance;
+long resolution = 0L;
+char serveSocket[fileNameMax] = "";
+int history = 0;
+bool statistics = FALSE;
+bool rotating = FALSE;
+double tuneRate = 0.0;
+long tuneSpan = 0L;
+long rotateBytes = 0L, rotateSeconds = 0L;
+char statisticsFileName[fileNameMax] = "";
+char failedName[OscStatsNameMax];
+OscStats stats;
+char *batchFiles[argc];
+int batchCount = 0;
+int workers = 1;
+bool termGiven = FALSE;
+bool native = defnative;
+char overlayName[fileNameMax] = "";
+char traceFileName[fileNameMax] = "";
+char smoothName[fileNameMax] = "";
+long driftFreq = 0L;
+double driftSwr = 0.0;
+Device devices[MaxDevices];
+int deviceCount = 0;
+Device *device = NULL; // the most recent -p, which -a/-b/-f/-n/-s apply to
 
   /* Initialise sensible defaults, etc. */
   progname = argv[0];
@@ -526,10 +2520,39 @@ bool hardwareFlowControl = FALSE;
       p=&argv[i][2]; // could be a buffer overflow ... if argv[i] is '-'
       switch (argv[i][1]) {
         case 'a':
-          sscanf(p, "%ld", &startFreq);
+          sscanf(p, "%ld", device != NULL ? &device->StartFreq : &startFreq);
           break;
         case 'b':
-          sscanf(p, "%ld", &stopFreq);
+          sscanf(p, "%ld", device != NULL ? &device->StopFreq : &stopFreq);
+          break;
+        case 'e':
+          strncpy(scanFileName, p, fileNameMax - 1);
+          scanFileTemporary = FALSE;
+          resuming = TRUE;
+          break;
+        case 'C':
+          calibrating = TRUE;
+          if (*p != '\0') {
+            sscanf(p, "%lf", &tolerance);
+          }
+          break;
+        case 'K':
+          rotateBytes = strtol(p, &end, 10);
+          if (*end == 'k') {
+            rotateBytes *= 1024L;
+            end++;
+          } else if (*end == 'M') {
+            rotateBytes *= 1024L * 1024L;
+            end++;
+          }
+          if (*end == ',') {
+            rotateSeconds = strtol(end + 1, &end, 10);
+          }
+          if (*end != '\0' || rotateBytes < 0L || rotateSeconds < 0L ||
+              (rotateBytes == 0L && rotateSeconds == 0L)) {
+            usage(term);
+          }
+          rotating = TRUE;
           break;
         case 'c':
           oscMode = TRUE;
@@ -553,82 +2576,422 @@ bool hardwareFlowControl = FALSE;
           }
           break;
         case 'f':
-          strncpy(scanFileName, p, fileNameMax);
-          scanFileTemporary = FALSE;
+          if (device != NULL) {
+            strncpy(device->ScanFileName, p, DeviceFileNameMax - 1);
+          } else {
+            strncpy(scanFileName, p, fileNameMax);
+            scanFileTemporary = FALSE;
+          }
+          break;
+        case 'A':
+          sscanf(p, "%ld", &driftFreq);
+          break;
+        case 'D':
+          strncpy(serveSocket, p, fileNameMax - 1);
+          break;
+        case 'F':
+          if (strcmp(p, "text") == 0) {
+            scanFormat = SCAN_FORMAT_TEXT;
+          } else if (strcmp(p, "bin") == 0) {
+            scanFormat = SCAN_FORMAT_BIN;
+          } else {
+            usage(term);
+          }
+          break;
+        case 'G':
+          native = FALSE;
+          break;
+        case 'B':
+          asciiOnly = TRUE;
           break;
         case 'h':
           hardwareFlowControl = TRUE;
           break;
+        case 'H':
+          strncpy(historyFileName, p, fileNameMax - 1);
+          break;
+        case 'E':
+        case 'Z':
+          // [<from>][,<to>]
+          if (!parseTimeRange(p, &historyQuery)) {
+            usage(term);
+          }
+          historyQuery.Action = argv[i][1] == 'E' ? HISTORY_EXTRACT : HISTORY_RESAMPLE;
+          historyQuerying = TRUE;
+          break;
+        case 'i':
+          statistics = TRUE;
+          break;
+        case 'I':
+          strncpy(statisticsFileName, p, fileNameMax - 1);
+          break;
+        case 'k':
+          // <method>[,<window>]
+          strncpy(smoothName, p, sizeof(smoothName) - 1);
+          if ((q = strchr(smoothName, ',')) != NULL) {
+            *q++ = '\0';
+            sscanf(q, "%d", &smoothWindow);
+          }
+          if ((smoothMethod = smooth_method(smoothName)) == -1) {
+            usage(term);
+          }
+          break;
+        case 'l':
+          live = TRUE;
+          break;
+        case 'L':
+          // open, short, load[,<ohms>] or off
+          if (strcmp(p, "off") == 0) {
+            correct = FALSE;
+            break;
+          }
+          if ((q = strchr(p, ',')) != NULL) {
+            *q++ = '\0';
+            sscanf(q, "%lf", &loadOhms);
+          }
+          if ((standard = osl_standard(p)) == -1) {
+            usage(term);
+          }
+          break;
+        case 'j':
+          sscanf(p, "%d", &workers);
+          break;
         case 'm':
           strncpy(term, p, linemax);
+          termGiven = TRUE;
+          break;
+        case 'M':
+          sscanf(p, "%d", &history);
+          break;
+        case 'u':
+          if (sscanf(p, "%lf,%ld", &tuneRate, &tuneSpan) < 1 || tuneRate <= 0.0) {
+            usage(term);
+          }
+          tuneSpan *= 1000L;
+          break;
+        case 'N':
+          native = TRUE;
           break;
         case 'n':
-          sscanf(p, "%d", &numSteps);
+          sscanf(p, "%d", device != NULL ? &device->NumSteps : &numSteps);
           break;
         case 'o':
           strncpy(plotFileName, p, fileNameMax);
           break;
+        case 'O':
+          strncpy(overlayName, p, fileNameMax - 1);
+          break;
         case 'p':
-          strncpy(port, p, portmax);
+          if (deviceCount == MaxDevices) {
+            printf("At most %d ports may be given\n", MaxDevices);
+            exit(1);
+          }
           /* XXX: check existence, deviceness? */
+          device = &devices[deviceCount++];
+          memset(device, 0, sizeof(Device));
+          strncpy(device->Port, p, DevicePortMax - 1);
+          device->StartFreq = device->StopFreq = -1L;
+          device->NumSteps = device->SettleDelay = -1;
           break;
         case 'q':
           queryMode = TRUE;
           break;
+        case 'r':
+          sscanf(p, "%ld", &resolution);
+          break;
+        case 'R':
+          findResonances = TRUE;
+          break;
         case 's':
-          sscanf(p, "%d", &settleDelay);
+          sscanf(p, "%d", device != NULL ? &device->SettleDelay : &settleDelay);
+          settleGiven = settleGiven || device == NULL;
+          break;
+        case 'S':
+          split = TRUE;
           break;
         case 't':
           strncpy(title, p, linemax);
           break;
+        case 'T':
+          strncpy(traceFileName, p, fileNameMax - 1);
+          break;
+        case 'U':
+          strncpy(serverSocket, p, fileNameMax - 1);
+          break;
         case 'v':
           verbose = TRUE;
           break;
+        case 'W':
+          sscanf(p, "%lf", &driftSwr);
+          break;
+        case 'x':
+          strncpy(metricsFileName, p, fileNameMax - 1);
+          break;
         case 'w':
           window = TRUE;
           plotFileName[0] = '\0';
-#if defined(MACOSX)
-          strcpy(term, "aqua");
-#endif
-#if defined(REDHAT) || defined(DEBIAN) || defined(RASPBIAN)
-          strcpy(term, "x11");
-#endif
+          strcpy(term, windowTerm());
           break;
         default:
           usage(term);
       }
     }
     else
-      usage(term);
+      batchFiles[batchCount++] = argv[i];
+  }
+
+  // An odd number of points to smooth over, so they centre on each point
+  if (smoothWindow <= 0) {
+    smoothWindow = smooth_default_window(smoothMethod);
+  }
+  smoothWindow |= 1;
+  if (smoothWindow > SmoothWindowMax) {
+    smoothWindow = SmoothWindowMax;
+  }
+
+  // Adding scan files to the history store?
+  if (batchCount > 0 && historyFileName[0] != '\0') {
+    importScans(batchFiles, batchCount, title);
+    finish(0);
+  }
+
+  // Querying the history store?
+  if (historyQuerying) {
+    if (historyFileName[0] == '\0') {
+      printf("Give the history store to query with -H\n");
+      finish(1);
+    }
+    historyQuery.Title = title[0] != '\0' ? title : NULL;
+    historyQuery.StartFreq = startFreq;
+    historyQuery.StopFreq = stopFreq;
+    historyQuery.NumSteps = numSteps;
+    queryHistory(&historyQuery, scanFileTemporary ? NULL : scanFileName);
+    finish(0);
+  }
+
+  // Plotting a batch of scan files?
+  if (batchCount > 0) {
+    batchPlot(batchFiles, batchCount, termGiven ? term : "png",
+      plotFileName[0] != '\0' ? plotFileName : ".", overlayName, workers, native,
+      title[0] != '\0' ? title : "Comparison", plotType);
+    finish(0);
   }
 
   if (title[0] == '\0') {
     strcpy(title, "Unknown Antenna");
   }
 
+  // Options given before any -p are the defaults for every port
+  for (i = 0; i < deviceCount; i++) {
+    if (devices[i].StartFreq == -1L) {
+      devices[i].StartFreq = startFreq;
+    }
+    if (devices[i].StopFreq == -1L) {
+      devices[i].StopFreq = stopFreq;
+    }
+    if (devices[i].NumSteps == -1) {
+      devices[i].NumSteps = numSteps;
+    }
+    if (devices[i].SettleDelay == -1) {
+      devices[i].SettleDelay = settleGiven || oscMode ? settleDelay :
+        portSettle(devices[i].Port, settleDelay);
+    }
+  }
+  if (deviceCount == 1) {
+    strncpy(port, devices[0].Port, portmax);
+    startFreq = devices[0].StartFreq;
+    stopFreq = devices[0].StopFreq;
+    numSteps = devices[0].NumSteps;
+    settleDelay = devices[0].SettleDelay;
+    if (devices[0].ScanFileName[0] != '\0') {
+      strncpy(scanFileName, devices[0].ScanFileName, fileNameMax);
+      scanFileTemporary = FALSE;
+    }
+  }
+  // Scans use the settle delay calibrated for their port, unless given one
+  if (deviceCount == 0 && !settleGiven && !oscMode) {
+    settleDelay = portSettle(port, settleDelay);
+  }
+
+  // Analysing a previous capture?
+  if (statisticsFileName[0] != '\0') {
+    oscstats_init(&stats);
+    q = strrchr(statisticsFileName, '.');
+    if (q != NULL && strcmp(q, ".manifest") == 0) {
+      if (!oscstats_manifest(&stats, statisticsFileName, failedName)) {
+        printf("Cannot read capture file '%s': %s\n", failedName, strerror(errno));
+        finish(1);
+      }
+    } else if (!oscstats_file(&stats, statisticsFileName)) {
+      printf("Cannot read capture file '%s': %s\n", statisticsFileName, strerror(errno));
+      finish(1);
+    }
+    oscstats_report(&stats, stdout, verbose);
+    finish(0);
+  }
+
+  // Sharing the analyser?
+  if (serveSocket[0] != '\0') {
+    /* Trap CTRL-C */
+    signal(SIGINT, &sighandler);
+    signal(SIGTERM, &sighandler);
+    finish(server_run(port, serveSocket, hardwareFlowControl, verbose, &quit) ? 0 : 1);
+  }
+
+  if (traceFileName[0] != '\0') {
+    if (!trace_open(&trace, traceFileName)) {
+      printf("Cannot open trace file '%s' for write: %s\n", traceFileName, strerror(errno));
+      finish(1);
+    }
+    tracing = TRUE;
+  }
+
   // Just querying?
   if (queryMode) {
-    openSerialAndScanOutput(TRUE, port, NULL, hardwareFlowControl);
-    closeSerialAndScanOutput();
+    if (deviceCount == 0) {
+      openSerialAndScanOutput(TRUE, port, NULL, hardwareFlowControl);
+      closeSerialAndScanOutput();
+    }
+    for (i = 0; i < deviceCount; i++) {
+      openSerialAndScanOutput(TRUE, devices[i].Port, NULL, hardwareFlowControl);
+      closeSerialAndScanOutput();
+    }
+  }
+
+  // Calibrating the settle delay?
+  else if (calibrating) {
+    if (deviceCount > 1) {
+      printf("Only one port may be given with -C\n");
+      finish(1);
+    }
+    if (startFreq == 0L || stopFreq == 0L) {
+      printf("Give -a/-b for the frequencies to calibrate between\n");
+      finish(1);
+    }
+    calibrate(verbose, port, hardwareFlowControl, startFreq, stopFreq, tolerance,
+      settleDelay, numSteps);
+  }
+
+  // Measuring an open/short/load calibration standard?
+  else if (standard != -1) {
+    if (deviceCount > 1) {
+      printf("Only one port may be given with -L\n");
+      finish(1);
+    }
+    if (startFreq == 0L || stopFreq == 0L) {
+      printf("You must give -a/-b to measure a standard\n");
+      finish(1);
+    }
+    measureStandard(verbose, port, startFreq, stopFreq, numSteps, settleDelay, scanFileName,
+      hardwareFlowControl, title, standard, loadOhms);
+  }
+
+  // Splitting one scan between several analysers?
+  else if (deviceCount > 1 && split) {
+    if (oscMode) {
+      printf("Only one port may be given with -c\n");
+      finish(1);
+    }
+    if (!splitScan(devices, deviceCount, verbose, hardwareFlowControl, scanFormat, title,
+                   startFreq, stopFreq, numSteps, settleDelay)) {
+      finish(1);
+    }
+  }
+
+  // Scanning with several analysers at once?
+  else if (deviceCount > 1) {
+    if (oscMode) {
+      printf("Only one port may be given with -c\n");
+      finish(1);
+    }
+    if (!scanDevices(devices, deviceCount, verbose, hardwareFlowControl, scanFormat, title)) {
+      finish(1);
+    }
+    if (plotFileName[0] != '\0' || window) {
+      printf("Plotting is only available when scanning with one analyser\n");
+    }
+    finish(0);
+  }
+
+  // Resuming an interrupted scan?
+  else if (resuming) {
+    if (!checkpoint_load(scanFileName, &checkpoint)) {
+      printf("There is no interrupted scan to resume in '%s'\n", scanFileName);
+      finish(1);
+    }
+    if (correct) {
+      prepareCorrection(checkpoint.StartFreq, checkpoint.StopFreq, checkpoint.NumSteps);
+    }
+    scan(verbose, port, checkpoint.StartFreq, checkpoint.StopFreq, checkpoint.NumSteps,
+      checkpoint.SettleDelay, scanFileName, hardwareFlowControl, checkpoint.Format,
+      checkpoint.Title, &checkpoint);
+  }
+
+  // Tuning?
+  else if (plotType == PLOT_TYPE_VSWR && tuneRate > 0.0) {
+    if (startFreq == 0L || stopFreq <= startFreq) {
+      printf("You must give -a/-b to tune\n");
+      finish(1);
+    }
+    tuneScan(verbose, port, startFreq, stopFreq, numSteps, settleDelay, hardwareFlowControl,
+      tuneRate, tuneSpan > 0L ? tuneSpan : (stopFreq - startFreq) / 5L);
   }
 
   // Are we plotting VSWR?
+  else if (plotType == PLOT_TYPE_VSWR && startFreq != 0L && stopFreq != 0L && history > 0) {
+    if (correct) {
+      prepareCorrection(startFreq, stopFreq, numSteps);
+    }
+    monitorScan(verbose, port, startFreq, stopFreq, numSteps, settleDelay, scanFileName,
+      hardwareFlowControl, title, history, driftFreq, (long) (driftSwr * 1000.0 + 0.5));
+  }
+  else if (plotType == PLOT_TYPE_VSWR && startFreq != 0L && stopFreq != 0L && resolution > 0L) {
+    if (live) {
+      printf("Live plotting isn't available when scanning adaptively\n");
+    }
+    refineScan(verbose, port, startFreq, stopFreq, numSteps, settleDelay, scanFileName,
+      hardwareFlowControl, scanFormat, title, resolution);
+  }
   else if (plotType == PLOT_TYPE_VSWR && startFreq != 0L && stopFreq != 0L) {
-    scan(verbose, port, startFreq, stopFreq, numSteps, settleDelay, scanFileName, hardwareFlowControl);
+    if (correct) {
+      prepareCorrection(startFreq, stopFreq, numSteps);
+    }
+    if (live) {
+      startLivePlot(title, plotType, startFreq, stopFreq);
+    }
+    scan(verbose, port, startFreq, stopFreq, numSteps, settleDelay, scanFileName, hardwareFlowControl,
+      scanFormat, title, NULL);
+    livePlotted = livePlotting;
+    stopLivePlot();
 
   // Are we measuring detector voltages?
   } else if (oscMode && (plotType == PLOT_TYPE_FWD || plotType == PLOT_TYPE_REV)) {
-    oscilloscope(verbose, port, startFreq, settleDelay, scanFileName, plotType, hardwareFlowControl);
+    if (rotating && (live || plotFileName[0] != '\0' || window)) {
+      printf("Plotting isn't available when capturing continuously\n");
+      live = window = FALSE;
+      plotFileName[0] = '\0';
+    }
+    if (rotating && scanFileTemporary) {
+      printf("Give the base name of the capture segments with -f<file>\n");
+      finish(1);
+    }
+    if (live) {
+      startLivePlot(title, plotType, 0L, 0L);
+    }
+    oscilloscope(verbose, port, startFreq, settleDelay, scanFileName, plotType, hardwareFlowControl,
+      statistics, rotateBytes, rotateSeconds);
+    livePlotted = livePlotting;
+    stopLivePlot();
 
   }
 
   // Are we plotting?
   // TODO Should allow interactive mode if term is qt, without having to specify a
   // plot file name.
-  if ( plotFileName[0] != '\0' || // to a file
-       window                     // to a window
+  if ( plotFileName[0] != '\0' ||   // to a file
+       (window && !livePlotted)     // to a window, unless it's already up
      ) {
-    plot(window, title, term, plotFileName, scanFileName, plotType);
+    plot(window, native, title, term, plotFileName, scanFileName, plotType);
   }
 
   if (verbose) {
@@ -0,0 +1,138 @@
+/*******************************************************************************
+***
+*** Filename         : anasim.c
+*** Purpose          : Run a simulated antenna analyser on a pseudo-terminal.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "global.h"
+#include "sim.h"
+
+static char *progname;
+
+static void usage(SimParams *params)
+{
+  printf("anasim v%s - simulated K6BEZ antenna analyser\n\n", VERSION);
+  printf("Syntax:\n");
+  printf("  %s [options]\n", progname);
+  printf("Options:\n");
+  printf("  -d<hz>    Move the resonant frequency by this much after each scan,\n");
+  printf("            e.g. to simulate icing. Default 0.\n");
+  printf("  -l<us>    Set DDS programming latency per step in microseconds. Default %ld.\n", params->StepLatency);
+  printf("  -o<num>   Set number of samples per oscilloscope capture. Default %ld.\n", params->Samples);
+  printf("  -q<q>     Set the antenna's Q. Default %.1f.\n", params->Q);
+  printf("  -r<bps>   Set simulated line rate in bits/sec, 0 for unlimited. Default %ld.\n", params->LineRate);
+  printf("  -f<hz>    Set the antenna's resonant frequency in Hertz. Default %.0f.\n", params->Resonance);
+  printf("  -w<swr>   Set the antenna's SWR at resonance. Default %.2f.\n", params->MinSwr);
+  printf("  -t<us>    Set the detectors' settling time constant after a frequency\n");
+  printf("            change in microseconds, 0 for instant. Default %ld.\n", params->DetectorTau);
+  printf("  -x<num>   Stop replying <num> points into each scan, as if the USB\n");
+  printf("            link dropped out. Default 0, never.\n");
+  printf("  -c<load>  Connect a calibration standard in place of the antenna:\n");
+  printf("            open, short, or a resistor of <load> ohms.\n");
+  printf("  -e<gamma> Set the bridge's directivity error, as the reflection\n");
+  printf("            coefficient read with a matched load. Default %.2f.\n", params->Leakage);
+  printf("  -a        Only speak ASCII: don't offer the binary protocol (P),\n");
+  printf("            as the firmware before it.\n");
+  printf("  -k<num>   Lose a byte of every <num> binary protocol frames.\n");
+  printf("  -v        Log commands and replies to stderr.\n");
+  printf("The pseudo-terminal's name is printed on startup; give it to the\n");
+  printf("analyser with -p<port>.\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+int i;
+char *p;
+char slave[128];
+int master;
+SimParams params;
+
+  progname = argv[0];
+  sim_defaults(&params);
+
+  for (i=1; i<argc; i++) {
+    if (argv[i][0]=='-') {
+      p=&argv[i][2];
+      switch (argv[i][1]) {
+        case 'a':
+          params.AsciiOnly = TRUE;
+          break;
+        case 'c':
+          if (strcmp(p, "open") == 0) {
+            params.Load = SimOpen;
+          } else if (strcmp(p, "short") == 0) {
+            params.Load = 0.0;
+          } else if (sscanf(p, "%lf", &params.Load) != 1 || params.Load < 0.0) {
+            usage(&params);
+          }
+          break;
+        case 'd':
+          sscanf(p, "%lf", &params.Drift);
+          break;
+        case 'e':
+          sscanf(p, "%lf", &params.Leakage);
+          break;
+        case 'f':
+          sscanf(p, "%lf", &params.Resonance);
+          break;
+        case 'k':
+          sscanf(p, "%ld", &params.LoseEvery);
+          break;
+        case 'l':
+          sscanf(p, "%ld", &params.StepLatency);
+          break;
+        case 'o':
+          sscanf(p, "%ld", &params.Samples);
+          break;
+        case 'q':
+          sscanf(p, "%lf", &params.Q);
+          break;
+        case 'r':
+          sscanf(p, "%ld", &params.LineRate);
+          break;
+        case 't':
+          sscanf(p, "%ld", &params.DetectorTau);
+          break;
+        case 'v':
+          params.Verbose = TRUE;
+          break;
+        case 'w':
+          sscanf(p, "%lf", &params.MinSwr);
+          break;
+        case 'x':
+          sscanf(p, "%ld", &params.DropAfter);
+          break;
+        default:
+          usage(&params);
+      }
+    }
+    else
+      usage(&params);
+  }
+
+  if ((master = sim_open(slave, sizeof(slave))) == -1) {
+    printf("Cannot open a pseudo-terminal\n");
+    exit(-1);
+  }
+  printf("pty: %s\n", slave);
+  fflush(stdout);
+
+  sim_serve(master, &params);
+  return 0;
+}
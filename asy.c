@@ -4,36 +4,160 @@
 *** Purpose          : Linux implementation of NCP ASY routines
 *** Author           : Matt J. Gumbley
 *** Created          : 16/01/97
-*** Last updated     : 20/01/97
+*** Last updated     : 16/10/26
 ***
 *** Notes            : The following preprocessor symbols are used:
 ***                    DEBUG - to include dump code.
+***                    Input is drained from the tty in chunks into a
+***                    per-port ring buffer; asy_getc, asy_readline and
+***                    asy_test are all served from it. Several ports may be
+***                    open at once; asy_receive and asy_nextline let them
+***                    be driven from a poll() loop.
 ***
 ********************************************************************************
 ***
 *** Modification Record
+*** 16/10/26 agent Input read in chunks through a per-port ring buffer, with
+***                several ports open at once, driven from a poll() loop.
 ***
 *******************************************************************************/
 
 #define DataTimeout 20
+#define MaxPorts 8
+#define RingSize 4096
 
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/times.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
 #include <termios.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #include "global.h"
 #include "asy.h"
 #include "util.h"
 
-static byte PendingDataBuffer;
-static int PendingData = FALSE;
-static struct termios OriginalSerialParameters;
+typedef struct {
+  int Fd;                       /* -1 if this slot is free */
+  bool Tty;                     /* FALSE for a socket from asy_connect */
+  struct termios OriginalSerialParameters;
+  byte Ring[RingSize];
+  int Head;                     /* Index of the next byte to return */
+  int Count;                    /* Number of bytes buffered */
+} AsyPort;
+
+static AsyPort Ports[MaxPorts];
+static bool PortsInitialised = FALSE;
+
+
+static AsyPort *asy_port(int fd)
+{
+  int i;
+  for (i = 0; i < MaxPorts; i++) {
+    if (PortsInitialised && Ports[i].Fd == fd) {
+      return &Ports[i];
+    }
+  }
+  return NULL;
+}
+
+
+static AsyPort *asy_allocate_port(int fd)
+{
+  int i;
+  if (!PortsInitialised) {
+    for (i = 0; i < MaxPorts; i++) {
+      Ports[i].Fd = -1;
+    }
+    PortsInitialised = TRUE;
+  }
+  for (i = 0; i < MaxPorts; i++) {
+    if (Ports[i].Fd == -1) {
+      Ports[i].Fd = fd;
+      Ports[i].Tty = TRUE;
+      Ports[i].Head = 0;
+      Ports[i].Count = 0;
+      return &Ports[i];
+    }
+  }
+  return NULL;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : asy_fill
+*** Preconditions    : Port is open, and its ring is not full.
+*** Postconditions   : asy_fill is positive, the number of bytes read from the
+***                    tty into the ring with a single read.
+***                    asy_fill is 0, and nothing arrived within the timeout
+***                    (or immediately, if NoDelay is TRUE).
+***                    asy_fill is -1 on error.
+***
+*******************************************************************************/
+
+static int asy_fill(AsyPort *Port, bool NoDelay)
+{
+  int Tail, Space, Status;
+#ifdef DEBUG
+  struct tms Timest;
+  clock_t Interval;
+#endif
+
+  Tail = (Port->Head + Port->Count) % RingSize;
+  /* Only read into the contiguous free space; we'll wrap on the next fill */
+  Space = (Tail >= Port->Head) ? RingSize - Tail : Port->Head - Tail;
+  if (Port->Count == RingSize) {
+    return 0;
+  }
+
+  if (NoDelay) {
+    /* Switch to nodelay mode for a sec */
+    (void) fcntl (Port->Fd, F_SETFL, fcntl (Port->Fd, F_GETFL) | O_NDELAY);
+  }
+  /* Re-read until we are not affected by a signal. */
+  do {
+#ifdef DEBUG
+    Interval = times (&Timest);
+#endif
+    Status = read (Port->Fd, &Port->Ring[Tail], Space);
+#ifdef DEBUG
+    Interval = times (&Timest) - Interval;
+#endif
+  }
+  while (Status == -1 && errno == EINTR);
+  if (NoDelay) {
+    /* Now switch back to delayed action */
+    (void) fcntl (Port->Fd, F_SETFL, fcntl (Port->Fd, F_GETFL) & (~O_NDELAY));
+  }
+  if (Status == 0 && !Port->Tty) {
+    /* On a socket, that's the other end closing, not a timeout */
+    Status = -1;
+  } else if (Status == -1 && errno == EAGAIN) {
+    /* Nothing there in nodelay mode, or a socket's receive timeout */
+    Status = 0;
+  }
+
+  if (Status <= 0) {
+#ifdef DEBUG
+    fprintf (stderr, "asy_fill: Read returned %d. Errno=%d Interval=%ld\n",
+             Status, errno, (long) Interval);
+#endif
+    return Status;
+  }
+#ifdef DEBUG
+  fprintf (stderr, "asy_fill: Read %d bytes\n", Status);
+#endif
+  Port->Count += Status;
+  return Status;
+}
 
 
 /*******************************************************************************
@@ -53,6 +177,7 @@ static struct termios OriginalSerialParameters;
 int asy_open(char *Port, int Baud, bool Hardware)
 {
   struct termios SerialParameters;
+  AsyPort *Slot;
   int i, fd;
 
   /* We want to open the port in nodelay mode, so we are informed if the
@@ -80,7 +205,14 @@ int asy_open(char *Port, int Baud, bool Hardware)
     return -1;
   }
 
-  (void) tcgetattr (fd, &OriginalSerialParameters);
+  if ((Slot = asy_allocate_port(fd)) == NULL) {
+#ifdef DEBUG
+    fprintf (stderr, "asy_open: Too many ports open, cannot open %s\n", Port);
+#endif
+    close(fd);
+    return -1;
+  }
+  Slot->OriginalSerialParameters = SerialParameters;
 
   SerialParameters.c_cflag = Baud | CS8 | CLOCAL | CREAD | (Hardware ? CRTSCTS : 0);
   SerialParameters.c_lflag = 0;
@@ -96,10 +228,62 @@ int asy_open(char *Port, int Baud, bool Hardware)
 #ifdef DEBUG
     fprintf (stderr, "asy_open: Cannot tcsetattr on port %s. Errno = %d\n", Port, errno);
 #endif
+    Slot->Fd = -1;
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : asy_connect connects to a Unix domain socket that
+***                    speaks the same line protocol as the serial port.
+*** Preconditions    : Path names a listening Unix domain socket.
+*** Postconditions   : asy_connect is positive, the file descriptor for
+***                    access with the other asy routines. Reads time out as
+***                    they do on a tty.
+***                    asy_connect is -1, and the connect failed.
+***
+*******************************************************************************/
+
+int asy_connect(char *Path)
+{
+  struct sockaddr_un Address;
+  struct timeval Timeout;
+  AsyPort *Slot;
+  int fd;
+
+  if (strlen(Path) >= sizeof(Address.sun_path)) {
+    return -1;
+  }
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  strcpy(Address.sun_path, Path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *) &Address, sizeof(Address)) == -1) {
+#ifdef DEBUG
+    fprintf (stderr, "asy_connect: Cannot connect to %s. Errno = %d\n", Path, errno);
+#endif
+    close(fd);
     return -1;
   }
 
-  PendingData = FALSE;
+  /* The equivalent of VTIME */
+  Timeout.tv_sec = DataTimeout / 10;
+  Timeout.tv_usec = (DataTimeout % 10) * 100000L;
+  (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+  if ((Slot = asy_allocate_port(fd)) == NULL) {
+    close(fd);
+    return -1;
+  }
+  Slot->Tty = FALSE;
   return fd;
 }
 
@@ -115,7 +299,20 @@ int asy_open(char *Port, int Baud, bool Hardware)
 
 void asy_close(int fd)
 {
-  if (tcsetattr (fd, TCSANOW, &OriginalSerialParameters) == -1) {
+  AsyPort *Port = asy_port(fd);
+  if (Port == NULL) {
+#ifdef DEBUG
+    fprintf (stderr, "asy_close: Port not open\n");
+#endif
+    close(fd);
+    return;
+  }
+  Port->Fd = -1;
+  if (!Port->Tty) {
+    close(fd);
+    return;
+  }
+  if (tcsetattr (fd, TCSANOW, &Port->OriginalSerialParameters) == -1) {
 #ifdef DEBUG
     fprintf (stderr, "asy_close: Cannot reset with tcsetattr. Errno = %d\n", errno);
 #endif
@@ -210,7 +407,8 @@ int asy_write(int fd, byte *Data, int len)
 void asy_flush(int fd)
 {
   char Trashcan;
-  if (fd == 0) {
+  AsyPort *Port = asy_port(fd);
+  if (fd == 0 || Port == NULL) {
 #ifdef DEBUG
     fprintf(stderr, "asy_flush: Port not open\n");
 #endif
@@ -226,7 +424,8 @@ void asy_flush(int fd)
   }
   /* Now switch back to delayed action */
   (void) fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & (~O_NDELAY));
-  PendingData = FALSE;
+  Port->Head = 0;
+  Port->Count = 0;
 }
 
 
@@ -242,42 +441,171 @@ void asy_flush(int fd)
 int asy_getc(int fd)
 {
   byte Buffer;
-  int Status;
-  struct tms Timest;
-  clock_t Interval;
-  if (fd == 0) {
+  AsyPort *Port = asy_port(fd);
+  if (fd == 0 || Port == NULL) {
 #ifdef DEBUG
     fprintf(stderr, "asy_getc: Port not open\n");
 #endif
     return -1;
   }
-  /* Is any data pending from an asy_test? */
-  if (PendingData) {
-    PendingData = FALSE;
+  /* Anything buffered, from an earlier fill or an asy_test? */
+  if (Port->Count == 0 && asy_fill(Port, FALSE) <= 0) {
+    return -1;
+  }
+  Buffer = Port->Ring[Port->Head];
+  Port->Head = (Port->Head + 1) % RingSize;
+  Port->Count--;
+#ifdef DEBUG
+  fprintf(stderr,"asy_getc: Read char : %s\n", diagchar(Buffer));
+#endif
+  return (int) Buffer;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : asy_nextline()
+*** Precondition     : fd is open, Line is a buffer of MaxLen bytes.
+*** Postcondition    : As asy_readline, except that it never reads from the
+***                    tty: asy_nextline is negative if no complete line is
+***                    buffered yet.
+***
+*******************************************************************************/
+
+int asy_nextline(int fd, char *Line, int MaxLen)
+{
+  AsyPort *Port = asy_port(fd);
+  int Scanned, i, Index;
+  if (fd == 0 || Port == NULL || MaxLen < 2) {
 #ifdef DEBUG
-    fprintf(stderr,"asy_getc: Pending char : %s\n", diagchar(PendingDataBuffer));
+    fprintf(stderr, "asy_nextline: Port not open\n");
 #endif
-    return (int) PendingDataBuffer;
+    return -1;
   }
 
-  /* Re-read until we are not affected by a signal. */
-  do {
-    Interval = times (&Timest);
-    Status = read (fd, &Buffer, 1);
-    Interval = times (&Timest) - Interval;
+  for (Scanned = 0; Scanned < Port->Count; Scanned++) {
+    if (Port->Ring[(Port->Head + Scanned) % RingSize] == '\n') {
+      Scanned++;
+      for (i = 0, Index = Port->Head; i < Scanned; i++) {
+        Line[i] = Port->Ring[Index];
+        Index = (Index + 1) % RingSize;
+      }
+      Line[Scanned] = '\0';
+      Port->Head = Index;
+      Port->Count -= Scanned;
+#ifdef DEBUG
+      fprintf(stderr,"asy_nextline: Read line of %d bytes\n", Scanned);
+#endif
+      return Scanned;
+    }
+    if (Scanned == MaxLen - 2) {
+      /* No room for the newline and terminator */
+      Port->Head = (Port->Head + Scanned + 1) % RingSize;
+      Port->Count -= Scanned + 1;
+      return 0;
+    }
   }
-  while (Status == -1 && errno == EINTR);
-  if (Status != 1) {
+  return -1;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : asy_readline()
+*** Precondition     : fd is open, Line is a buffer of MaxLen bytes.
+*** Postcondition    : asy_readline is positive, the length of the line
+***                    stored in Line, including its terminating newline. The
+***                    line is NUL-terminated.
+***                    asy_readline is 0, and MaxLen - 1 bytes arrived without
+***                    a newline; they have been discarded.
+***                    asy_readline is -1, indicating a timeout. Any partial
+***                    line stays buffered.
+***                    asy_readline is -2, and the port failed, or the other
+***                    end of a socket closed it.
+***
+*******************************************************************************/
+
+int asy_readline(int fd, char *Line, int MaxLen)
+{
+  AsyPort *Port = asy_port(fd);
+  int Status;
+  if (fd == 0 || Port == NULL || MaxLen < 2) {
 #ifdef DEBUG
-    fprintf (stderr, "asy_getc: Read returned %d. Errno=%d Interval=%ld\n", 
-             Status, errno, (long) Interval);
+    fprintf(stderr, "asy_readline: Port not open\n");
 #endif
     return -1;
   }
+
+  while ((Status = asy_nextline(fd, Line, MaxLen)) < 0) {
+    if ((Status = asy_fill(Port, FALSE)) <= 0) {
+      return Status == 0 ? -1 : -2;
+    }
+  }
+  return Status;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : asy_read()
+*** Precondition     : fd is open, Data is a buffer of Len bytes, and Len is
+***                    at most the port's buffer size.
+*** Postcondition    : asy_read is Len, and the next Len bytes received are
+***                    stored in Data.
+***                    asy_read is -1, indicating a timeout. Any bytes that
+***                    did arrive stay buffered.
+***                    asy_read is -2, and the port failed, or the other end
+***                    of a socket closed it.
+***
+*******************************************************************************/
+
+int asy_read(int fd, byte *Data, int Len)
+{
+  AsyPort *Port = asy_port(fd);
+  int Status, i;
+  if (fd == 0 || Port == NULL || Len > RingSize) {
 #ifdef DEBUG
-  fprintf(stderr,"asy_getc: Read char : %s\n", diagchar(Buffer));
+    fprintf(stderr, "asy_read: Port not open\n");
 #endif
-  return (int) Buffer;
+    return -1;
+  }
+
+  while (Port->Count < Len) {
+    if ((Status = asy_fill(Port, FALSE)) <= 0) {
+      return Status == 0 ? -1 : -2;
+    }
+  }
+  for (i = 0; i < Len; i++) {
+    Data[i] = Port->Ring[Port->Head];
+    Port->Head = (Port->Head + 1) % RingSize;
+  }
+  Port->Count -= Len;
+  return Len;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : asy_receive()
+*** Precondition     : fd is open, and readable - e.g. poll() has reported
+***                    POLLIN for it - so this won't wait.
+*** Postcondition    : asy_receive is positive, the number of bytes read
+***                    into the port's buffer, for asy_nextline to return.
+***                    asy_receive is 0 if nothing could be read (buffer
+***                    full, or end of file), negative on error.
+***
+*******************************************************************************/
+
+int asy_receive(int fd)
+{
+  AsyPort *Port = asy_port(fd);
+  if (fd == 0 || Port == NULL) {
+#ifdef DEBUG
+    fprintf(stderr, "asy_receive: Port not open\n");
+#endif
+    return -1;
+  }
+  return asy_fill(Port, FALSE);
 }
 
 
@@ -292,29 +620,30 @@ int asy_getc(int fd)
 
 int asy_test(int fd)
 {
+  AsyPort *Port = asy_port(fd);
 #ifdef DEBUG
   static int LastPendingData = 999;
+  int PendingData;
 #endif
-  if (fd == 0) {
+  if (fd == 0 || Port == NULL) {
 #ifdef DEBUG
     fprintf(stderr, "asy_test: Port not open\n");
 #endif
     return -1;
   }
-  if (PendingData) {
+  if (Port->Count > 0) {
 #ifdef DEBUG
     printf("asy_test: Previous data pending\n");
 #endif
     return TRUE; /* There's something from last time, still... */
   }
-  /* Switch to nodelay mode for a sec */
-  (void) fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NDELAY);
-  /* Is there anything to read? */
-  PendingData = (read (fd, &PendingDataBuffer, 1) == 1);
+  /* Is there anything to read? Whatever is there stays buffered. */
+  (void) asy_fill(Port, TRUE);
 #ifdef DEBUG
+  PendingData = Port->Count > 0;
   printf("asy_test: PendingData is %d\n",PendingData);
   if (PendingData) {
-    printf("asy_test: data available %s\n",diagchar(PendingDataBuffer));
+    printf("asy_test: data available %s\n",diagchar(Port->Ring[Port->Head]));
   }
   else {
     if (LastPendingData != PendingData) {
@@ -323,8 +652,5 @@ int asy_test(int fd)
   }
   LastPendingData = PendingData;
 #endif
-  /* Now switch back to delayed action */
-  (void) fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & (~O_NDELAY));
-  return PendingData;
+  return Port->Count > 0;
 }
-
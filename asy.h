@@ -4,7 +4,7 @@
 *** Purpose          : Definitions for the ASY physical layer in NCP
 *** Author           : Matt J. Gumbley
 *** Created          : 16/01/97
-*** Last updated     : 29/12/98
+*** Last updated     : 16/10/26
 ***
 ********************************************************************************
 ***
@@ -18,9 +18,14 @@
 void asy_flush(int);
 int  asy_test(int);
 int  asy_getc(int);
+int  asy_readline(int, char*, int);
+int  asy_nextline(int, char*, int);
+int  asy_read(int, byte*, int);
+int  asy_receive(int);
 int  asy_uputc(int, byte);
 int  asy_write(int, byte*, int);
 int  asy_open(char*, int, bool);
+int  asy_connect(char*);
 void asy_close(int);
 
 #endif /* ASY_H */
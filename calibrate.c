@@ -0,0 +1,208 @@
+/*******************************************************************************
+***
+*** Filename         : calibrate.c
+*** Purpose          : Finding the shortest settle delay that keeps the SWR
+***                    accurate, and remembering it for each port.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The driver captures the forward and then the reverse
+***                    detector with the oscilloscope, sampling as fast as
+***                    the analyser will, straight after moving the DDS to a
+***                    new frequency. Pairing the two captures sample by
+***                    sample gives the SWR the analyser would have measured
+***                    that long after the change. It's settled once it stays
+***                    within the tolerance of its final value, or within
+***                    the noise if that's larger, as no settle delay could
+***                    do better.
+***                    Calibrated delays are kept in ~/.analyser_settle, a
+***                    line of port name and milliseconds per port.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "global.h"
+#include "calibrate.h"
+
+/* Samples each side in the median that steadies each reading */
+#define MedianHalfWidth 2
+
+/* The noise allowance, in standard deviations */
+#define NoiseDeviations 3.0
+
+#define LineMax 256
+
+
+static double swr(double Fwd, double Rev)
+{
+  return Rev >= Fwd ? 999.0 : (Fwd + Rev) / (Fwd - Rev);
+}
+
+
+static double median(const long *Values, long Count, long Index)
+{
+  long window[2 * MedianHalfWidth + 1], v;
+  long lo = Index - MedianHalfWidth, hi = Index + MedianHalfWidth, i;
+  int n = 0, k;
+
+  lo = lo < 0L ? 0L : lo;
+  hi = hi > Count - 1L ? Count - 1L : hi;
+  for (i = lo; i <= hi; i++, n++) {
+    v = Values[i];
+    for (k = n; k > 0 && window[k - 1] > v; k--) {
+      window[k] = window[k - 1];
+    }
+    window[k] = v;
+  }
+  return n % 2 == 1 ? window[n / 2] : (window[n / 2 - 1] + window[n / 2]) / 2.0;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : calibrate_step
+*** Preconditions    : Fwd and Rev hold Count readings of the forward and
+***                    reverse detectors, taken PeriodMs apart starting
+***                    PeriodMs after the DDS changed frequency.
+*** Postconditions   : calibrate_step is TRUE, and Step says how long the
+***                    SWR took to settle to within Tolerance of its final
+***                    value, or FALSE if there are too few readings or not
+***                    enough memory.
+***
+*******************************************************************************/
+
+bool calibrate_step(const long *Fwd, const long *Rev, long Count, double PeriodMs,
+  double Tolerance, CalibrateStep *Step)
+{
+  double *v, fwd = 0.0, rev = 0.0, mean = 0.0, variance = 0.0;
+  long tail = Count / 4L, i, k;
+
+  memset(Step, 0, sizeof(CalibrateStep));
+  if (tail < 2L || (v = malloc(Count * sizeof(double))) == NULL) {
+    return FALSE;
+  }
+  for (i = Count - tail; i < Count; i++) {
+    fwd += Fwd[i];
+    rev += Rev[i];
+  }
+  Step->FinalSwr = swr(fwd / tail, rev / tail);
+
+  for (i = 0L; i < Count; i++) {
+    v[i] = swr(median(Fwd, Count, i), median(Rev, Count, i));
+  }
+  for (i = Count - tail; i < Count; i++) {
+    mean += v[i] / tail;
+  }
+  for (i = Count - tail; i < Count; i++) {
+    variance += (v[i] - mean) * (v[i] - mean) / (tail - 1L);
+  }
+  Step->Allowed = NoiseDeviations * sqrt(variance);
+  if (Step->Allowed < Tolerance) {
+    Step->Allowed = Tolerance;
+  }
+
+  /* The first reading from which on they all stay within what's allowed */
+  for (k = Count; k > 0L && fabs(v[k - 1] - Step->FinalSwr) <= Step->Allowed; k--)
+    ;
+  free(v);
+  Step->Settled = k < Count - tail;
+  Step->SettleMs = (k + 1L) * PeriodMs;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : calibrate_file_name
+*** Preconditions    : Out has room for Max characters.
+*** Postconditions   : Out is the name of the file of calibrated settle
+***                    delays, in the home directory (or the current one if
+***                    HOME isn't set).
+***
+*******************************************************************************/
+
+void calibrate_file_name(char *Out, int Max)
+{
+  char *home = getenv("HOME");
+
+  snprintf(Out, Max, "%s/.analyser_settle", home != NULL ? home : ".");
+}
+
+
+/*******************************************************************************
+***
+*** Function         : calibrate_load
+*** Preconditions    : None
+*** Postconditions   : calibrate_load is the settle delay in ms calibrated
+***                    for Port and saved in FileName, or -1 if there's none.
+***
+*******************************************************************************/
+
+int calibrate_load(const char *FileName, const char *Port)
+{
+  char line[LineMax], port[LineMax];
+  int settle, found = -1;
+  FILE *in;
+
+  if ((in = fopen(FileName, "r")) == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (sscanf(line, "%255s %d", port, &settle) == 2 && strcmp(port, Port) == 0) {
+      found = settle;
+    }
+  }
+  fclose(in);
+  return found;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : calibrate_save
+*** Preconditions    : None
+*** Postconditions   : calibrate_save is TRUE, and FileName has Settle as
+***                    Port's settle delay in place of any saved before,
+***                    keeping those of other ports. It's replaced in one
+***                    go, so a scan never reads it half written. FALSE if
+***                    it can't be written.
+***
+*******************************************************************************/
+
+bool calibrate_save(const char *FileName, const char *Port, int Settle)
+{
+  char tempName[LineMax + 8], line[LineMax], port[LineMax];
+  FILE *in, *out;
+  bool ok;
+
+  snprintf(tempName, sizeof(tempName), "%s.tmp", FileName);
+  if ((out = fopen(tempName, "w")) == NULL) {
+    return FALSE;
+  }
+  if ((in = fopen(FileName, "r")) != NULL) {
+    while (fgets(line, sizeof(line), in) != NULL) {
+      if (sscanf(line, "%255s", port) == 1 && strcmp(port, Port) != 0) {
+        fputs(line, out);
+      }
+    }
+    fclose(in);
+  }
+  fprintf(out, "%s %d\n", Port, Settle);
+  ok = !ferror(out);
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(tempName, FileName) != 0) {
+    unlink(tempName);
+    return FALSE;
+  }
+  return TRUE;
+}
@@ -0,0 +1,39 @@
+/*******************************************************************************
+***
+*** Filename         : calibrate.h
+*** Purpose          : Definitions for calibrating the settle delay
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+#include "global.h"
+
+/* SWR error allowed by a calibrated settle delay, unless another is given */
+#define CalibrateTolerance 0.05
+
+/* Most samples of an oscilloscope capture that are analysed */
+#define CalibrateSamplesMax 4096
+
+/* How the detectors settled after one change of frequency */
+typedef struct {
+  bool Settled;                 /* Within the capture's first 3/4 */
+  double SettleMs;              /* From the change to the first settled sample */
+  double FinalSwr;              /* Over the capture's last 1/4 */
+  double Allowed;               /* The tolerance, or the noise if greater */
+} CalibrateStep;
+
+bool calibrate_step(const long *, const long *, long, double, double, CalibrateStep *);
+void calibrate_file_name(char *, int);
+int  calibrate_load(const char *, const char *);
+bool calibrate_save(const char *, const char *, int);
+
+#endif /* CALIBRATE_H */
@@ -0,0 +1,169 @@
+/*******************************************************************************
+***
+*** Filename         : capture.c
+*** Purpose          : Writing an oscilloscope capture that runs until it's
+***                    interrupted, across segment files bounded in size or
+***                    time, listed in a manifest.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The layout is described in capture.h. The memory used
+***                    is one segment's buffer however long the capture
+***                    runs. Samples are only written to disk when that
+***                    buffer is full, every CaptureBufferSize bytes (ten
+***                    seconds or so at 57600 bps), and then only into the
+***                    page cache, which the serial port's own buffering
+***                    more than covers; nothing waits for the disk.
+***                    A segment only gets its final name, and a manifest
+***                    entry, once it has been written in full, so an
+***                    interrupted capture leaves either whole segments or
+***                    a .part file, never a partial segment under its
+***                    final name. Segment numbers carry on from any left
+***                    by an earlier capture to the same base, complete or
+***                    not.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "global.h"
+#include "capture.h"
+
+#define PartExtension ".part"
+#define ManifestExtension ".manifest"
+
+
+/*******************************************************************************
+***
+*** Function         : capture_open
+*** Preconditions    : MaxBytes or MaxSeconds is above 0.
+*** Postconditions   : capture_open is TRUE and C is ready to write segments
+***                    of Base, rotated after MaxBytes or MaxSeconds (0 for
+***                    no limit), or FALSE if there's not enough memory.
+***
+*******************************************************************************/
+
+bool capture_open(Capture *C, const char *Base, long MaxBytes, long MaxSeconds)
+{
+  memset(C, 0, sizeof(Capture));
+  strncpy(C->Base, Base, CaptureNameMax - 1);
+  C->MaxBytes = MaxBytes;
+  C->MaxSeconds = MaxSeconds;
+  return (C->Buffer = malloc(CaptureBufferSize)) != NULL;
+}
+
+
+/* Start the next free segment */
+static bool capture_start(Capture *C)
+{
+  char part[sizeof(C->Name) + sizeof(PartExtension)];
+
+  do {
+    C->Segment++;
+    snprintf(C->Name, sizeof(C->Name), "%s.%04d", C->Base, C->Segment);
+    snprintf(part, sizeof(part), "%s" PartExtension, C->Name);
+  } while (access(C->Name, F_OK) == 0 || access(part, F_OK) == 0);
+  if ((C->Out = fopen(part, "w")) == NULL) {
+    return FALSE;
+  }
+  setvbuf(C->Out, C->Buffer, _IOFBF, CaptureBufferSize);
+  C->Bytes = 0L;
+  C->Samples = 0L;
+  C->Started = time(NULL);
+  return TRUE;
+}
+
+
+/* Write out the current segment, give it its name, and list it */
+static bool capture_finish(Capture *C)
+{
+  char part[sizeof(C->Name) + sizeof(PartExtension)];
+  char manifest[CaptureNameMax + sizeof(ManifestExtension)];
+  FILE *out;
+  bool ok;
+
+  snprintf(part, sizeof(part), "%s" PartExtension, C->Name);
+  ok = fclose(C->Out) == 0;
+  C->Out = NULL;
+  if (!ok) {
+    return FALSE;
+  }
+  if (C->Samples == 0L) {
+    unlink(part);
+    return TRUE;
+  }
+  if (rename(part, C->Name) == -1) {
+    return FALSE;
+  }
+  snprintf(manifest, sizeof(manifest), "%s" ManifestExtension, C->Base);
+  if ((out = fopen(manifest, "a")) == NULL) {
+    return FALSE;
+  }
+  fprintf(out, "%s %ld %ld %ld %ld %ld %ld\n", C->Name, C->FirstSample, C->LastSample,
+    C->Samples, (long) C->Started, (long) time(NULL), C->Bytes);
+  C->Segments++;
+  return (ferror(out) | (fclose(out) != 0)) == 0;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : capture_write
+*** Preconditions    : C was opened by capture_open; Line is the Length
+***                    bytes of the capture line of sample Sample.
+*** Postconditions   : capture_write is TRUE and Line has been added to the
+***                    current segment, the last one having been completed
+***                    and a new one started if it had reached its limit; or
+***                    FALSE if a segment can't be written.
+***
+*******************************************************************************/
+
+bool capture_write(Capture *C, long Sample, const char *Line, int Length)
+{
+  if (C->Out != NULL &&
+      ((C->MaxBytes > 0L && C->Bytes + Length > C->MaxBytes) ||
+       (C->MaxSeconds > 0L && time(NULL) - C->Started >= C->MaxSeconds))) {
+    if (!capture_finish(C)) {
+      return FALSE;
+    }
+  }
+  if (C->Out == NULL && !capture_start(C)) {
+    return FALSE;
+  }
+  if (C->Samples == 0L) {
+    C->FirstSample = Sample;
+  }
+  C->LastSample = Sample;
+  C->Samples++;
+  C->Bytes += Length;
+  return fwrite(Line, 1, Length, C->Out) == (size_t) Length;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : capture_close
+*** Preconditions    : C was opened by capture_open.
+*** Postconditions   : capture_close is TRUE and the current segment, if
+***                    any, has been completed and listed, or FALSE if it
+***                    can't be written. C's memory has been freed.
+***
+*******************************************************************************/
+
+bool capture_close(Capture *C)
+{
+  bool ok = C->Out == NULL || capture_finish(C);
+
+  free(C->Buffer);
+  C->Buffer = NULL;
+  return ok;
+}
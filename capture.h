@@ -0,0 +1,58 @@
+/*******************************************************************************
+***
+*** Filename         : capture.h
+*** Purpose          : Definitions for oscilloscope captures rotated across
+***                    segment files
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "global.h"
+
+/*
+ * A capture is written to segments <base>.0001, <base>.0002, ... each of
+ * capture lines, as a single capture file would be. A segment is written
+ * as <name>.part and renamed when complete. <base>.manifest lists the
+ * complete segments, a line each:
+ *
+ *   name first-sample last-sample samples started ended bytes
+ *
+ * with the times in seconds since the epoch.
+ */
+
+#define CaptureNameMax 256
+#define CaptureBufferSize 65536     /* Bytes written to a segment at once */
+
+typedef struct {
+  char Base[CaptureNameMax];
+  long MaxBytes;                /* Of a segment, 0 for no limit */
+  long MaxSeconds;              /* Of a segment, 0 for no limit */
+  char *Buffer;                 /* Out's buffer */
+  FILE *Out;                    /* The current segment, NULL between them */
+  char Name[CaptureNameMax + 8];
+  int Segment;                  /* Its number */
+  int Segments;                 /* Completed */
+  long Bytes;
+  long Samples;
+  long FirstSample;
+  long LastSample;
+  time_t Started;
+} Capture;
+
+bool capture_open(Capture *, const char *, long, long);
+bool capture_write(Capture *, long, const char *, int);
+bool capture_close(Capture *);
+
+#endif /* CAPTURE_H */
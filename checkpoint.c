@@ -0,0 +1,210 @@
+/*******************************************************************************
+***
+*** Filename         : checkpoint.c
+*** Purpose          : Recording scans as they start, so that if they're
+***                    interrupted they can be resumed from their last point.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : A scan's parameters are saved next to its scan file,
+***                    in <file>.resume, when it starts, and removed when it
+***                    ends. How far it got isn't saved: it's the scan file
+***                    itself, which is written as the points arrive. So a
+***                    scan can be resumed however it was interrupted - a
+***                    timeout, Ctrl-C, or the computer crashing. A partly
+***                    written last point is cut off, and measured again.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "scanfile.h"
+#include "checkpoint.h"
+
+#define Extension ".resume"
+#define LineMax 256
+
+/* Longest scan file name */
+#define CheckpointNameMax 256
+
+
+static void checkpoint_name(char *Out, char *ScanFileName)
+{
+  snprintf(Out, CheckpointNameMax + sizeof(Extension), "%s" Extension, ScanFileName);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : checkpoint_save
+*** Preconditions    : The scan in C is starting, to ScanFileName.
+*** Postconditions   : checkpoint_save is TRUE and C's parameters (not Done
+***                    or LastFreq) have been saved, or FALSE if they can't
+***                    be written.
+***
+*******************************************************************************/
+
+bool checkpoint_save(char *ScanFileName, Checkpoint *C)
+{
+  char name[CheckpointNameMax + sizeof(Extension)];
+  FILE *out;
+  bool ok;
+
+  checkpoint_name(name, ScanFileName);
+  if ((out = fopen(name, "w")) == NULL) {
+    return FALSE;
+  }
+  fprintf(out, "start %ld\nstop %ld\nsteps %d\nsettle %d\nformat %s\ntitle %s\n",
+    C->StartFreq, C->StopFreq, C->NumSteps, C->SettleDelay,
+    C->Format == SCAN_FORMAT_BIN ? "bin" : "text", C->Title);
+  ok = !ferror(out);
+  return fclose(out) == 0 && ok;
+}
+
+
+/* How many points a binary scan file holds, cutting off any partial record
+   (or header) */
+static bool binary_progress(char *ScanFileName, Checkpoint *C)
+{
+  struct stat st;
+  ScanFile scan;
+  ScanPoint point;
+  off_t keep;
+
+  if (stat(ScanFileName, &st) == -1) {
+    return FALSE;
+  }
+  if (st.st_size < ScanFileHeaderSize) {
+    return truncate(ScanFileName, 0) == 0;
+  }
+  C->Done = (st.st_size - ScanFileHeaderSize) / ScanFileRecordSize;
+  keep = ScanFileHeaderSize + (off_t) C->Done * ScanFileRecordSize;
+  if (keep != st.st_size && truncate(ScanFileName, keep) != 0) {
+    return FALSE;
+  }
+  if (C->Done > 0L) {
+    if (!scanfile_map(ScanFileName, &scan)) {
+      return FALSE;
+    }
+    scanfile_record(&scan, C->Done - 1L, &point);
+    C->LastFreq = point.Freq;
+    scanfile_unmap(&scan);
+  }
+  return TRUE;
+}
+
+
+/* How many lines a text scan file holds, cutting off any partial line */
+static bool text_progress(char *ScanFileName, Checkpoint *C)
+{
+  char buf[BUFSIZ], line[LineMax];
+  long offset = 0L, end = 0L, lastLine = -1L, lineStart = 0L;
+  double mhz;
+  size_t len, i;
+  FILE *in;
+
+  if ((in = fopen(ScanFileName, "r")) == NULL) {
+    return FALSE;
+  }
+  while ((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+    for (i = 0; i < len; i++) {
+      if (buf[i] == '\n') {
+        C->Done++;
+        lastLine = lineStart;
+        lineStart = end = offset + (long) i + 1L;
+      }
+    }
+    offset += (long) len;
+  }
+  if (lastLine >= 0L && fseek(in, lastLine, SEEK_SET) == 0 &&
+      fgets(line, sizeof(line), in) != NULL && sscanf(line, "%lf", &mhz) == 1) {
+    C->LastFreq = (long) (mhz * 100000000.0 + 0.5);
+  }
+  fclose(in);
+  return end == offset || truncate(ScanFileName, end) == 0;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : checkpoint_load
+*** Preconditions    : None
+*** Postconditions   : checkpoint_load is TRUE, and C describes the
+***                    interrupted scan to ScanFileName: its parameters, and
+***                    the number of points in the scan file and the last
+***                    one's frequency (after cutting off any partly written
+***                    point). FALSE if there's no checkpoint for it, or the
+***                    scan file can't be read.
+***
+*******************************************************************************/
+
+bool checkpoint_load(char *ScanFileName, Checkpoint *C)
+{
+  char name[CheckpointNameMax + sizeof(Extension)];
+  char line[LineMax], *value;
+  FILE *in;
+  int found = 0;
+
+  memset(C, 0, sizeof(Checkpoint));
+  checkpoint_name(name, ScanFileName);
+  if ((in = fopen(name, "r")) == NULL) {
+    return FALSE;
+  }
+  while (fgets(line, sizeof(line), in) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if ((value = strchr(line, ' ')) == NULL) {
+      continue;
+    }
+    *value++ = '\0';
+    found++;
+    if (strcmp(line, "start") == 0) {
+      C->StartFreq = atol(value);
+    } else if (strcmp(line, "stop") == 0) {
+      C->StopFreq = atol(value);
+    } else if (strcmp(line, "steps") == 0) {
+      C->NumSteps = atoi(value);
+    } else if (strcmp(line, "settle") == 0) {
+      C->SettleDelay = atoi(value);
+    } else if (strcmp(line, "format") == 0) {
+      C->Format = strcmp(value, "bin") == 0 ? SCAN_FORMAT_BIN : SCAN_FORMAT_TEXT;
+    } else if (strcmp(line, "title") == 0) {
+      strncpy(C->Title, value, ScanFileTitleMax - 1);
+    } else {
+      found--;
+    }
+  }
+  fclose(in);
+  if (found < 6 || C->NumSteps < 1) {
+    return FALSE;
+  }
+  return C->Format == SCAN_FORMAT_BIN ? binary_progress(ScanFileName, C) :
+                                        text_progress(ScanFileName, C);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : checkpoint_remove
+*** Preconditions    : None
+*** Postconditions   : The scan to ScanFileName has no checkpoint.
+***
+*******************************************************************************/
+
+void checkpoint_remove(char *ScanFileName)
+{
+  char name[CheckpointNameMax + sizeof(Extension)];
+
+  checkpoint_name(name, ScanFileName);
+  unlink(name);
+}
@@ -0,0 +1,37 @@
+/*******************************************************************************
+***
+*** Filename         : checkpoint.h
+*** Purpose          : Definitions for resuming interrupted scans
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "global.h"
+#include "scanfile.h"
+
+/* A scan, and how far it got */
+typedef struct {
+  long StartFreq;               /* Hz */
+  long StopFreq;
+  int NumSteps;
+  int SettleDelay;
+  int Format;                   /* SCAN_FORMAT_ */
+  char Title[ScanFileTitleMax];
+  long Done;                    /* Points in the scan file */
+  long LastFreq;                /* The last one's frequency, Hz x 100 */
+} Checkpoint;
+
+bool checkpoint_save(char *, Checkpoint *);
+bool checkpoint_load(char *, Checkpoint *);
+void checkpoint_remove(char *);
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,635 @@
+/*******************************************************************************
+***
+*** Filename         : history.c
+*** Purpose          : An append-only store of sweeps, kept for trend
+***                    analysis, and queries over it.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The layout is described in history.h. A sweep's
+***                    frequencies follow from its start, stop and steps, so
+***                    only its SWRs are kept, as the change from each step
+***                    to the next: a byte or so per point rather than the
+***                    twenty of a text scan file.
+***                    Sweeps are only ever appended, under a lock, so
+***                    several drivers can add to one store. If one is
+***                    interrupted while appending, the partial sweep is cut
+***                    off, and any sweeps missing from the index are added
+***                    to it, the next time a sweep is appended.
+***                    Queries open the store read-only, under a shared lock,
+***                    map the index and the indexed part of the segment
+***                    into memory, pick sweeps by their index entries, and
+***                    decode only those. Entries are checked against the
+***                    segment before any of their sweep is read.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "global.h"
+#include "util.h"
+#include "scanline.h"
+#include "history.h"
+
+#define IndexExtension ".idx"
+#define FileNameMax 256
+
+/* Longest varint, for a change of up to 2^35 */
+#define VarintMax 5
+
+/* Longest line history_query writes */
+#define OutputLineMax 64
+
+
+static unsigned long history_hash(const char *Title, int Length)
+{
+  u_int32_t hash = 2166136261U;
+
+  while (Length-- > 0) {
+    hash ^= (byte) *Title++;
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+
+static void write_word64(byte *Out, long long Value)
+{
+  write_word32(Out, (u_int32_t) (Value & 0xffffffffLL));
+  write_word32(Out + 4, (u_int32_t) (Value >> 32));
+}
+
+
+static long long read_word64(byte *In)
+{
+  return (long long) read_word32(In) | ((long long) read_word32(In + 4) << 32);
+}
+
+
+static void write_header(byte *Out, const char *Magic, int Size)
+{
+  memset(Out, 0, HistoryHeaderSize);
+  memcpy(Out, Magic, 4);
+  write_word16(Out + 4, HistoryVersion);
+  write_word16(Out + 6, (u_int16_t) Size);
+}
+
+
+static bool read_header(byte *In, const char *Magic)
+{
+  return memcmp(In, Magic, 4) == 0 && read_word16(In + 4) == HistoryVersion;
+}
+
+
+/* Index the sweeps at the end of the segment that the index is missing,
+   cutting off a partly written one. Returns the index, open for append,
+   and sets *End to the end of the segment, or -1 if they can't be read or
+   written. */
+static int history_sync(const char *StoreName, int SegmentFd, off_t *End)
+{
+  char indexName[FileNameMax + sizeof(IndexExtension)];
+  byte header[HistorySweepHeaderSize + HistoryTitleMax], entry[HistoryEntrySize];
+  struct stat st;
+  off_t segmentSize, offset, entries;
+  long size;
+  int indexFd, titleLength;
+
+  snprintf(indexName, sizeof(indexName), "%s" IndexExtension, StoreName);
+  if ((indexFd = open(indexName, O_RDWR | O_CREAT, 0644)) == -1) {
+    return -1;
+  }
+  if (fstat(SegmentFd, &st) == -1) {
+    close(indexFd);
+    return -1;
+  }
+  segmentSize = st.st_size;
+  if (segmentSize < HistoryHeaderSize) {
+    write_header(header, HistoryMagic, HistoryHeaderSize);
+    if (ftruncate(SegmentFd, 0) == -1 ||
+        pwrite(SegmentFd, header, HistoryHeaderSize, 0) != HistoryHeaderSize) {
+      close(indexFd);
+      return -1;
+    }
+    segmentSize = HistoryHeaderSize;
+  }
+
+  // Where the indexed sweeps end; start again if the index is unreadable
+  offset = HistoryHeaderSize;
+  entries = 0;
+  if (fstat(indexFd, &st) == 0 && st.st_size >= HistoryHeaderSize &&
+      pread(indexFd, header, HistoryHeaderSize, 0) == HistoryHeaderSize &&
+      read_header(header, HistoryIndexMagic) &&
+      read_word16(header + 6) == HistoryEntrySize) {
+    entries = (st.st_size - HistoryHeaderSize) / HistoryEntrySize;
+    if (entries > 0 &&
+        pread(indexFd, entry, HistoryEntrySize,
+              HistoryHeaderSize + (entries - 1) * HistoryEntrySize) == HistoryEntrySize) {
+      offset = read_word64(entry + 20) + read_word32(entry + 28);
+    }
+    if (offset > segmentSize) {
+      entries = 0;
+      offset = HistoryHeaderSize;
+    }
+  }
+  write_header(header, HistoryIndexMagic, HistoryEntrySize);
+  if (ftruncate(indexFd, HistoryHeaderSize + entries * HistoryEntrySize) == -1 ||
+      (entries == 0 && pwrite(indexFd, header, HistoryHeaderSize, 0) != HistoryHeaderSize) ||
+      lseek(indexFd, 0, SEEK_END) == -1) {
+    close(indexFd);
+    return -1;
+  }
+
+  while (offset + HistorySweepHeaderSize <= segmentSize) {
+    if (pread(SegmentFd, header, sizeof(header), offset) < HistorySweepHeaderSize) {
+      break;
+    }
+    size = read_word32(header);
+    titleLength = header[24];
+    if (size < HistorySweepHeaderSize + titleLength || offset + size > segmentSize) {
+      break;
+    }
+    memcpy(entry, header + 4, 16);
+    write_word32(entry + 16,
+      (u_int32_t) history_hash((char *) header + HistorySweepHeaderSize, titleLength));
+    write_word64(entry + 20, offset);
+    write_word32(entry + 28, (u_int32_t) size);
+    if (write(indexFd, entry, HistoryEntrySize) != HistoryEntrySize) {
+      close(indexFd);
+      return -1;
+    }
+    offset += size;
+  }
+  if (offset != segmentSize && ftruncate(SegmentFd, offset) == -1) {
+    close(indexFd);
+    return -1;
+  }
+  *End = offset;
+  return indexFd;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_append
+*** Preconditions    : Vswr holds the NumSteps + 1 SWRs x 1000 of a sweep from
+***                    StartFreq to StopFreq (Hz) titled Title, at Timestamp.
+*** Postconditions   : history_append is TRUE and the sweep has been added to
+***                    the store StoreName (which is created if need be), or
+***                    FALSE if it can't be written.
+***
+*******************************************************************************/
+
+bool history_append(const char *StoreName, const char *Title, long Timestamp,
+  long StartFreq, long StopFreq, long NumSteps, const long *Vswr)
+{
+  byte *sweep, *p, entry[HistoryEntrySize];
+  long long delta;
+  unsigned long long zigzag;
+  int segmentFd, indexFd, titleLength = strlen(Title);
+  off_t end;
+  long i, size;
+  bool ok;
+
+  if (NumSteps < 1L) {
+    return FALSE;
+  }
+  if (titleLength > HistoryTitleMax - 1) {
+    titleLength = HistoryTitleMax - 1;
+  }
+  if ((sweep = malloc(HistorySweepHeaderSize + titleLength + NumSteps * VarintMax)) == NULL) {
+    return FALSE;
+  }
+  write_word32(sweep + 4, (u_int32_t) Timestamp);
+  write_word32(sweep + 8, (u_int32_t) StartFreq);
+  write_word32(sweep + 12, (u_int32_t) StopFreq);
+  write_word32(sweep + 16, (u_int32_t) NumSteps);
+  write_word32(sweep + 20, (u_int32_t) Vswr[0]);
+  sweep[24] = (byte) titleLength;
+  memcpy(sweep + HistorySweepHeaderSize, Title, titleLength);
+  p = sweep + HistorySweepHeaderSize + titleLength;
+  for (i = 1L; i <= NumSteps; i++) {
+    delta = (long long) Vswr[i] - Vswr[i - 1];
+    zigzag = ((unsigned long long) delta << 1) ^ (unsigned long long) (delta >> 63);
+    while (zigzag >= 0x80ULL) {
+      *p++ = (byte) (zigzag | 0x80ULL);
+      zigzag >>= 7;
+    }
+    *p++ = (byte) zigzag;
+  }
+  size = p - sweep;
+  write_word32(sweep, (u_int32_t) size);
+
+  if ((segmentFd = open(StoreName, O_RDWR | O_CREAT, 0644)) == -1) {
+    free(sweep);
+    return FALSE;
+  }
+  if (flock(segmentFd, LOCK_EX) == -1 ||
+      (indexFd = history_sync(StoreName, segmentFd, &end)) == -1) {
+    close(segmentFd);
+    free(sweep);
+    return FALSE;
+  }
+  // The sweep, then its index entry: if interrupted between the two, the
+  // next history_sync indexes it
+  ok = pwrite(segmentFd, sweep, size, end) == size;
+  if (ok) {
+    memcpy(entry, sweep + 4, 16);
+    write_word32(entry + 16, (u_int32_t) history_hash(Title, titleLength));
+    write_word64(entry + 20, end);
+    write_word32(entry + 28, (u_int32_t) size);
+    ok = write(indexFd, entry, HistoryEntrySize) == HistoryEntrySize;
+  }
+  ok = close(indexFd) == 0 && ok;
+  close(segmentFd);
+  free(sweep);
+  return ok;
+}
+
+
+static byte *map_file(int Fd, size_t Length)
+{
+  byte *map = mmap(NULL, Length, PROT_READ, MAP_SHARED, Fd, 0);
+
+  return map == MAP_FAILED ? NULL : map;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_open
+*** Preconditions    : None
+*** Postconditions   : history_open is TRUE, the store StoreName is mapped
+***                    read-only as far as its index goes, and H describes
+***                    it; release it with history_close. Neither file is
+***                    changed: sweeps not yet indexed are left for the
+***                    next history_append to index.
+***                    FALSE if there's no such store or it can't be read.
+***
+*******************************************************************************/
+
+bool history_open(const char *StoreName, History *H)
+{
+  char indexName[FileNameMax + sizeof(IndexExtension)];
+  struct stat segmentSt, indexSt;
+  int segmentFd, indexFd;
+  off_t end = HistoryHeaderSize;
+  byte header[HistoryHeaderSize], entry[HistoryEntrySize];
+  long count;
+
+  memset(H, 0, sizeof(History));
+  if ((segmentFd = open(StoreName, O_RDONLY)) == -1) {
+    return FALSE;
+  }
+  snprintf(indexName, sizeof(indexName), "%s" IndexExtension, StoreName);
+  if (pread(segmentFd, header, HistoryHeaderSize, 0) != HistoryHeaderSize ||
+      !read_header(header, HistoryMagic) || flock(segmentFd, LOCK_SH) == -1 ||
+      (indexFd = open(indexName, O_RDONLY)) == -1) {
+    close(segmentFd);
+    return FALSE;
+  }
+  if (fstat(segmentFd, &segmentSt) == -1 || fstat(indexFd, &indexSt) == -1 ||
+      pread(indexFd, header, HistoryHeaderSize, 0) != HistoryHeaderSize ||
+      !read_header(header, HistoryIndexMagic) ||
+      read_word16(header + 6) != HistoryEntrySize) {
+    close(indexFd);
+    close(segmentFd);
+    return FALSE;
+  }
+  // Only as much of the segment as the last entry covers: a later append
+  // may cut off what's beyond it
+  count = (indexSt.st_size - HistoryHeaderSize) / HistoryEntrySize;
+  if (count > 0L &&
+      pread(indexFd, entry, HistoryEntrySize,
+            HistoryHeaderSize + (count - 1L) * HistoryEntrySize) == HistoryEntrySize) {
+    end = read_word64(entry + 20) + read_word32(entry + 28);
+  }
+  if (end > segmentSt.st_size) {
+    end = segmentSt.st_size;
+  }
+  H->SegmentLength = (size_t) end;
+  H->Segment = map_file(segmentFd, H->SegmentLength);
+  H->IndexLength = HistoryHeaderSize + count * HistoryEntrySize;
+  H->Index = map_file(indexFd, H->IndexLength);
+  close(indexFd);
+  close(segmentFd);
+  if (H->Segment == NULL || H->Index == NULL) {
+    history_close(H);
+    return FALSE;
+  }
+  H->Count = count;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_close
+*** Preconditions    : H was opened by history_open.
+*** Postconditions   : The mappings are released.
+***
+*******************************************************************************/
+
+void history_close(History *H)
+{
+  if (H->Segment != NULL) {
+    munmap(H->Segment, H->SegmentLength);
+    H->Segment = NULL;
+  }
+  if (H->Index != NULL) {
+    munmap(H->Index, H->IndexLength);
+    H->Index = NULL;
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_entry
+*** Preconditions    : 0 <= Index < H->Count
+*** Postconditions   : E is the Index'th sweep's index entry.
+***
+*******************************************************************************/
+
+void history_entry(History *H, long Index, HistoryEntry *E)
+{
+  byte *entry = H->Index + HistoryHeaderSize + Index * HistoryEntrySize;
+
+  E->Timestamp = read_word32(entry);
+  E->StartFreq = read_word32(entry + 4);
+  E->StopFreq = read_word32(entry + 8);
+  E->NumSteps = read_word32(entry + 12);
+  E->TitleHash = read_word32(entry + 16);
+  E->Offset = read_word64(entry + 20);
+  E->Size = read_word32(entry + 28);
+}
+
+
+/* Whether the entry's sweep, and its title, lie within the segment */
+static bool history_in_segment(History *H, HistoryEntry *E)
+{
+  if (E->Offset < HistoryHeaderSize || E->Size < HistorySweepHeaderSize ||
+      E->Offset + E->Size > (long long) H->SegmentLength) {
+    return FALSE;
+  }
+  return HistorySweepHeaderSize + H->Segment[E->Offset + 24] <= E->Size;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_title
+*** Preconditions    : E is an entry of H; Title has room for HistoryTitleMax.
+*** Postconditions   : Title is the sweep's title, or empty if its entry is
+***                    corrupt.
+***
+*******************************************************************************/
+
+void history_title(History *H, HistoryEntry *E, char *Title)
+{
+  byte *sweep = H->Segment + E->Offset;
+
+  if (!history_in_segment(H, E)) {
+    Title[0] = '\0';
+    return;
+  }
+  memcpy(Title, sweep + HistorySweepHeaderSize, sweep[24]);
+  Title[sweep[24]] = '\0';
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_decode
+*** Preconditions    : E is an entry of H; Vswr has room for E->NumSteps + 1.
+*** Postconditions   : history_decode is TRUE and Vswr holds the sweep's
+***                    SWRs x 1000, or FALSE if it's corrupt.
+***
+*******************************************************************************/
+
+bool history_decode(History *H, HistoryEntry *E, long *Vswr)
+{
+  byte *sweep, *p, *end;
+  unsigned long long zigzag;
+  long i;
+  int shift;
+
+  if (!history_in_segment(H, E) || E->NumSteps < 1L) {
+    return FALSE;
+  }
+  sweep = H->Segment + E->Offset;
+  p = sweep + HistorySweepHeaderSize + sweep[24];
+  end = sweep + E->Size;
+  Vswr[0] = read_word32(sweep + 20);
+  for (i = 1L; i <= E->NumSteps; i++) {
+    zigzag = 0ULL;
+    for (shift = 0; p < end && (*p & 0x80) != 0; shift += 7) {
+      if (shift == 7 * (VarintMax - 1)) {
+        /* Longer than history_append writes */
+        return FALSE;
+      }
+      zigzag |= (unsigned long long) (*p++ & 0x7f) << shift;
+    }
+    if (p == end) {
+      return FALSE;
+    }
+    zigzag |= (unsigned long long) *p++ << shift;
+    Vswr[i] = Vswr[i - 1] + (long) ((zigzag >> 1) ^ (0ULL - (zigzag & 1ULL)));
+  }
+  return TRUE;
+}
+
+
+/* Whether the entry is one the query asks for */
+static bool history_matches(History *H, HistoryEntry *E, HistoryQuery *Q,
+  unsigned long Hash)
+{
+  char title[HistoryTitleMax];
+
+  if (E->Timestamp < Q->From || E->Timestamp > Q->To) {
+    return FALSE;
+  }
+  if (Q->Title == NULL) {
+    return TRUE;
+  }
+  if (E->TitleHash != Hash) {
+    return FALSE;
+  }
+  history_title(H, E, title);
+  return strcmp(title, Q->Title) == 0;
+}
+
+
+static void write_point(FILE *Out, long Timestamp, long Freq, long Vswr)
+{
+  char line[OutputLineMax];
+  int len;
+
+  len = format_fixed(line, Timestamp, 0);
+  line[len++] = ' ';
+  len += format_fixed(line + len, Freq, 6);
+  line[len++] = ' ';
+  len += format_fixed(line + len, Vswr, 3);
+  line[len++] = '\n';
+  fwrite(line, 1, len, Out);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_query
+*** Preconditions    : H was opened by history_open. For HISTORY_RESAMPLE,
+***                    Q's grid has NumSteps > 0.
+*** Postconditions   : history_query is the number of sweeps that Q asks for,
+***                    which have been written to Out, a line of timestamp,
+***                    MHz and SWR per point, a blank line after each sweep.
+***                    Resampled sweeps have the points of Q's grid that
+***                    they cover, interpolated. -1 if there's not enough
+***                    memory, or a sweep is corrupt.
+***
+*******************************************************************************/
+
+long history_query(History *H, HistoryQuery *Q, FILE *Out)
+{
+  char title[HistoryTitleMax];
+  HistoryEntry e;
+  unsigned long hash = Q->Title != NULL ? history_hash(Q->Title, strlen(Q->Title)) : 0UL;
+  long *vswr = NULL, size = 0L, found = 0L, i, j, k, freq;
+  double span, u, t;
+
+  for (i = 0L; i < H->Count; i++) {
+    history_entry(H, i, &e);
+    if (!history_matches(H, &e, Q, hash)) {
+      continue;
+    }
+    if (e.NumSteps + 1L > size) {
+      free(vswr);
+      size = e.NumSteps + 1L;
+      if ((vswr = malloc(size * sizeof(long))) == NULL) {
+        return -1L;
+      }
+    }
+    if (!history_decode(H, &e, vswr)) {
+      free(vswr);
+      return -1L;
+    }
+    history_title(H, &e, title);
+    fprintf(Out, "# %s, %ld, %ld-%ld Hz, %ld steps\n", title, e.Timestamp,
+      e.StartFreq, e.StopFreq, e.NumSteps);
+
+    span = (double) (e.StopFreq - e.StartFreq);
+    if (Q->Action == HISTORY_EXTRACT) {
+      for (j = 0L; j <= e.NumSteps; j++) {
+        write_point(Out, e.Timestamp,
+          e.StartFreq + (long) (span * j / e.NumSteps + 0.5), vswr[j]);
+      }
+    } else {
+      for (j = 0L; j <= Q->NumSteps; j++) {
+        freq = Q->StartFreq + (long) ((double) (Q->StopFreq - Q->StartFreq) * j /
+                                      Q->NumSteps + 0.5);
+        if (freq < e.StartFreq || freq > e.StopFreq) {
+          continue;
+        }
+        // Between steps k and k + 1 of the sweep
+        u = span > 0.0 ? (freq - e.StartFreq) * e.NumSteps / span : 0.0;
+        k = (long) u < e.NumSteps ? (long) u : e.NumSteps - 1L;
+        t = u - k;
+        write_point(Out, e.Timestamp, freq,
+          vswr[k] + (long) floor((vswr[k + 1] - vswr[k]) * t + 0.5));
+      }
+    }
+    fputc('\n', Out);
+    found++;
+  }
+  free(vswr);
+  return found;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_grid
+*** Preconditions    : H was opened by history_open.
+*** Postconditions   : history_grid is TRUE if any sweeps match Q, and any of
+***                    Q's grid start and stop frequencies that are 0 are set
+***                    to cover all of them. FALSE if none match.
+***
+*******************************************************************************/
+
+bool history_grid(History *H, HistoryQuery *Q)
+{
+  HistoryEntry e;
+  unsigned long hash = Q->Title != NULL ? history_hash(Q->Title, strlen(Q->Title)) : 0UL;
+  long startFreq = 0L, stopFreq = 0L, i;
+  bool found = FALSE;
+
+  for (i = 0L; i < H->Count; i++) {
+    history_entry(H, i, &e);
+    if (history_matches(H, &e, Q, hash)) {
+      startFreq = !found || e.StartFreq < startFreq ? e.StartFreq : startFreq;
+      stopFreq = !found || e.StopFreq > stopFreq ? e.StopFreq : stopFreq;
+      found = TRUE;
+    }
+  }
+  if (Q->StartFreq == 0L) {
+    Q->StartFreq = startFreq;
+  }
+  if (Q->StopFreq == 0L) {
+    Q->StopFreq = stopFreq;
+  }
+  return found;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : history_parse_time
+*** Preconditions    : None
+*** Postconditions   : history_parse_time is the time Text gives, in seconds
+***                    since the epoch: seconds since the epoch, or a local
+***                    YYYY-MM-DD[THH:MM[:SS]]. A date alone is its start,
+***                    or if End, its end. -1 if Text isn't a time.
+***
+*******************************************************************************/
+
+long history_parse_time(const char *Text, bool End)
+{
+  struct tm tm;
+  char *end;
+  long seconds;
+  int fields;
+
+  seconds = strtol(Text, &end, 10);
+  if (end != Text && *end == '\0') {
+    return seconds;
+  }
+  memset(&tm, 0, sizeof(tm));
+  fields = sscanf(Text, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                  &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+  if (fields < 3 || fields == 4) {
+    return -1L;
+  }
+  if (fields == 3 && End) {
+    tm.tm_hour = 23;
+    tm.tm_min = 59;
+    tm.tm_sec = 59;
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  tm.tm_isdst = -1;
+  return (long) mktime(&tm);
+}
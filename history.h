@@ -0,0 +1,114 @@
+/*******************************************************************************
+***
+*** Filename         : history.h
+*** Purpose          : Definitions for the sweep history store
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "global.h"
+
+/*
+ * A history store is an append-only segment file of sweeps, and an index
+ * of them in <store>.idx, all little endian. The index can always be
+ * rebuilt from the segment.
+ *
+ * Segment header
+ *   0  4  Magic "AAHS"
+ *   4  2  Format version
+ *   6  2  Header size (offset of first sweep)
+ *   8  8  Reserved, zero
+ *
+ * Sweep
+ *   0  4  Size of the sweep, bytes
+ *   4  4  Timestamp, seconds since the epoch
+ *   8  4  Start frequency, Hz
+ *  12  4  Stop frequency, Hz
+ *  16  4  Number of steps
+ *  20  4  First VSWR x 1000
+ *  24  1  Title length, n
+ *  25  n  Title
+ *  25+n   The change in VSWR x 1000 at each following step, zigzag
+ *         encoded varints: mostly a byte each.
+ *
+ * Index header
+ *   0  4  Magic "AAHI"
+ *   4  2  Format version
+ *   6  2  Entry size
+ *   8  8  Reserved, zero
+ *
+ * Index entry
+ *   0  4  Timestamp
+ *   4  4  Start frequency, Hz
+ *   8  4  Stop frequency, Hz
+ *  12  4  Number of steps
+ *  16  4  Hash of the title (FNV-1a)
+ *  20  8  Offset of the sweep in the segment
+ *  28  4  Size of the sweep
+ */
+
+#define HistoryMagic "AAHS"
+#define HistoryIndexMagic "AAHI"
+#define HistoryVersion 1
+#define HistoryHeaderSize 16
+#define HistorySweepHeaderSize 25
+#define HistoryEntrySize 32
+#define HistoryTitleMax 256          /* Including the NUL */
+
+/* One sweep, as listed in the index */
+typedef struct {
+  long Timestamp;
+  long StartFreq;               /* Hz */
+  long StopFreq;
+  long NumSteps;
+  unsigned long TitleHash;
+  long long Offset;
+  long Size;
+} HistoryEntry;
+
+/* A store mapped into memory */
+typedef struct {
+  byte *Segment;
+  size_t SegmentLength;
+  byte *Index;
+  size_t IndexLength;
+  long Count;                   /* Entries in the index */
+} History;
+
+/* What to do with each sweep found by history_query */
+#define HISTORY_EXTRACT 0       /* As it was measured */
+#define HISTORY_RESAMPLE 1      /* Onto a common grid of frequencies */
+
+typedef struct {
+  long From;                    /* Timestamps, inclusive */
+  long To;
+  const char *Title;            /* NULL for all */
+  int Action;
+  long StartFreq;               /* The grid to resample onto, Hz */
+  long StopFreq;
+  long NumSteps;
+} HistoryQuery;
+
+bool history_append(const char *, const char *, long, long, long, long, const long *);
+bool history_open(const char *, History *);
+void history_close(History *);
+void history_entry(History *, long, HistoryEntry *);
+void history_title(History *, HistoryEntry *, char *);
+bool history_decode(History *, HistoryEntry *, long *);
+long history_query(History *, HistoryQuery *, FILE *);
+bool history_grid(History *, HistoryQuery *);
+long history_parse_time(const char *, bool);
+
+#endif /* HISTORY_H */
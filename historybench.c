@@ -0,0 +1,133 @@
+/*******************************************************************************
+***
+*** Filename         : historybench.c
+*** Purpose          : Benchmark of the sweep history store: a year of
+***                    sweeps appended, then queried.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <limits.h>
+
+#include "config.h"
+
+#include "global.h"
+#include "history.h"
+
+/* A sweep every 10 minutes for a year, of two antennas in turn */
+#define Sweeps (365L * 24L * 6L)
+#define Interval 600L
+#define Steps 100L
+#define Start 1704067200L         /* 2024-01-01 */
+
+#define StoreNameMax 64
+
+
+static double now()
+{
+struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+/* A dipole whose resonance wanders with the seasons, and noise */
+static void sweep(long Index, long *Vswr)
+{
+double resonance = 3650000.0 + 20000.0 * sin(Index * 2.0 * M_PI / Sweeps);
+double freq, x, gamma;
+long i;
+  for (i = 0; i <= Steps; i++) {
+    freq = 3400000.0 + 500000.0 * i / Steps;
+    x = 60.0 * 12.0 * (freq / resonance - resonance / freq);
+    gamma = sqrt((100.0 + x * x) / (12100.0 + x * x));
+    Vswr[i] = (long) ((1.0 + gamma) / (1.0 - gamma) * 1000.0) + (i * 7L + Index) % 5L;
+  }
+}
+
+
+static void time_query(History *H, const char *Name, HistoryQuery *Q, FILE *Null)
+{
+double started = now(), elapsed;
+long found;
+  found = history_query(H, Q, Null);
+  elapsed = now() - started;
+  printf("%-28s %6ld sweeps %10.1f ms\n", Name, found, elapsed * 1000.0);
+}
+
+
+int main(int argc, char *argv[])
+{
+char storeName[StoreNameMax], indexName[StoreNameMax + 8];
+long vswr[Steps + 1];
+double started, elapsed;
+struct stat st;
+History h;
+HistoryQuery q;
+FILE *null;
+long i;
+
+  snprintf(storeName, sizeof(storeName), "/tmp/historybench.%d", (int) getpid());
+  snprintf(indexName, sizeof(indexName), "%s.idx", storeName);
+
+  started = now();
+  for (i = 0; i < Sweeps; i++) {
+    sweep(i, vswr);
+    if (!history_append(storeName, i % 2 == 0 ? "80m dipole" : "40m loop",
+                        Start + i * Interval, 3400000L, 3900000L, Steps, vswr)) {
+      printf("Cannot append to %s\n", storeName);
+      return 1;
+    }
+  }
+  elapsed = now() - started;
+  stat(storeName, &st);
+  printf("%-28s %12.0f sweeps/sec\n", "history_append",
+    elapsed > 0.0 ? Sweeps / elapsed : 0.0);
+  printf("%-28s %12.1f bytes/sweep (text: about %ld)\n", "Store size",
+    (double) st.st_size / Sweeps, (Steps + 1L) * 20L);
+
+  started = now();
+  if (!history_open(storeName, &h) || (null = fopen("/dev/null", "w")) == NULL) {
+    printf("Cannot open %s\n", storeName);
+    return 1;
+  }
+  printf("%-28s %6ld sweeps %10.1f ms\n", "history_open", h.Count, (now() - started) * 1000.0);
+
+  memset(&q, 0, sizeof(q));
+  q.Action = HISTORY_EXTRACT;
+  q.From = Start + 180L * 86400L;
+  q.To = q.From + 7L * 86400L - 1L;
+  q.Title = "80m dipole";
+  time_query(&h, "A week of one antenna", &q, null);
+  q.Title = NULL;
+  q.To = LONG_MAX;
+  q.From = LONG_MAX;
+  time_query(&h, "Index scan, no match", &q, null);
+  q.From = 0L;
+  q.Title = "80m dipole";
+  q.Action = HISTORY_RESAMPLE;
+  q.StartFreq = 3600000L;
+  q.StopFreq = 3700000L;
+  q.NumSteps = 10L;
+  time_query(&h, "A year resampled, 11 points", &q, null);
+
+  history_close(&h);
+  fclose(null);
+  unlink(storeName);
+  unlink(indexName);
+  return 0;
+}
@@ -0,0 +1,217 @@
+/*******************************************************************************
+***
+*** Filename         : liveplot.c
+*** Purpose          : Live plotting of points as they arrive, through a
+***                    single persistent gnuplot process.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : gnuplot can't append to an existing plot, so each
+***                    redraw resends the points so far as inline '-' data.
+***                    So that doesn't grow with the capture, the points are
+***                    kept as the lowest and highest of each of at most
+***                    LivePlotBuckets buckets of consecutive points; when
+***                    they're all full, neighbouring buckets are merged and
+***                    the width doubles. Every point is drawn until there
+***                    are twice LivePlotBuckets of them, and after that the
+***                    envelope still shows every peak and dip.
+***                    Redraws are rate limited, and the limit backs off so
+***                    that redrawing never takes more than a small fraction
+***                    of the time spent reading the analyser.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "global.h"
+#include "scanline.h"
+#include "liveplot.h"
+
+#define MinIntervalUs 200000L   /* Redraw at most 5 times a second */
+#define BackOffFactor 20L       /* Spend at most 1/20th of the time redrawing */
+
+
+static long elapsed_us(struct timeval *Since)
+{
+struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - Since->tv_sec) * 1000000L + (now.tv_usec - Since->tv_usec);
+}
+
+
+/* Keep the lowest and highest of the Count points from First, in the order
+   they came, as the two points at First */
+static void keep_extremes(LivePlot *Plot, long First, int Count)
+{
+  long x[4], y[4];
+  int i, low = 0, high = 0;
+
+  for (i = 0; i < Count; i++) {
+    x[i] = Plot->X[First + i];
+    y[i] = Plot->Y[First + i];
+    low = y[i] < y[low] ? i : low;
+    high = y[i] > y[high] ? i : high;
+  }
+  if (low == high) {
+    /* Level: keep where it starts and ends */
+    high = Count - 1;
+  }
+  i = low < high ? low : high;
+  Plot->X[First] = x[i];
+  Plot->Y[First] = y[i];
+  i = low < high ? high : low;
+  Plot->X[First + 1] = x[i];
+  Plot->Y[First + 1] = y[i];
+}
+
+
+static void liveplot_redraw(LivePlot *Plot)
+{
+  char buf[FormattedLineMax];
+  char *p;
+  int len;
+  long i;
+  struct timeval started;
+
+  if (Plot->Gnuplot == NULL || Plot->Count == 0L) {
+    return;
+  }
+  gettimeofday(&started, NULL);
+
+  fprintf(Plot->Gnuplot, "%s\n", Plot->PlotCommand);
+  /* One inline data block per '-' in the plot command */
+  for (p = strstr(Plot->PlotCommand, "'-'"); p != NULL; p = strstr(p + 3, "'-'")) {
+    for (i = 0; i < Plot->Count; i++) {
+      if (i % 2L == 1L && Plot->X[i] == Plot->X[i - 1] && Plot->Y[i] == Plot->Y[i - 1]) {
+        /* A bucket of one point */
+        continue;
+      }
+      len = format_fixed(buf, Plot->X[i], Plot->XDecimals);
+      buf[len++] = ' ';
+      len += format_fixed(buf + len, Plot->Y[i], Plot->YDecimals);
+      buf[len++] = '\n';
+      fwrite(buf, 1, len, Plot->Gnuplot);
+    }
+    fputs("e\n", Plot->Gnuplot);
+  }
+  if (fflush(Plot->Gnuplot) == EOF) {
+    /* gnuplot has gone; carry on without it */
+    pclose(Plot->Gnuplot);
+    Plot->Gnuplot = NULL;
+    return;
+  }
+
+  Plot->Dirty = FALSE;
+  gettimeofday(&Plot->LastDraw, NULL);
+  Plot->IntervalUs = elapsed_us(&started) * BackOffFactor;
+  if (Plot->IntervalUs < MinIntervalUs) {
+    Plot->IntervalUs = MinIntervalUs;
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : liveplot_open
+*** Preconditions    : PlotCommand is a gnuplot plot command taking its data
+***                    from one or more '-' sources. Points will be given in
+***                    fixed point with XDecimals and YDecimals places.
+*** Postconditions   : liveplot_open returns the gnuplot pipe, to which the
+***                    caller should write any settings (term, labels...)
+***                    before adding points.
+***                    liveplot_open is NULL if gnuplot could not be started.
+***
+*******************************************************************************/
+
+FILE *liveplot_open(LivePlot *Plot, char *PlotCommand, int XDecimals, int YDecimals)
+{
+  memset(Plot, 0, sizeof(LivePlot));
+  strncpy(Plot->PlotCommand, PlotCommand, LivePlotCommandMax - 1);
+  Plot->XDecimals = XDecimals;
+  Plot->YDecimals = YDecimals;
+  Plot->IntervalUs = MinIntervalUs;
+  Plot->Width = 1L;
+  gettimeofday(&Plot->LastDraw, NULL);
+
+  /* If gnuplot is closed, we want write errors, not death */
+  signal(SIGPIPE, SIG_IGN);
+  Plot->Gnuplot = popen("gnuplot --persist", "w");
+  return Plot->Gnuplot;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : liveplot_add
+*** Preconditions    : Plot has been opened.
+*** Postconditions   : The point is recorded, and the plot redrawn if enough
+***                    time has passed since the last redraw.
+***
+*******************************************************************************/
+
+void liveplot_add(LivePlot *Plot, long X, long Y)
+{
+  long i;
+
+  if (Plot->Gnuplot == NULL) {
+    return;
+  }
+  if (Plot->Filling == 0L) {
+    /* A new bucket; if there's no room, merge them in pairs first */
+    if (Plot->Count == LivePlotBuckets * 2L) {
+      for (i = 0L; i < LivePlotBuckets / 2L; i++) {
+        memmove(&Plot->X[i * 2L], &Plot->X[i * 4L], 4 * sizeof(long));
+        memmove(&Plot->Y[i * 2L], &Plot->Y[i * 4L], 4 * sizeof(long));
+        keep_extremes(Plot, i * 2L, 4);
+      }
+      Plot->Count = LivePlotBuckets;
+      Plot->Width *= 2L;
+    }
+    Plot->X[Plot->Count] = Plot->X[Plot->Count + 1] = X;
+    Plot->Y[Plot->Count] = Plot->Y[Plot->Count + 1] = Y;
+    Plot->Count += 2L;
+  } else {
+    Plot->X[Plot->Count] = X;
+    Plot->Y[Plot->Count] = Y;
+    keep_extremes(Plot, Plot->Count - 2L, 3);
+  }
+  if (++Plot->Filling == Plot->Width) {
+    Plot->Filling = 0L;
+  }
+  Plot->Dirty = TRUE;
+
+  if (elapsed_us(&Plot->LastDraw) >= Plot->IntervalUs) {
+    liveplot_redraw(Plot);
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : liveplot_close
+*** Preconditions    : Plot has been opened.
+*** Postconditions   : Any points not yet shown are drawn, and gnuplot is
+***                    left displaying the final plot (--persist).
+***
+*******************************************************************************/
+
+void liveplot_close(LivePlot *Plot)
+{
+  if (Plot->Dirty) {
+    liveplot_redraw(Plot);
+  }
+  if (Plot->Gnuplot != NULL) {
+    pclose(Plot->Gnuplot);
+    Plot->Gnuplot = NULL;
+  }
+  Plot->Count = 0L;
+}
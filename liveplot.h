@@ -0,0 +1,45 @@
+/*******************************************************************************
+***
+*** Filename         : liveplot.h
+*** Purpose          : Definitions for live plotting through a gnuplot pipe
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef LIVEPLOT_H
+#define LIVEPLOT_H
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "global.h"
+
+#define LivePlotCommandMax 512
+#define LivePlotBuckets 1000    /* Even; a redraw sends at most twice this */
+
+typedef struct {
+  FILE *Gnuplot;                /* NULL once gnuplot has gone away */
+  char PlotCommand[LivePlotCommandMax];
+  long X[LivePlotBuckets * 2 + 1]; /* The lowest and highest point of */
+  long Y[LivePlotBuckets * 2 + 1]; /* each bucket of points so far, in */
+  long Count;                   /* the order they came, in fixed point */
+  long Width;                   /* Points per bucket */
+  long Filling;                 /* ... so far in the last bucket */
+  int XDecimals;
+  int YDecimals;
+  long IntervalUs;              /* Current minimum time between redraws */
+  struct timeval LastDraw;
+  bool Dirty;                   /* Points added since the last redraw */
+} LivePlot;
+
+FILE *liveplot_open(LivePlot *, char *, int, int);
+void  liveplot_add(LivePlot *, long, long);
+void  liveplot_close(LivePlot *);
+
+#endif /* LIVEPLOT_H */
@@ -0,0 +1,323 @@
+/*******************************************************************************
+***
+*** Filename         : metrics.c
+*** Purpose          : Return loss, reflection coefficient, mismatch loss,
+***                    SWR bandwidth and Q, derived from a sweep.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The sweep is kept as a structure of arrays, and each
+***                    derived column is computed by its own loop over whole
+***                    columns, with no branches or calls, so the compiler
+***                    can vectorise them for whatever the target has (SSE,
+***                    NEON...) without intrinsics. The Makefile builds this
+***                    file with -O3, and -fno-trapping-math so that the
+***                    clamping can be done with selects. libm's log10
+***                    would stop that, so logarithms are computed inline.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "global.h"
+#include "scanline.h"
+#include "metrics.h"
+
+/* Return loss is capped at 120 dB rather than infinite at SWR 1:1 */
+#define MinGamma 1e-6
+
+#define Columns 7
+
+#define Ln2 0.69314718055994530942
+#define Ln10 2.30258509299404568402
+
+
+/* log10 of X > 0, with only arithmetic and bit operations so that it
+   vectorises: X = 2^k z with z in about [0.7, 1.4), and ln z from the
+   series 2 atanh((z - 1) / (z + 1)), good to about 1e-12 there. */
+static inline double log10_inline(double X)
+{
+  const uint64_t offset = 0x3fe6955500000000ULL;
+  const uint64_t magic = 0x4330000000000000ULL;      /* 2^52 */
+  uint64_t ix, tmp, kbits;
+  double z, k, t, t2, lnz;
+
+  memcpy(&ix, &X, sizeof(ix));
+  tmp = ix - offset;
+  /* z is X with its exponent brought to 0 (or -1) ... */
+  ix -= tmp & (0xfffULL << 52);
+  memcpy(&z, &ix, sizeof(z));
+  /* ... and k that exponent, converted through the bits of 2^52 + k + 2048
+     rather than by an int to double conversion */
+  kbits = magic + ((tmp + (1ULL << 63)) >> 52);
+  memcpy(&k, &kbits, sizeof(k));
+  k -= 4503599627372544.0;                          /* 2^52 + 2048 */
+
+  t = (z - 1.0) / (z + 1.0);
+  t2 = t * t;
+  lnz = 2.0 * t * (1.0 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 +
+        t2 * (1.0 / 9 + t2 * (1.0 / 11 + t2 * (1.0 / 13)))))));
+  return (k * Ln2 + lnz) * (1.0 / Ln10);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : metrics_init
+*** Preconditions    : Size > 0, a guess at the number of points.
+*** Postconditions   : metrics_init is TRUE and M is an empty sweep, or
+***                    FALSE if there's not enough memory.
+***
+*******************************************************************************/
+
+bool metrics_init(Metrics *M, long Size)
+{
+  memset(M, 0, sizeof(Metrics));
+  M->Size = Size;
+  M->Freq = malloc(Columns * Size * sizeof(double));
+  if (M->Freq == NULL) {
+    return FALSE;
+  }
+  M->Vswr = M->Freq + Size;
+  M->Fwd = M->Vswr + Size;
+  M->Rev = M->Fwd + Size;
+  M->Gamma = M->Rev + Size;
+  M->ReturnLoss = M->Gamma + Size;
+  M->MismatchLoss = M->ReturnLoss + Size;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : metrics_add
+*** Preconditions    : M has been initialised.
+*** Postconditions   : metrics_add is TRUE and Point is on the end of the
+***                    sweep, or FALSE if there's not enough memory.
+***
+*******************************************************************************/
+
+bool metrics_add(Metrics *M, const ScanPoint *Point)
+{
+  Metrics grown;
+  long i;
+
+  if (M->Count == M->Size) {
+    if (!metrics_init(&grown, M->Size * 2L)) {
+      return FALSE;
+    }
+    for (i = 0; i < Columns; i++) {
+      memcpy(grown.Freq + i * grown.Size, M->Freq + i * M->Size, M->Count * sizeof(double));
+    }
+    grown.Count = M->Count;
+    metrics_free(M);
+    *M = grown;
+  }
+  M->Freq[M->Count] = Point->Freq / 100000000.0;
+  M->Vswr[M->Count] = Point->Vswr / 1000.0;
+  M->Fwd[M->Count] = Point->Fwd / 100.0;
+  M->Rev[M->Count] = Point->Rev / 100.0;
+  M->Count++;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : metrics_compute
+*** Preconditions    : M has been initialised.
+*** Postconditions   : The derived columns are filled in for every point.
+***
+*******************************************************************************/
+
+void metrics_compute(Metrics *M)
+{
+  const double *restrict vswr = M->Vswr;
+  double *restrict gamma = M->Gamma;
+  double *restrict returnLoss = M->ReturnLoss;
+  double *restrict mismatchLoss = M->MismatchLoss;
+  long i, n = M->Count;
+  double s, g;
+
+  /* |Gamma| = (SWR - 1) / (SWR + 1), never below MinGamma */
+  for (i = 0; i < n; i++) {
+    s = vswr[i] > 1.0 ? vswr[i] : 1.0;
+    g = (s - 1.0) / (s + 1.0);
+    gamma[i] = g > MinGamma ? g : MinGamma;
+  }
+  /* Return loss = -20 log10 |Gamma| */
+  for (i = 0; i < n; i++) {
+    returnLoss[i] = -20.0 * log10_inline(gamma[i]);
+  }
+  /* Mismatch loss = -10 log10 (1 - |Gamma|^2) */
+  for (i = 0; i < n; i++) {
+    mismatchLoss[i] = -10.0 * log10_inline(1.0 - gamma[i] * gamma[i]);
+  }
+}
+
+
+/* The frequency at which the SWR passes through Limit between point Inside
+   (within it) and Outside (beyond it) */
+static double crossing(Metrics *M, long Inside, long Outside, double Limit)
+{
+  double v0 = M->Vswr[Inside], v1 = M->Vswr[Outside];
+
+  return M->Freq[Inside] + (Limit - v0) / (v1 - v0) * (M->Freq[Outside] - M->Freq[Inside]);
+}
+
+
+static void bandwidth(Metrics *M, long Resonance, double Limit, MetricsBandwidth *B)
+{
+  long i;
+
+  memset(B, 0, sizeof(MetricsBandwidth));
+  B->Limit = Limit;
+  if (M->Vswr[Resonance] > Limit) {
+    return;
+  }
+  B->Found = TRUE;
+  for (i = Resonance; i > 0L && M->Vswr[i - 1] <= Limit; i--)
+    ;
+  if (i == 0L) {
+    B->Low = M->Freq[0];
+    B->Open = TRUE;
+  } else {
+    B->Low = crossing(M, i, i - 1L, Limit);
+  }
+  for (i = Resonance; i < M->Count - 1L && M->Vswr[i + 1] <= Limit; i++)
+    ;
+  if (i == M->Count - 1L) {
+    B->High = M->Freq[i];
+    B->Open = TRUE;
+  } else {
+    B->High = crossing(M, i, i + 1L, Limit);
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : metrics_summarise
+*** Preconditions    : metrics_compute has been called on M, which is in
+***                    frequency order.
+*** Postconditions   : metrics_summarise is TRUE and Summary describes the
+***                    resonance (the lowest SWR), and the 1.5:1 and 2:1
+***                    bandwidths around it, or FALSE if M is empty.
+***                    Q is estimated from the narrower closed bandwidth as
+***                    Q = f0 / BW x (S - 1) / sqrt(S), as for a resonator
+***                    matched at f0, and is 0 if neither is closed.
+***
+*******************************************************************************/
+
+bool metrics_summarise(Metrics *M, MetricsSummary *Summary)
+{
+  MetricsBandwidth *b = NULL;
+  long i, best = 0L;
+
+  memset(Summary, 0, sizeof(MetricsSummary));
+  if (M->Count == 0L) {
+    return FALSE;
+  }
+  for (i = 1L; i < M->Count; i++) {
+    if (M->Vswr[i] < M->Vswr[best]) {
+      best = i;
+    }
+  }
+  Summary->Freq = M->Freq[best];
+  Summary->Vswr = M->Vswr[best];
+  Summary->ReturnLoss = M->ReturnLoss[best];
+  bandwidth(M, best, 1.5, &Summary->Bandwidth15);
+  bandwidth(M, best, 2.0, &Summary->Bandwidth20);
+
+  if (Summary->Bandwidth15.Found && !Summary->Bandwidth15.Open) {
+    b = &Summary->Bandwidth15;
+  } else if (Summary->Bandwidth20.Found && !Summary->Bandwidth20.Open) {
+    b = &Summary->Bandwidth20;
+  }
+  if (b != NULL && b->High > b->Low) {
+    Summary->Q = Summary->Freq / (b->High - b->Low) * (b->Limit - 1.0) / sqrt(b->Limit);
+  }
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : metrics_write
+*** Preconditions    : metrics_compute has been called on M. Out is open.
+*** Postconditions   : metrics_write is TRUE and every point has been
+***                    written to Out as a line of frequency, SWR, detector
+***                    readings and the derived columns, after a heading
+***                    comment, or FALSE on a write error.
+***
+*******************************************************************************/
+
+bool metrics_write(Metrics *M, FILE *Out)
+{
+  long i;
+
+  fprintf(Out, "# MHz SWR Fwd Rev |Gamma| ReturnLoss(dB) MismatchLoss(dB)\n");
+  for (i = 0L; i < M->Count; i++) {
+    fprintf(Out, "%f %f %.2f %.2f %.6f %.3f %.4f\n", M->Freq[i], M->Vswr[i],
+      M->Fwd[i], M->Rev[i], M->Gamma[i], M->ReturnLoss[i], M->MismatchLoss[i]);
+  }
+  return !ferror(Out);
+}
+
+
+static void print_bandwidth(MetricsBandwidth *B, FILE *Out)
+{
+  fprintf(Out, "%.1f:1 bandwidth: ", B->Limit);
+  if (!B->Found) {
+    fprintf(Out, "none\n");
+  } else {
+    fprintf(Out, "%f - %f MHz, %.1f kHz%s\n", B->Low, B->High,
+      (B->High - B->Low) * 1000.0, B->Open ? " or more (beyond the sweep)" : "");
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : metrics_print
+*** Preconditions    : Summary was filled in by metrics_summarise.
+*** Postconditions   : It has been written to Out.
+***
+*******************************************************************************/
+
+void metrics_print(MetricsSummary *Summary, FILE *Out)
+{
+  fprintf(Out, "Resonance: %f MHz, SWR %.3f, return loss %.1f dB\n",
+    Summary->Freq, Summary->Vswr, Summary->ReturnLoss);
+  print_bandwidth(&Summary->Bandwidth15, Out);
+  print_bandwidth(&Summary->Bandwidth20, Out);
+  if (Summary->Q > 0.0) {
+    fprintf(Out, "Q: %.1f (estimated)\n", Summary->Q);
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : metrics_free
+*** Preconditions    : M was initialised by metrics_init.
+*** Postconditions   : Its memory has been freed.
+***
+*******************************************************************************/
+
+void metrics_free(Metrics *M)
+{
+  free(M->Freq);
+  M->Freq = M->Vswr = M->Fwd = M->Rev = NULL;
+  M->Gamma = M->ReturnLoss = M->MismatchLoss = NULL;
+  M->Count = M->Size = 0L;
+}
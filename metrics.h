@@ -0,0 +1,65 @@
+/*******************************************************************************
+***
+*** Filename         : metrics.h
+*** Purpose          : Definitions for metrics derived from a sweep
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+
+#include "global.h"
+#include "scanline.h"
+
+/* A sweep as a structure of arrays, one element per point, so that each
+   derived column is computed by a simple loop over contiguous doubles. */
+typedef struct {
+  long Count;
+  long Size;                    /* Elements allocated in each column */
+  double *Freq;                 /* MHz */
+  double *Vswr;
+  double *Fwd;                  /* Detector readings */
+  double *Rev;
+  /* Derived by metrics_compute */
+  double *Gamma;                /* Reflection coefficient magnitude */
+  double *ReturnLoss;           /* dB */
+  double *MismatchLoss;         /* dB */
+} Metrics;
+
+/* The bandwidth between the points either side of resonance where the SWR
+   rises through a limit. Open if the sweep ended before it did. */
+typedef struct {
+  double Limit;
+  double Low;                   /* MHz */
+  double High;
+  bool Found;                   /* The SWR at resonance is within Limit */
+  bool Open;
+} MetricsBandwidth;
+
+typedef struct {
+  double Freq;                  /* Resonance: lowest SWR, MHz */
+  double Vswr;
+  double ReturnLoss;
+  MetricsBandwidth Bandwidth15; /* 1.5:1 */
+  MetricsBandwidth Bandwidth20; /* 2:1 */
+  double Q;                     /* Estimated, 0 if there's no bandwidth */
+} MetricsSummary;
+
+bool metrics_init(Metrics *, long);
+bool metrics_add(Metrics *, const ScanPoint *);
+void metrics_compute(Metrics *);
+bool metrics_summarise(Metrics *, MetricsSummary *);
+bool metrics_write(Metrics *, FILE *);
+void metrics_print(MetricsSummary *, FILE *);
+void metrics_free(Metrics *);
+
+#endif /* METRICS_H */
@@ -0,0 +1,107 @@
+/*******************************************************************************
+***
+*** Filename         : metricsbench.c
+*** Purpose          : Microbenchmark of the derived metrics kernel, and a
+***                    check of it against libm.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+
+#include "global.h"
+#include "scanline.h"
+#include "metrics.h"
+
+#define PointCount 1000000
+#define Passes 20
+
+
+static double now()
+{
+struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+/* The derived columns must agree with those computed with libm. */
+static bool check(Metrics *m)
+{
+double s, g, rl, ml;
+long i;
+  for (i = 0; i < m->Count; i++) {
+    s = m->Vswr[i] > 1.0 ? m->Vswr[i] : 1.0;
+    g = (s - 1.0) / (s + 1.0);
+    g = g > 1e-6 ? g : 1e-6;
+    rl = -20.0 * log10(g);
+    ml = -10.0 * log10(1.0 - g * g);
+    if (fabs(m->Gamma[i] - g) > 1e-12 || fabs(m->ReturnLoss[i] - rl) > 1e-9 ||
+        fabs(m->MismatchLoss[i] - ml) > 1e-9 * (ml > 1.0 ? ml : 1.0)) {
+      printf("Mismatch at SWR %f: %g %g %g, libm %g %g %g\n", m->Vswr[i],
+        m->Gamma[i], m->ReturnLoss[i], m->MismatchLoss[i], g, rl, ml);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+Metrics m;
+MetricsSummary summary;
+ScanPoint point;
+double started, elapsed;
+long i;
+int pass;
+
+  if (!metrics_init(&m, 1024L)) {
+    return 1;
+  }
+  /* A resonance at 14.5 MHz, and SWRs from 1:1 to 1001:1 */
+  for (i = 0; i < PointCount; i++) {
+    point.Freq = 1400000000L + i * 100L;
+    point.Vswr = 1000L + labs(i - PointCount / 2) * 2L;
+    point.Fwd = 79000L;
+    point.Rev = i % 80000L;
+    if (!metrics_add(&m, &point)) {
+      return 1;
+    }
+  }
+
+  started = now();
+  for (pass = 0; pass < Passes; pass++) {
+    metrics_compute(&m);
+  }
+  elapsed = now() - started;
+  printf("%-22s %12.0f points/sec\n", "metrics_compute",
+    elapsed > 0.0 ? (double) Passes * PointCount / elapsed : 0.0);
+
+  started = now();
+  for (pass = 0; pass < Passes; pass++) {
+    metrics_summarise(&m, &summary);
+  }
+  elapsed = now() - started;
+  printf("%-22s %12.0f points/sec\n", "metrics_summarise",
+    elapsed > 0.0 ? (double) Passes * PointCount / elapsed : 0.0);
+  metrics_print(&summary, stdout);
+
+  if (!check(&m)) {
+    return 1;
+  }
+  printf("Derived columns match libm\n");
+  metrics_free(&m);
+  return 0;
+}
@@ -0,0 +1,177 @@
+/*******************************************************************************
+***
+*** Filename         : monitor.c
+*** Purpose          : Continuous monitoring of an antenna: a bounded history
+***                    of sweeps, running average/min/max hold curves, and
+***                    alarms on resonance drift.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : Everything is updated incrementally as each sweep is
+***                    added: the oldest sweep's VSWRs come out of the running
+***                    sums as the new one's go in, so each sweep costs
+***                    O(points) however long the history, and the memory
+***                    used never grows after monitor_init.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "monitor.h"
+
+
+/*******************************************************************************
+***
+*** Function         : monitor_init
+*** Preconditions    : Points > 0, History > 0. DriftFreq (Hz x 100) and
+***                    DriftVswr (x 1000) are the alarm thresholds, 0 to
+***                    disable either.
+*** Postconditions   : monitor_init is TRUE and Mon is ready for sweeps, or
+***                    FALSE if there's not enough memory.
+***
+*******************************************************************************/
+
+bool monitor_init(Monitor *Mon, long Points, int History, long DriftFreq,
+  long DriftVswr)
+{
+  memset(Mon, 0, sizeof(Monitor));
+  Mon->Points = Points;
+  Mon->History = History;
+  Mon->DriftFreq = DriftFreq;
+  Mon->DriftVswr = DriftVswr;
+  Mon->Freq = malloc(Points * sizeof(long));
+  Mon->Ring = malloc(History * Points * sizeof(long));
+  Mon->Sum = calloc(Points, sizeof(long));
+  Mon->MinHold = malloc(Points * sizeof(long));
+  Mon->MaxHold = malloc(Points * sizeof(long));
+  if (Mon->Freq == NULL || Mon->Ring == NULL || Mon->Sum == NULL ||
+      Mon->MinHold == NULL || Mon->MaxHold == NULL) {
+    monitor_free(Mon);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : monitor_add
+*** Preconditions    : Freq and Vswr hold a complete sweep of Mon->Points
+***                    points, in fixed point.
+*** Postconditions   : The sweep has replaced the oldest in the history (if
+***                    it's full), and the curves and the resonance updated.
+***                    The first sweep sets the baseline.
+***                    monitor_add is the alarm state: MONITOR_OK if the
+***                    resonance is within the drift thresholds (or
+***                    MONITOR_CLEARED if it's just come back), MONITOR_ALARM
+***                    if not (MONITOR_RAISED if it's just gone out).
+***
+*******************************************************************************/
+
+int monitor_add(Monitor *Mon, const long *Freq, const long *Vswr)
+{
+  long *row = Mon->Ring + (long) Mon->Head * Mon->Points;
+  long i, best = 0L;
+  bool alarm;
+
+  if (Mon->Sweeps == 0L) {
+    memcpy(Mon->Freq, Freq, Mon->Points * sizeof(long));
+    memcpy(Mon->MinHold, Vswr, Mon->Points * sizeof(long));
+    memcpy(Mon->MaxHold, Vswr, Mon->Points * sizeof(long));
+  }
+
+  for (i = 0L; i < Mon->Points; i++) {
+    if (Mon->Held == Mon->History) {
+      Mon->Sum[i] -= row[i];
+    }
+    row[i] = Vswr[i];
+    Mon->Sum[i] += Vswr[i];
+    if (Vswr[i] < Mon->MinHold[i]) {
+      Mon->MinHold[i] = Vswr[i];
+    }
+    if (Vswr[i] > Mon->MaxHold[i]) {
+      Mon->MaxHold[i] = Vswr[i];
+    }
+    if (Vswr[i] < Vswr[best]) {
+      best = i;
+    }
+  }
+  if (Mon->Held < Mon->History) {
+    Mon->Held++;
+  }
+  Mon->Head = (Mon->Head + 1) % Mon->History;
+
+  Mon->ResonanceFreq = Freq[best];
+  Mon->ResonanceVswr = Vswr[best];
+  if (Mon->Sweeps++ == 0L) {
+    Mon->BaselineFreq = Mon->ResonanceFreq;
+    Mon->BaselineVswr = Mon->ResonanceVswr;
+  }
+
+  alarm = (Mon->DriftFreq > 0L &&
+           labs(Mon->ResonanceFreq - Mon->BaselineFreq) > Mon->DriftFreq) ||
+          (Mon->DriftVswr > 0L &&
+           labs(Mon->ResonanceVswr - Mon->BaselineVswr) > Mon->DriftVswr);
+  if (alarm != Mon->Alarmed) {
+    Mon->Alarmed = alarm;
+    return alarm ? MONITOR_RAISED : MONITOR_CLEARED;
+  }
+  return alarm ? MONITOR_ALARM : MONITOR_OK;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : monitor_average
+*** Preconditions    : At least one sweep has been added. 0 <= Index < Points.
+*** Postconditions   : monitor_average is the mean VSWR (x 1000) at point
+***                    Index over the sweeps in the history.
+***
+*******************************************************************************/
+
+long monitor_average(Monitor *Mon, long Index)
+{
+  return (Mon->Sum[Index] + Mon->Held / 2) / Mon->Held;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : monitor_latest
+*** Preconditions    : At least one sweep has been added. 0 <= Index < Points.
+*** Postconditions   : monitor_latest is the VSWR (x 1000) at point Index in
+***                    the latest sweep.
+***
+*******************************************************************************/
+
+long monitor_latest(Monitor *Mon, long Index)
+{
+  int latest = (Mon->Head + Mon->History - 1) % Mon->History;
+  return Mon->Ring[(long) latest * Mon->Points + Index];
+}
+
+
+/*******************************************************************************
+***
+*** Function         : monitor_free
+*** Preconditions    : Mon was initialised by monitor_init.
+*** Postconditions   : Its memory has been freed.
+***
+*******************************************************************************/
+
+void monitor_free(Monitor *Mon)
+{
+  free(Mon->Freq);
+  free(Mon->Ring);
+  free(Mon->Sum);
+  free(Mon->MinHold);
+  free(Mon->MaxHold);
+  Mon->Freq = Mon->Ring = Mon->Sum = Mon->MinHold = Mon->MaxHold = NULL;
+}
@@ -0,0 +1,55 @@
+/*******************************************************************************
+***
+*** Filename         : monitor.h
+*** Purpose          : Definitions for continuous monitoring of an antenna
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include "global.h"
+
+/* Alarm states, as returned by monitor_add */
+#define MONITOR_OK 0
+#define MONITOR_ALARM 1         /* Drifted past a threshold this sweep */
+#define MONITOR_RAISED 2        /* ... and wasn't on the previous sweep */
+#define MONITOR_CLEARED 3       /* Back within the thresholds */
+
+/* The last History sweeps of Points points each, and curves derived from
+   them. All the memory is allocated by monitor_init. */
+typedef struct {
+  long Points;
+  int History;
+  long *Freq;                   /* Hz x 100, from the first sweep */
+  long *Ring;                   /* History x Points VSWRs, x 1000 */
+  int Head;                     /* Row the next sweep goes in */
+  int Held;                     /* Rows in use */
+  long Sweeps;                  /* Sweeps ever added */
+  long *Sum;                    /* Of the rows in use */
+  long *MinHold;                /* Since the first sweep */
+  long *MaxHold;
+  /* Drift alarm */
+  long DriftFreq;               /* Hz x 100, 0 for no alarm */
+  long DriftVswr;               /* x 1000, 0 for no alarm */
+  long BaselineFreq;            /* Resonance of the first sweep */
+  long BaselineVswr;
+  long ResonanceFreq;           /* ... and of the latest */
+  long ResonanceVswr;
+  bool Alarmed;
+} Monitor;
+
+bool monitor_init(Monitor *, long, int, long, long);
+int  monitor_add(Monitor *, const long *, const long *);
+long monitor_average(Monitor *, long);
+long monitor_latest(Monitor *, long);
+void monitor_free(Monitor *);
+
+#endif /* MONITOR_H */
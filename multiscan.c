@@ -0,0 +1,349 @@
+/*******************************************************************************
+***
+*** Filename         : multiscan.c
+*** Purpose          : Scan with several analysers at once, driving them all
+***                    from a single poll() loop.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : Each device goes through the same conversation as a
+***                    single scan: the q handshake, then A/B/N/D/s, then
+***                    scan lines until "End". All the state for a device is
+***                    held in its Device, so nothing here is global.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/time.h>
+#include <termios.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "global.h"
+#include "asy.h"
+#include "scanline.h"
+#include "scanfile.h"
+#include "multiscan.h"
+
+#define DeviceTimeoutMs 2000    /* The same as asy's DataTimeout */
+#define LineMax 256
+
+static int multiBps = B57600;
+
+
+static long elapsed_ms(struct timeval *Since)
+{
+struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - Since->tv_sec) * 1000L + (now.tv_usec - Since->tv_usec) / 1000L;
+}
+
+
+static double elapsed_seconds(struct timeval *Since)
+{
+struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - Since->tv_sec) + (now.tv_usec - Since->tv_usec) / 1000000.0;
+}
+
+
+static void device_fail(Device *Dev, char *Reason)
+{
+  printf("%s: %s\n", Dev->Port, Reason);
+  if (Dev->State == DEVICE_SCANNING) {
+    Dev->ScanSeconds = elapsed_seconds(&Dev->ScanStarted);
+  }
+  Dev->State = DEVICE_FAILED;
+}
+
+
+static bool device_write(Device *Dev, char *Line)
+{
+int len = strlen(Line);
+  if (asy_write(Dev->Fd, (byte *) Line, len) != len) {
+    device_fail(Dev, "Could not write to the analyser");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+static void device_start_scan(Device *Dev)
+{
+char line[LineMax];
+
+  sprintf(line, "%ldA", Dev->StartFreq);
+  if (!device_write(Dev, line)) {
+    return;
+  }
+  sprintf(line, "%ldB", Dev->StopFreq);
+  if (!device_write(Dev, line)) {
+    return;
+  }
+  sprintf(line, "%dN", Dev->NumSteps);
+  if (!device_write(Dev, line)) {
+    return;
+  }
+  sprintf(line, "%dD", Dev->SettleDelay);
+  if (!device_write(Dev, line)) {
+    return;
+  }
+  if (device_write(Dev, "s")) {
+    Dev->State = DEVICE_SCANNING;
+    gettimeofday(&Dev->ScanStarted, NULL);
+  }
+}
+
+
+static void device_handle_line(Device *Dev, char *Line, bool Verbose, int ScanFormat)
+{
+ScanPoint point;
+
+  if (Dev->State == DEVICE_QUERYING) {
+    if (Verbose) {
+      printf("%s: Query from analyser: %s", Dev->Port, Line);
+    }
+    if (++Dev->QueryLines == 2) {
+      device_start_scan(Dev);
+    }
+    return;
+  }
+
+  if (strncmp("End", Line, 3) == 0) {
+    Dev->State = DEVICE_DONE;
+    Dev->ScanSeconds = elapsed_seconds(&Dev->ScanStarted);
+    return;
+  }
+  if (Verbose) {
+    printf("%s: Scan Line: %s", Dev->Port, Line);
+  }
+  if (!parse_scan_line(Line, &point)) {
+    printf("%s: Ignoring malformed scan line: %s", Dev->Port, Line);
+    return;
+  }
+  if (!scanfile_write(Dev->ScanOutput, ScanFormat, &point)) {
+    device_fail(Dev, "Cannot write to the scan file");
+    return;
+  }
+  Dev->Points++;
+}
+
+
+static bool device_open(Device *Dev, bool HardwareFlowControl, int ScanFormat,
+  char *Title)
+{
+  Dev->Fd = -1;
+  Dev->ScanOutput = NULL;
+  Dev->Points = 0L;
+  Dev->QueryLines = 0;
+  Dev->ScanSeconds = -1.0;
+
+  if ((Dev->Fd = asy_open(Dev->Port, multiBps, HardwareFlowControl)) == -1) {
+    device_fail(Dev, "open failed");
+    return FALSE;
+  }
+  Dev->ScanOutput = fopen(Dev->ScanFileName, "w+");
+  if (Dev->ScanOutput == NULL) {
+    printf("%s: Cannot open scan file '%s' for write: %s\n", Dev->Port,
+      Dev->ScanFileName, strerror(errno));
+    Dev->State = DEVICE_FAILED;
+    return FALSE;
+  }
+  if (!scanfile_begin(Dev->ScanOutput, ScanFormat, Dev->StartFreq,
+                      Dev->StopFreq, Dev->NumSteps, Dev->SettleDelay, Title)) {
+    device_fail(Dev, "Cannot write scan file header");
+    return FALSE;
+  }
+
+  Dev->State = DEVICE_QUERYING;
+  gettimeofday(&Dev->LastHeard, NULL);
+  return device_write(Dev, "q");
+}
+
+
+static void device_close(Device *Dev, int ScanFormat)
+{
+  if (Dev->State == DEVICE_SCANNING) {
+    /* Interrupted */
+    Dev->ScanSeconds = elapsed_seconds(&Dev->ScanStarted);
+    (void) asy_write(Dev->Fd, (byte *) "z", 1);
+    asy_flush(Dev->Fd);
+  }
+  if (Dev->ScanOutput != NULL) {
+    if (ScanFormat == SCAN_FORMAT_BIN && Dev->State == DEVICE_DONE) {
+      scanfile_finish(Dev->ScanOutput, Dev->Points);
+    }
+    fclose(Dev->ScanOutput);
+    Dev->ScanOutput = NULL;
+  }
+  if (Dev->Fd != -1) {
+    asy_close(Dev->Fd);
+    Dev->Fd = -1;
+  }
+}
+
+
+static bool device_active(Device *Dev)
+{
+  return Dev->State == DEVICE_QUERYING || Dev->State == DEVICE_SCANNING;
+}
+
+
+/* Read whatever the device has sent, and handle each complete line. */
+static void device_receive(Device *Dev, bool Verbose, int ScanFormat)
+{
+char line[LineMax];
+int len;
+
+  if (asy_receive(Dev->Fd) <= 0) {
+    device_fail(Dev, "Analyser disconnected");
+    return;
+  }
+  gettimeofday(&Dev->LastHeard, NULL);
+  while (device_active(Dev) && (len = asy_nextline(Dev->Fd, line, LineMax)) >= 0) {
+    if (len == 0) {
+      device_fail(Dev, "Buffer overflow detected");
+      return;
+    }
+    device_handle_line(Dev, line, Verbose, ScanFormat);
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : multiscan_split
+*** Preconditions    : Devices holds Count devices with their ports set.
+***                    StartFreq < StopFreq, NumSteps > 0.
+*** Postconditions   : The NumSteps + 1 points of the StartFreq..StopFreq
+***                    scan are shared out between the devices as contiguous,
+***                    non-overlapping sub-ranges in frequency order, each
+***                    with the same step size as the whole scan.
+***                    multiscan_split is the number of devices used, which
+***                    is fewer than Count if there are too few points to
+***                    give every device at least two.
+***
+*******************************************************************************/
+
+int multiscan_split(Device *Devices, int Count, long StartFreq, long StopFreq,
+  int NumSteps)
+{
+long points = NumSteps + 1L;
+long first = 0L, share;
+double stepSize = (double) (StopFreq - StartFreq) / NumSteps;
+int i;
+
+  if (points < 2L * Count) {
+    Count = points / 2L;
+  }
+  for (i = 0; i < Count; i++) {
+    /* Spread the remainder over the first devices */
+    share = points / Count + (i < points % Count ? 1L : 0L);
+    Devices[i].StartFreq = StartFreq + (long) (first * stepSize + 0.5);
+    Devices[i].StopFreq = StartFreq + (long) ((first + share - 1L) * stepSize + 0.5);
+    Devices[i].NumSteps = share - 1L;
+    first += share;
+  }
+  return Count;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : multiscan
+*** Preconditions    : Devices holds Count devices, each with its port, scan
+***                    parameters and scan file name set. Quit is set
+***                    asynchronously (e.g. by a SIGINT handler) to stop.
+*** Postconditions   : Every device has been scanned into its scan file, or
+***                    has failed, and has been closed. Per-device and
+***                    aggregate points/sec have been reported.
+***                    multiscan is TRUE if every scan completed.
+***
+*******************************************************************************/
+
+bool multiscan(Device *Devices, int Count, bool Verbose, bool HardwareFlowControl,
+  int ScanFormat, char *Title, int *Quit)
+{
+struct pollfd fds[MaxDevices];
+int which[MaxDevices];
+struct timeval started;
+int i, n, active, timeout;
+long waited, totalPoints = 0L;
+double seconds;
+bool ok = TRUE;
+
+  gettimeofday(&started, NULL);
+  for (i = 0; i < Count; i++) {
+    if (Verbose) {
+      printf("%s: start freq: %ld Hz, end freq: %ld Hz, steps: %d, settle: %d ms, output: %s\n",
+        Devices[i].Port, Devices[i].StartFreq, Devices[i].StopFreq,
+        Devices[i].NumSteps, Devices[i].SettleDelay, Devices[i].ScanFileName);
+    }
+    (void) device_open(&Devices[i], HardwareFlowControl, ScanFormat, Title);
+  }
+
+  for (;;) {
+    /* Gather the devices still talking, and the nearest timeout */
+    n = 0;
+    timeout = DeviceTimeoutMs;
+    for (i = 0; i < Count; i++) {
+      if (!device_active(&Devices[i])) {
+        continue;
+      }
+      waited = elapsed_ms(&Devices[i].LastHeard);
+      if (waited >= DeviceTimeoutMs) {
+        device_fail(&Devices[i], "Timeout!");
+        continue;
+      }
+      if (DeviceTimeoutMs - waited < timeout) {
+        timeout = DeviceTimeoutMs - waited;
+      }
+      fds[n].fd = Devices[i].Fd;
+      fds[n].events = POLLIN;
+      fds[n].revents = 0;
+      which[n++] = i;
+    }
+    if (n == 0 || *Quit) {
+      break;
+    }
+
+    active = poll(fds, n, timeout);
+    if (active == -1 && errno != EINTR) {
+      printf("poll failed: %s\n", strerror(errno));
+      break;
+    }
+    for (i = 0; i < n && active > 0; i++) {
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        device_receive(&Devices[which[i]], Verbose, ScanFormat);
+      }
+    }
+  }
+
+  if (*Quit) {
+    puts("Terminating scans...\n");
+  }
+
+  seconds = elapsed_ms(&started) / 1000.0;
+  for (i = 0; i < Count; i++) {
+    device_close(&Devices[i], ScanFormat);
+    if (Devices[i].ScanSeconds < 0.0) {
+      printf("%s: no scan\n", Devices[i].Port);
+    } else {
+      printf("%s: %ld points in %.3f s, %.1f points/sec%s\n", Devices[i].Port,
+        Devices[i].Points, Devices[i].ScanSeconds,
+        Devices[i].ScanSeconds > 0.0 ? Devices[i].Points / Devices[i].ScanSeconds : 0.0,
+        Devices[i].State == DEVICE_DONE ? "" : " (incomplete)");
+    }
+    totalPoints += Devices[i].Points;
+    ok = ok && Devices[i].State == DEVICE_DONE;
+  }
+  printf("Total: %ld points from %d analysers in %.3f s, %.1f points/sec\n",
+    totalPoints, Count, seconds, seconds > 0.0 ? totalPoints / seconds : 0.0);
+  return ok;
+}
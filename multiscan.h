@@ -0,0 +1,56 @@
+/*******************************************************************************
+***
+*** Filename         : multiscan.h
+*** Purpose          : Definitions for scanning with several analysers at once
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef MULTISCAN_H
+#define MULTISCAN_H
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "global.h"
+
+#define MaxDevices 8
+#define DevicePortMax 64
+#define DeviceFileNameMax 128
+
+/* Device states */
+#define DEVICE_IDLE 0
+#define DEVICE_QUERYING 1
+#define DEVICE_SCANNING 2
+#define DEVICE_DONE 3
+#define DEVICE_FAILED 4
+
+/* One analyser, its scan parameters and output */
+typedef struct {
+  char Port[DevicePortMax];
+  long StartFreq;
+  long StopFreq;
+  int NumSteps;
+  int SettleDelay;
+  char ScanFileName[DeviceFileNameMax];
+  /* Run time state */
+  int Fd;
+  FILE *ScanOutput;
+  int State;
+  int QueryLines;
+  long Points;
+  struct timeval LastHeard;
+  struct timeval ScanStarted;   /* When s was sent */
+  double ScanSeconds;           /* From s to End (or giving up); -1 if not sent */
+} Device;
+
+int  multiscan_split(Device *, int, long, long, int);
+bool multiscan(Device *, int, bool, bool, int, char *, int *);
+
+#endif /* MULTISCAN_H */
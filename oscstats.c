@@ -0,0 +1,286 @@
+/*******************************************************************************
+***
+*** Filename         : oscstats.c
+*** Purpose          : Mean, variance, mode, min, max and histogram of
+***                    detector readings, computed as they arrive.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : This replaces mode.pl. Nothing is kept per reading:
+***                    the mean and variance are Welford's online algorithm,
+***                    the histogram has a fixed bin per ADC value, and the
+***                    mode is updated as each bin's count goes up, so the
+***                    memory used is the same for any length of capture.
+***                    Capture files are read through mmap, so they may be
+***                    larger than memory. A rotating capture's segments are
+***                    read in turn from its manifest.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "global.h"
+#include "oscstats.h"
+
+
+/*******************************************************************************
+***
+*** Function         : oscstats_init
+*** Preconditions    : None
+*** Postconditions   : Stats holds no readings.
+***
+*******************************************************************************/
+
+void oscstats_init(OscStats *Stats)
+{
+  memset(Stats, 0, sizeof(OscStats));
+}
+
+
+/*******************************************************************************
+***
+*** Function         : oscstats_add
+*** Preconditions    : Stats has been initialised.
+*** Postconditions   : Value has been included in the statistics.
+***
+*******************************************************************************/
+
+void oscstats_add(OscStats *Stats, long Value)
+{
+  double delta;
+  long n;
+
+  if (Stats->Count == 0L || Value < Stats->Min) {
+    Stats->Min = Value;
+  }
+  if (Stats->Count == 0L || Value > Stats->Max) {
+    Stats->Max = Value;
+  }
+  Stats->Count++;
+  delta = Value - Stats->Mean;
+  Stats->Mean += delta / Stats->Count;
+  Stats->M2 += delta * (Value - Stats->Mean);
+
+  if (Value < 0L || Value >= OscStatsBins) {
+    Stats->OutOfRange++;
+    return;
+  }
+  n = ++Stats->Histogram[Value];
+  if (n > Stats->ModeCount) {
+    Stats->ModeCount = n;
+    Stats->Mode = Value;
+  }
+}
+
+
+/* Parse the unsigned decimal at *P, stopping at End. FALSE if there
+   isn't one, or it's too large for a long. */
+static bool scan_number(const char **P, const char *End, long *Value)
+{
+  const char *p = *P;
+  long value = 0L;
+
+  if (p == End || *p < '0' || *p > '9') {
+    return FALSE;
+  }
+  while (p < End && *p >= '0' && *p <= '9') {
+    if (value > (LONG_MAX - (*p - '0')) / 10L) {
+      return FALSE;
+    }
+    value = value * 10L + (*p++ - '0');
+  }
+  *P = p;
+  *Value = value;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : oscstats_file
+*** Preconditions    : Stats has been initialised.
+*** Postconditions   : oscstats_file is TRUE, and every "sample value" line
+***                    of the capture file FileName has been added to Stats
+***                    (other lines are counted in Rejected, and blank ones
+***                    ignored), or FALSE if the file can't be read.
+***
+*******************************************************************************/
+
+bool oscstats_file(OscStats *Stats, char *FileName)
+{
+  struct stat st;
+  const char *map, *p, *end, *eol, *line;
+  long sample, value;
+  int fd;
+
+  if ((fd = open(FileName, O_RDONLY)) == -1) {
+    return FALSE;
+  }
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return FALSE;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return TRUE;
+  }
+  map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return FALSE;
+  }
+#ifdef MADV_SEQUENTIAL
+  (void) madvise((void *) map, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  end = map + st.st_size;
+  for (p = map; p < end; p = eol + 1) {
+    if ((eol = memchr(p, '\n', end - p)) == NULL) {
+      eol = end;
+    }
+    line = p;
+    if (scan_number(&p, eol, &sample) && p < eol && *p++ == ' ' &&
+        scan_number(&p, eol, &value) &&
+        (p == eol || (*p == '\r' && p + 1 == eol))) {
+      oscstats_add(Stats, value);
+    } else if (eol > line && !(*line == '\r' && line + 1 == eol)) {
+      Stats->Rejected++;
+    }
+  }
+
+  munmap((void *) map, (size_t) st.st_size);
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : oscstats_manifest
+*** Preconditions    : Stats has been initialised; Failed has room for
+***                    OscStatsNameMax.
+*** Postconditions   : oscstats_manifest is TRUE, and the readings of every
+***                    segment listed in the rotating capture's manifest
+***                    ManifestName have been added to Stats, as by
+***                    oscstats_file. FALSE if the manifest or a segment
+***                    can't be read; Failed is its name.
+***                    A segment not found where the manifest says is looked
+***                    for beside the manifest, so a capture can be moved.
+***
+*******************************************************************************/
+
+bool oscstats_manifest(OscStats *Stats, char *ManifestName, char *Failed)
+{
+  char line[OscStatsNameMax * 2], name[OscStatsNameMax];
+  const char *slash = strrchr(ManifestName, '/'), *base;
+  FILE *in;
+  bool ok = TRUE;
+
+  strncpy(Failed, ManifestName, OscStatsNameMax - 1);
+  Failed[OscStatsNameMax - 1] = '\0';
+  if ((in = fopen(ManifestName, "r")) == NULL) {
+    return FALSE;
+  }
+  while (ok && fgets(line, sizeof(line), in) != NULL) {
+    if (sscanf(line, "%511s", name) != 1) {
+      continue;
+    }
+    strcpy(Failed, name);
+    if (oscstats_file(Stats, name)) {
+      continue;
+    }
+    ok = FALSE;
+    if (errno == ENOENT && slash != NULL) {
+      base = strrchr(name, '/') != NULL ? strrchr(name, '/') + 1 : name;
+      if (snprintf(Failed, OscStatsNameMax, "%.*s%s", (int) (slash + 1 - ManifestName),
+                   ManifestName, base) < OscStatsNameMax) {
+        ok = oscstats_file(Stats, Failed);
+      }
+    }
+  }
+  if (ok && ferror(in)) {
+    strcpy(Failed, ManifestName);
+    ok = FALSE;
+  }
+  fclose(in);
+  return ok;
+}
+
+
+/* Histogram bins, least frequent first, as mode.pl listed them */
+static OscStats *SortStats;
+
+static int compare_occurrences(const void *A, const void *B)
+{
+  long a = SortStats->Histogram[*(const int *) A];
+  long b = SortStats->Histogram[*(const int *) B];
+  if (a != b) {
+    return a < b ? -1 : 1;
+  }
+  return *(const int *) A - *(const int *) B;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : oscstats_report
+*** Preconditions    : Stats has been initialised.
+*** Postconditions   : The statistics have been written to Out, followed by
+***                    the histogram, least frequent readings first, if
+***                    Histogram is TRUE.
+***
+*******************************************************************************/
+
+void oscstats_report(OscStats *Stats, FILE *Out, bool Histogram)
+{
+  int bins[OscStatsBins];
+  int i, n = 0;
+
+  if (Stats->Rejected > 0L) {
+    fprintf(Out, "Lines that weren't readings: %ld\n", Stats->Rejected);
+  }
+  if (Stats->Count == 0L) {
+    fprintf(Out, "No readings\n");
+    return;
+  }
+  fprintf(Out, "Readings: %ld\n", Stats->Count);
+  fprintf(Out, "Mean: %f\n", Stats->Mean);
+  fprintf(Out, "Standard deviation: %f\n",
+    Stats->Count > 1L ? sqrt(Stats->M2 / (Stats->Count - 1L)) : 0.0);
+  if (Stats->ModeCount > 0L) {
+    fprintf(Out, "Mode: %ld (%ld occurrences)\n", Stats->Mode, Stats->ModeCount);
+  }
+  fprintf(Out, "Min: %ld Max %ld\n", Stats->Min, Stats->Max);
+  fprintf(Out, "Between min and max: %g\n", Stats->Min + (Stats->Max - Stats->Min) / 2.0);
+  if (Stats->OutOfRange > 0L) {
+    fprintf(Out, "Outside 0-%d: %ld\n", OscStatsBins - 1, Stats->OutOfRange);
+  }
+
+  if (!Histogram) {
+    return;
+  }
+  for (i = 0; i < OscStatsBins; i++) {
+    if (Stats->Histogram[i] != 0L) {
+      bins[n++] = i;
+    }
+  }
+  SortStats = Stats;
+  qsort(bins, n, sizeof(int), compare_occurrences);
+  for (i = 0; i < n; i++) {
+    fprintf(Out, "%d has %ld occurrences\n", bins[i], Stats->Histogram[bins[i]]);
+  }
+}
@@ -0,0 +1,46 @@
+/*******************************************************************************
+***
+*** Filename         : oscstats.h
+*** Purpose          : Definitions for oscilloscope capture statistics
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef OSCSTATS_H
+#define OSCSTATS_H
+
+#include <stdio.h>
+
+#include "global.h"
+
+/* One histogram bin per reading of the Arduino's 10 bit ADC */
+#define OscStatsBins 1024
+
+#define OscStatsNameMax 512
+
+typedef struct {
+  long Count;
+  double Mean;                  /* Welford's running mean ... */
+  double M2;                    /* ... and sum of squared differences */
+  long Min;
+  long Max;
+  long Histogram[OscStatsBins];
+  long OutOfRange;              /* Readings that fell outside the bins */
+  long Mode;                    /* Most frequent reading so far */
+  long ModeCount;
+  long Rejected;                /* Capture file lines that weren't readings */
+} OscStats;
+
+void oscstats_init(OscStats *);
+void oscstats_add(OscStats *, long);
+bool oscstats_file(OscStats *, char *);
+bool oscstats_manifest(OscStats *, char *, char *);
+void oscstats_report(OscStats *, FILE *, bool);
+
+#endif /* OSCSTATS_H */
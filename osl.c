@@ -0,0 +1,524 @@
+/*******************************************************************************
+***
+*** Filename         : osl.c
+*** Purpose          : Open/short/load calibration: correcting the SWR for
+***                    the errors of the bridge and cable.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The analyser only measures the size of the reflection
+***                    coefficient (reverse over forward detector), so this
+***                    is scalar correction, as scalar network analysers do
+***                    it. With a load connected, the bridge's directivity
+***                    error is what it reads; open and short should both
+***                    read 1, and their average (which cancels most of the
+***                    cable's ripple between them) is its tracking. A
+***                    reading is mapped linearly from the load's reading to
+***                    the load's true reflection coefficient, and from the
+***                    open/short reading to 1.
+***                    Calibrations are kept in ~/.analyser_osl, a file per
+***                    frequency plan (start-stop-steps in Hz), holding a
+***                    line per step: its frequency and the three readings.
+***                    A scan uses the calibration of its own plan, or the
+***                    finest one that covers its range, interpolated onto
+***                    its steps before the scan starts; correcting each
+***                    point is then a lookup by step number.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <math.h>
+
+#include "global.h"
+#include "scanline.h"
+#include "osl.h"
+
+#define LineMax 256
+#define FileNameMax 256
+
+/* The largest reflection coefficient a corrected point may have, and the
+   SWR reported for it, as the firmware does when Rev >= Fwd */
+#define GammaMax 0.999
+#define VswrMax 999000L
+
+/* Tracking and directivity readings closer than this can't be told apart;
+   such a step is left uncorrected */
+#define MinSpan 0.01
+
+/* How far from a step of its plan (as a fraction of a step) a point's
+   frequency may be, to be taken as that step */
+#define StepTolerance 0.25
+
+static const char *standardNames[OslStandards] = { "open", "short", "load" };
+
+
+/*******************************************************************************
+***
+*** Function         : osl_standard
+*** Preconditions    : None
+*** Postconditions   : osl_standard is the OSL_ standard called Name, or -1
+***                    if there's none.
+***
+*******************************************************************************/
+
+int osl_standard(const char *Name)
+{
+  int i;
+
+  for (i = 0; i < OslStandards; i++) {
+    if (strcmp(Name, standardNames[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_standard_name
+*** Preconditions    : Standard is an OSL_ standard.
+*** Postconditions   : osl_standard_name is its name.
+***
+*******************************************************************************/
+
+const char *osl_standard_name(int Standard)
+{
+  return standardNames[Standard];
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_init
+*** Preconditions    : NumSteps > 0
+*** Postconditions   : osl_init is TRUE and T is the calibration of the plan,
+***                    with no standards measured yet, or FALSE if there's
+***                    not enough memory.
+***
+*******************************************************************************/
+
+bool osl_init(OslTable *T, long StartFreq, long StopFreq, int NumSteps)
+{
+  int i;
+
+  memset(T, 0, sizeof(OslTable));
+  T->StartFreq = StartFreq;
+  T->StopFreq = StopFreq;
+  T->NumSteps = NumSteps;
+  T->LoadOhms = OslLoadOhms;
+  for (i = 0; i < OslStandards; i++) {
+    if ((T->Gamma[i] = calloc(NumSteps + 1L, sizeof(float))) == NULL) {
+      osl_free(T);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_free
+*** Preconditions    : T was initialised by osl_init or osl_load.
+*** Postconditions   : T's memory is freed.
+***
+*******************************************************************************/
+
+void osl_free(OslTable *T)
+{
+  int i;
+
+  for (i = 0; i < OslStandards; i++) {
+    free(T->Gamma[i]);
+    T->Gamma[i] = NULL;
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_complete
+*** Preconditions    : T was initialised by osl_init or osl_load.
+*** Postconditions   : osl_complete is TRUE if all the standards have been
+***                    measured.
+***
+*******************************************************************************/
+
+bool osl_complete(OslTable *T)
+{
+  return T->Measured[OSL_OPEN] && T->Measured[OSL_SHORT] && T->Measured[OSL_LOAD];
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_record
+*** Preconditions    : Point is step Step of a sweep of T's plan, with
+***                    Standard connected.
+*** Postconditions   : Its reflection coefficient is recorded in T.
+***
+*******************************************************************************/
+
+void osl_record(OslTable *T, int Standard, long Step, const ScanPoint *Point)
+{
+  if (Step < 0L || Step > T->NumSteps) {
+    return;
+  }
+  T->Gamma[Standard][Step] = Point->Fwd > 0L ? (float) Point->Rev / Point->Fwd : 1.0f;
+  T->Measured[Standard] = TRUE;
+}
+
+
+static void osl_dir_name(char *Out, int Max)
+{
+  char *home = getenv("HOME");
+
+  snprintf(Out, Max, "%s/.analyser_osl", home != NULL ? home : ".");
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_file_name
+*** Preconditions    : Out has room for Max characters.
+*** Postconditions   : Out is the name of the file holding the calibration
+***                    of the plan.
+***
+*******************************************************************************/
+
+void osl_file_name(char *Out, int Max, long StartFreq, long StopFreq, int NumSteps)
+{
+  char dir[FileNameMax];
+
+  osl_dir_name(dir, sizeof(dir));
+  snprintf(Out, Max, "%s/%ld-%ld-%d", dir, StartFreq, StopFreq, NumSteps);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_save
+*** Preconditions    : T was initialised by osl_init or osl_load.
+*** Postconditions   : osl_save is TRUE and T is saved in FileName, which is
+***                    replaced in one go, or FALSE if it can't be written.
+***
+*******************************************************************************/
+
+bool osl_save(const char *FileName, OslTable *T)
+{
+  char dir[FileNameMax], tempName[FileNameMax + 8];
+  FILE *out;
+  long i;
+  int s;
+  bool ok;
+
+  osl_dir_name(dir, sizeof(dir));
+  (void) mkdir(dir, 0755);
+  snprintf(tempName, sizeof(tempName), "%s.tmp", FileName);
+  if ((out = fopen(tempName, "w")) == NULL) {
+    return FALSE;
+  }
+  fprintf(out, "osl %ld %ld %d %g", T->StartFreq, T->StopFreq, T->NumSteps, T->LoadOhms);
+  for (s = 0; s < OslStandards; s++) {
+    if (T->Measured[s]) {
+      fprintf(out, " %s", standardNames[s]);
+    }
+  }
+  fputc('\n', out);
+  for (i = 0L; i <= T->NumSteps; i++) {
+    fprintf(out, "%ld", T->StartFreq + (long) ((double) (T->StopFreq - T->StartFreq) *
+      i / T->NumSteps + 0.5));
+    for (s = 0; s < OslStandards; s++) {
+      if (T->Measured[s]) {
+        fprintf(out, " %.6f", T->Gamma[s][i]);
+      } else {
+        fputs(" -", out);
+      }
+    }
+    fputc('\n', out);
+  }
+  ok = !ferror(out);
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(tempName, FileName) != 0) {
+    unlink(tempName);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/* Read a calibration file's first line into T, which is initialised for
+   its plan */
+static bool osl_load_header(FILE *In, OslTable *T)
+{
+  char line[LineMax], *word;
+  long startFreq, stopFreq;
+  int numSteps, offset, s;
+  double loadOhms;
+
+  if (fgets(line, sizeof(line), In) == NULL ||
+      sscanf(line, "osl %ld %ld %d %lf%n", &startFreq, &stopFreq, &numSteps, &loadOhms,
+             &offset) != 4 ||
+      numSteps < 1 || !osl_init(T, startFreq, stopFreq, numSteps)) {
+    return FALSE;
+  }
+  T->LoadOhms = loadOhms;
+  for (word = strtok(line + offset, " \r\n"); word != NULL; word = strtok(NULL, " \r\n")) {
+    if ((s = osl_standard(word)) != -1) {
+      T->Measured[s] = TRUE;
+    }
+  }
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_load
+*** Preconditions    : None
+*** Postconditions   : osl_load is TRUE and T is the calibration saved in
+***                    FileName, or FALSE if it can't be read.
+***
+*******************************************************************************/
+
+bool osl_load(const char *FileName, OslTable *T)
+{
+  char line[LineMax], *p, *end;
+  FILE *in;
+  long i;
+  int s;
+  bool ok;
+
+  if ((in = fopen(FileName, "r")) == NULL) {
+    return FALSE;
+  }
+  if (!osl_load_header(in, T)) {
+    fclose(in);
+    return FALSE;
+  }
+  for (i = 0L, ok = TRUE; i <= T->NumSteps && ok; i++) {
+    if (!(ok = fgets(line, sizeof(line), in) != NULL)) {
+      break;
+    }
+    strtol(line, &p, 10);
+    for (s = 0; s < OslStandards && ok; s++) {
+      T->Gamma[s][i] = strtof(p, &end);
+      if (end == p) {
+        // Not measured: "-"
+        ok = !T->Measured[s] && (p = strchr(p, '-')) != NULL;
+        end = p + 1;
+      }
+      p = end;
+    }
+  }
+  fclose(in);
+  if (!ok) {
+    osl_free(T);
+  }
+  return ok;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_find
+*** Preconditions    : NumSteps > 0
+*** Postconditions   : osl_find is TRUE and T is a complete calibration for
+***                    the plan: its own if there is one, otherwise that of
+***                    the finest plan covering its range. FALSE if there's
+***                    none.
+***
+*******************************************************************************/
+
+bool osl_find(long StartFreq, long StopFreq, int NumSteps, OslTable *T)
+{
+  char fileName[FileNameMax], best[FileNameMax] = "";
+  double step, bestStep = 0.0;
+  glob_t files;
+  OslTable header;
+  FILE *in;
+  size_t i;
+
+  osl_file_name(fileName, sizeof(fileName), StartFreq, StopFreq, NumSteps);
+  if (osl_load(fileName, T)) {
+    if (osl_complete(T)) {
+      return TRUE;
+    }
+    osl_free(T);
+  }
+
+  osl_dir_name(fileName, sizeof(fileName));
+  strncat(fileName, "/*-*-*", sizeof(fileName) - strlen(fileName) - 1);
+  if (glob(fileName, 0, NULL, &files) != 0) {
+    return FALSE;
+  }
+  for (i = 0; i < files.gl_pathc; i++) {
+    if ((in = fopen(files.gl_pathv[i], "r")) == NULL) {
+      continue;
+    }
+    if (osl_load_header(in, &header)) {
+      step = (double) (header.StopFreq - header.StartFreq) / header.NumSteps;
+      if (osl_complete(&header) &&
+          header.StartFreq <= StartFreq && header.StopFreq >= StopFreq &&
+          (best[0] == '\0' || step < bestStep)) {
+        strncpy(best, files.gl_pathv[i], sizeof(best) - 1);
+        bestStep = step;
+      }
+      osl_free(&header);
+    }
+    fclose(in);
+  }
+  globfree(&files);
+  return best[0] != '\0' && osl_load(best, T);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_prepare
+*** Preconditions    : T is a complete calibration, NumSteps > 0.
+*** Postconditions   : osl_prepare is TRUE and C corrects the steps of the
+***                    plan, using T interpolated onto them, or FALSE if
+***                    there's not enough memory.
+***
+*******************************************************************************/
+
+bool osl_prepare(OslTable *T, long StartFreq, long StopFreq, int NumSteps,
+  OslCorrection *C)
+{
+  double freq, u, t, g[OslStandards], tracking;
+  long i, j;
+  int s;
+
+  C->StartFreq = StartFreq;
+  C->StopFreq = StopFreq;
+  C->NumSteps = NumSteps;
+  C->Count = NumSteps + 1L;
+  C->LoadGamma = T->LoadOhms > 50.0 ? (T->LoadOhms - 50.0) / (T->LoadOhms + 50.0) :
+                                      (50.0 - T->LoadOhms) / (T->LoadOhms + 50.0);
+  C->Offset = malloc(C->Count * sizeof(double));
+  C->Scale = malloc(C->Count * sizeof(double));
+  if (C->Offset == NULL || C->Scale == NULL) {
+    osl_free_correction(C);
+    return FALSE;
+  }
+
+  for (i = 0L; i < C->Count; i++) {
+    // Where the step falls between the calibration's steps
+    freq = StartFreq + (double) (StopFreq - StartFreq) * i / NumSteps;
+    u = T->StopFreq == T->StartFreq ? 0.0 :
+        (freq - T->StartFreq) * T->NumSteps / (T->StopFreq - T->StartFreq);
+    j = (long) u;
+    j = j < 0L ? 0L : j > T->NumSteps - 1L ? T->NumSteps - 1L : j;
+    t = u - j;
+    t = t < 0.0 ? 0.0 : t > 1.0 ? 1.0 : t;
+    for (s = 0; s < OslStandards; s++) {
+      g[s] = T->Gamma[s][j] + (T->Gamma[s][j + 1] - T->Gamma[s][j]) * t;
+    }
+
+    tracking = (g[OSL_OPEN] + g[OSL_SHORT]) / 2.0;
+    if (tracking - g[OSL_LOAD] < MinSpan) {
+      C->Offset[i] = C->LoadGamma;
+      C->Scale[i] = 1.0;
+    } else {
+      C->Offset[i] = g[OSL_LOAD];
+      C->Scale[i] = (1.0 - C->LoadGamma) / (tracking - g[OSL_LOAD]);
+    }
+  }
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_step
+*** Preconditions    : None
+*** Postconditions   : osl_step is the step of the plan StartFreq to StopFreq
+***                    (Hz) in NumSteps that Freq (Hz x 100) was measured
+***                    at, or -1 if it isn't (near enough) one of them.
+***
+*******************************************************************************/
+
+long osl_step(long StartFreq, long StopFreq, int NumSteps, long Freq)
+{
+  double u;
+  long step;
+
+  if (StopFreq <= StartFreq || NumSteps < 1) {
+    return -1L;
+  }
+  u = (Freq / 100.0 - StartFreq) * NumSteps / (StopFreq - StartFreq);
+  step = (long) floor(u + 0.5);
+  if (step < 0L || step > NumSteps || fabs(u - step) > StepTolerance) {
+    return -1L;
+  }
+  return step;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_correct
+*** Preconditions    : C was prepared by osl_prepare for the plan of the
+***                    scan that Point is from.
+*** Postconditions   : osl_correct is TRUE and Point's VSWR is corrected for
+***                    the step its frequency is at; its detector readings
+***                    are left as they were read. FALSE, and Point is
+***                    unchanged, if it isn't at a step of the plan.
+***
+*******************************************************************************/
+
+bool osl_correct(OslCorrection *C, ScanPoint *Point)
+{
+  long step = osl_step(C->StartFreq, C->StopFreq, C->NumSteps, Point->Freq);
+  double gamma;
+
+  if (step < 0L) {
+    return FALSE;
+  }
+  if (Point->Fwd <= 0L) {
+    return TRUE;
+  }
+  gamma = C->LoadGamma + ((double) Point->Rev / Point->Fwd - C->Offset[step]) * C->Scale[step];
+  if (gamma < 0.0) {
+    gamma = 0.0;
+  }
+  if (gamma > GammaMax) {
+    Point->Vswr = VswrMax;
+    return TRUE;
+  }
+  Point->Vswr = (long) ((1.0 + gamma) / (1.0 - gamma) * 1000.0 + 0.5);
+  if (Point->Vswr > VswrMax) {
+    Point->Vswr = VswrMax;
+  }
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : osl_free_correction
+*** Preconditions    : C was prepared by osl_prepare.
+*** Postconditions   : C's memory is freed.
+***
+*******************************************************************************/
+
+void osl_free_correction(OslCorrection *C)
+{
+  free(C->Offset);
+  free(C->Scale);
+  C->Offset = C->Scale = NULL;
+  C->Count = 0L;
+}
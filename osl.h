@@ -0,0 +1,68 @@
+/*******************************************************************************
+***
+*** Filename         : osl.h
+*** Purpose          : Definitions for open/short/load calibration
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef OSL_H
+#define OSL_H
+
+#include "global.h"
+#include "scanline.h"
+
+/* Calibration standards */
+#define OSL_OPEN 0
+#define OSL_SHORT 1
+#define OSL_LOAD 2
+#define OslStandards 3
+
+/* The load's resistance, unless another is given */
+#define OslLoadOhms 50.0
+
+/* The calibration sweeps of one frequency plan: the reflection coefficient
+   read with each standard connected, at each step. */
+typedef struct {
+  long StartFreq;               /* Hz */
+  long StopFreq;
+  int NumSteps;
+  double LoadOhms;
+  bool Measured[OslStandards];
+  float *Gamma[OslStandards];   /* NumSteps + 1 each */
+} OslTable;
+
+/* A calibration interpolated onto the steps of a scan, so that correcting
+   a point is a lookup and a multiply. */
+typedef struct {
+  long StartFreq;               /* The scan's plan, Hz */
+  long StopFreq;
+  int NumSteps;
+  long Count;
+  double LoadGamma;             /* The load's true reflection coefficient */
+  double *Offset;               /* Read with the load, per step */
+  double *Scale;                /* True over read reflection, per step */
+} OslCorrection;
+
+int  osl_standard(const char *);
+const char *osl_standard_name(int);
+bool osl_init(OslTable *, long, long, int);
+void osl_free(OslTable *);
+bool osl_complete(OslTable *);
+void osl_record(OslTable *, int, long, const ScanPoint *);
+void osl_file_name(char *, int, long, long, int);
+bool osl_save(const char *, OslTable *);
+bool osl_load(const char *, OslTable *);
+bool osl_find(long, long, int, OslTable *);
+bool osl_prepare(OslTable *, long, long, int, OslCorrection *);
+long osl_step(long, long, int, long);
+bool osl_correct(OslCorrection *, ScanPoint *);
+void osl_free_correction(OslCorrection *);
+
+#endif /* OSL_H */
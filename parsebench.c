@@ -0,0 +1,180 @@
+/*******************************************************************************
+***
+*** Filename         : parsebench.c
+*** Purpose          : Microbenchmark of scan/oscilloscope line parsing and
+***                    formatting: sscanf/sprintf versus scanline.c, and
+***                    binary protocol frames.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "global.h"
+#include "scanline.h"
+
+#define LineCount 10000
+#define LineMax 64
+
+static char scanLines[LineCount][LineMax];
+static char oscLines[LineCount][LineMax];
+static char scanFrames[LineCount][LineMax];
+static char output[FormattedLineMax];
+
+/* Stops the compiler discarding the work */
+static volatile long sink;
+
+
+static double now()
+{
+struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+static void generate()
+{
+ScanPoint point;
+int i;
+  for (i = 0; i < LineCount; i++) {
+    sprintf(scanLines[i], "%ld.00,0,%d,%d.00,%d.00\r\n",
+      1000000L + i * 2900L, 1000 + (i * 37) % 9000, 790 + i % 11, i % 800);
+    sprintf(oscLines[i], "%d %d\r\n", i, 790 + (i * 7) % 23);
+    parse_scan_line(scanLines[i], &point);
+    format_scan_frame((byte *) scanFrames[i], SCAN_FRAME_POINT, &point);
+  }
+}
+
+
+static void scan_stdio(char *line)
+{
+long scan_freq, scan_vswr, scan_fwdv, scan_revv;
+  sscanf(line, "%ld.00,0,%ld,%ld.00,%ld.00\n",
+         &scan_freq, &scan_vswr, &scan_fwdv, &scan_revv);
+  sprintf(output, "%f %f\n", scan_freq / 1000000.0, scan_vswr / 1000.0);
+  sink += output[0];
+}
+
+
+static void scan_fixed(char *line)
+{
+ScanPoint point;
+  if (parse_scan_line(line, &point)) {
+    sink += format_scan_point(output, &point);
+  }
+}
+
+
+static void scan_frame(char *frame)
+{
+ScanPoint point;
+  if (parse_scan_frame((byte *) frame, &point) == SCAN_FRAME_POINT) {
+    sink += format_scan_point(output, &point);
+  }
+}
+
+
+static void osc_stdio(char *line)
+{
+long sample_num, voltage;
+  sscanf(line, "%ld %ld\n", &sample_num, &voltage);
+  sprintf(output, "%ld %ld\n", sample_num, voltage);
+  sink += output[0];
+}
+
+
+static void osc_fixed(char *line)
+{
+OscPoint point;
+  if (parse_osc_line(line, &point)) {
+    sink += format_osc_point(output, &point);
+  }
+}
+
+
+static double run(char *name, void (*convert)(char *), char lines[][LineMax], int passes)
+{
+int pass, i;
+double started, elapsed, rate;
+
+  started = now();
+  for (pass = 0; pass < passes; pass++) {
+    for (i = 0; i < LineCount; i++) {
+      convert(lines[i]);
+    }
+  }
+  elapsed = now() - started;
+  rate = elapsed > 0.0 ? (double) passes * LineCount / elapsed : 0.0;
+  printf("%-22s %12.0f lines/sec\n", name, rate);
+  return rate;
+}
+
+
+/* The new path must produce the same gnuplot data as the old one. */
+static bool check()
+{
+char expected[FormattedLineMax];
+int i;
+  for (i = 0; i < LineCount; i++) {
+    scan_stdio(scanLines[i]);
+    strcpy(expected, output);
+    scan_fixed(scanLines[i]);
+    if (strcmp(expected, output) != 0) {
+      printf("Mismatch on '%s': '%s' versus '%s'\n", scanLines[i], expected, output);
+      return FALSE;
+    }
+    output[0] = '\0';
+    scan_frame(scanFrames[i]);
+    if (strcmp(expected, output) != 0) {
+      printf("Mismatch on the frame of '%s': '%s' versus '%s'\n", scanLines[i], expected,
+        output);
+      return FALSE;
+    }
+    osc_stdio(oscLines[i]);
+    strcpy(expected, output);
+    osc_fixed(oscLines[i]);
+    if (strcmp(expected, output) != 0) {
+      printf("Mismatch on '%s': '%s' versus '%s'\n", oscLines[i], expected, output);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+int passes = 50;
+double before, after;
+
+  if (argc > 1) {
+    passes = atoi(argv[1]);
+  }
+  generate();
+  if (!check()) {
+    return 1;
+  }
+
+  before = run("scan sscanf/sprintf", scan_stdio, scanLines, passes);
+  after = run("scan scanline.c", scan_fixed, scanLines, passes);
+  printf("%-22s %12.1fx\n", "scan speedup", after / before);
+  after = run("scan frames", scan_frame, scanFrames, passes);
+  printf("%-22s %12.1fx\n", "frame speedup", after / before);
+
+  before = run("osc sscanf/sprintf", osc_stdio, oscLines, passes);
+  after = run("osc scanline.c", osc_fixed, oscLines, passes);
+  printf("%-22s %12.1fx\n", "osc speedup", after / before);
+  return 0;
+}
@@ -0,0 +1,227 @@
+/*******************************************************************************
+***
+*** Filename         : refine.c
+*** Purpose          : Adaptive resonance refinement: decide where to sweep
+***                    next, given the points measured so far.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : A coarse sweep is refined by follow-up sweeps across
+***                    the gaps either side of each dip (a local VSWR minimum
+***                    below RefineVswr, or not much worse than the best dip),
+***                    and across each gap where the VSWR crosses RefineVswr,
+***                    i.e. the steep sides that bound the usable bandwidth.
+***                    Each follow-up only measures the points inside its gap,
+***                    and gaps are refined until they're no wider than the
+***                    target resolution, so the flat, high VSWR parts of the
+***                    range cost nothing beyond the coarse sweep.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdlib.h>
+
+#include "global.h"
+#include "scanline.h"
+#include "refine.h"
+
+#define RefineVswr 3000L        /* 3:1, x 1000 */
+#define RefineSteps 10L         /* Most steps a follow-up sweep divides a gap into */
+#define InitialCapacity 256L
+
+
+static int compare_freq(const void *A, const void *B)
+{
+  long a = ((const ScanPoint *) A)->Freq;
+  long b = ((const ScanPoint *) B)->Freq;
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : refine_init
+*** Preconditions    : Resolution > 0, in Hz.
+*** Postconditions   : Refinement holds no points.
+***
+*******************************************************************************/
+
+void refine_init(Refinement *Refining, long Resolution)
+{
+  Refining->Points = NULL;
+  Refining->Count = Refining->Capacity = 0L;
+  Refining->Resolution = Resolution;
+  Refining->Sorted = TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : refine_add
+*** Preconditions    : Refinement has been initialised.
+*** Postconditions   : refine_add is TRUE and Point has been added, or FALSE
+***                    if there's no memory for it.
+***
+*******************************************************************************/
+
+bool refine_add(Refinement *Refining, const ScanPoint *Point)
+{
+  ScanPoint *points;
+  long capacity;
+
+  if (Refining->Count == Refining->Capacity) {
+    capacity = Refining->Capacity == 0L ? InitialCapacity : Refining->Capacity * 2L;
+    points = realloc(Refining->Points, capacity * sizeof(ScanPoint));
+    if (points == NULL) {
+      return FALSE;
+    }
+    Refining->Points = points;
+    Refining->Capacity = capacity;
+  }
+  Refining->Points[Refining->Count++] = *Point;
+  Refining->Sorted = FALSE;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : refine_sort
+*** Preconditions    : Refinement has been initialised.
+*** Postconditions   : The points are in frequency order, and where a
+***                    frequency was measured more than once, only one of the
+***                    measurements is kept.
+***
+*******************************************************************************/
+
+void refine_sort(Refinement *Refining)
+{
+  long i, kept = 0L;
+
+  if (Refining->Sorted) {
+    return;
+  }
+  qsort(Refining->Points, Refining->Count, sizeof(ScanPoint), compare_freq);
+  for (i = 0L; i < Refining->Count; i++) {
+    if (kept == 0L || Refining->Points[i].Freq != Refining->Points[kept - 1].Freq) {
+      Refining->Points[kept++] = Refining->Points[i];
+    }
+  }
+  Refining->Count = kept;
+  Refining->Sorted = TRUE;
+}
+
+
+/* Is point i a local minimum at or below Limit? */
+static bool is_dip(ScanPoint *Points, long Count, long i, long Limit)
+{
+  return Points[i].Vswr <= Limit &&
+         (i == 0L || Points[i].Vswr <= Points[i - 1].Vswr) &&
+         (i == Count - 1L || Points[i].Vswr <= Points[i + 1].Vswr);
+}
+
+
+/* Fill in a sweep of the points strictly inside the gap From..To (Hz x 100) */
+static void gap_sweep(Refinement *Refining, long From, long To, Sweep *Next)
+{
+  long width = To - From;
+  long steps = (width + Refining->Resolution * 100L - 1L) / (Refining->Resolution * 100L);
+
+  /* Three steps measure two new points, at the cost of two dwells; fewer
+   * would measure the midpoint twice */
+  if (steps < 3L) {
+    steps = 3L;
+  }
+  if (steps > RefineSteps) {
+    steps = RefineSteps;
+  }
+  Next->StartFreq = (From + width / steps + 50L) / 100L;
+  Next->StopFreq = (To - width / steps + 50L) / 100L;
+  Next->NumSteps = (int) steps - 2;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : refine_next
+*** Preconditions    : Refinement holds the points measured so far. Sweeps
+***                    has room for MaxSweeps.
+*** Postconditions   : The points are sorted, as by refine_sort.
+***                    refine_next is the number of follow-up sweeps placed
+***                    in Sweeps, 0 if every dip and crossing has been
+***                    resolved to the target resolution.
+***
+*******************************************************************************/
+
+int refine_next(Refinement *Refining, Sweep *Sweeps, int MaxSweeps)
+{
+  ScanPoint *p;
+  long i, n, limit;
+  int sweeps = 0;
+
+  refine_sort(Refining);
+  p = Refining->Points;
+  n = Refining->Count;
+  if (n < 2L) {
+    return 0;
+  }
+
+  limit = p[refine_best(Refining)].Vswr;
+  limit += limit / 2L;
+  if (limit < RefineVswr) {
+    limit = RefineVswr;
+  }
+
+  /* Gap i lies between point i and point i + 1 */
+  for (i = 0L; i < n - 1L && sweeps < MaxSweeps; i++) {
+    if (p[i + 1].Freq - p[i].Freq <= Refining->Resolution * 100L) {
+      continue;
+    }
+    if (is_dip(p, n, i, limit) || is_dip(p, n, i + 1L, limit) ||
+        (p[i].Vswr <= limit) != (p[i + 1].Vswr <= limit)) {
+      gap_sweep(Refining, p[i].Freq, p[i + 1].Freq, &Sweeps[sweeps++]);
+    }
+  }
+  return sweeps;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : refine_best
+*** Preconditions    : Refinement has been sorted.
+*** Postconditions   : refine_best is the index of the point with the lowest
+***                    VSWR, or -1 if there are no points.
+***
+*******************************************************************************/
+
+long refine_best(Refinement *Refining)
+{
+  long i, best = -1L;
+
+  for (i = 0L; i < Refining->Count; i++) {
+    if (best == -1L || Refining->Points[i].Vswr < Refining->Points[best].Vswr) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : refine_free
+*** Preconditions    : Refinement has been initialised.
+*** Postconditions   : The points have been freed.
+***
+*******************************************************************************/
+
+void refine_free(Refinement *Refining)
+{
+  free(Refining->Points);
+  refine_init(Refining, Refining->Resolution);
+}
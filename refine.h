@@ -0,0 +1,47 @@
+/*******************************************************************************
+***
+*** Filename         : refine.h
+*** Purpose          : Definitions for adaptive resonance refinement
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef REFINE_H
+#define REFINE_H
+
+#include "global.h"
+#include "scanline.h"
+
+#define RefineMaxSweeps 32      /* Follow-up sweeps per pass */
+#define RefineMaxPasses 16
+
+/* A follow-up sweep to send to the analyser, in Hz */
+typedef struct {
+  long StartFreq;
+  long StopFreq;
+  int NumSteps;
+} Sweep;
+
+/* Every point measured so far, and the resolution we're aiming for */
+typedef struct {
+  ScanPoint *Points;
+  long Count;
+  long Capacity;
+  long Resolution;              /* Hz */
+  bool Sorted;
+} Refinement;
+
+void refine_init(Refinement *, long);
+bool refine_add(Refinement *, const ScanPoint *);
+void refine_sort(Refinement *);
+int  refine_next(Refinement *, Sweep *, int);
+long refine_best(Refinement *);
+void refine_free(Refinement *);
+
+#endif /* REFINE_H */
@@ -0,0 +1,905 @@
+/*******************************************************************************
+***
+*** Filename         : render.c
+*** Purpose          : Built-in SVG and PNG rendering of the VSWR and
+***                    detector plots, for when starting gnuplot is too slow
+***                    or too big (e.g. on a Raspberry Pi).
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The plots follow what plot() asks gnuplot for: a
+***                    600x400 image, autoscaled axes extended to whole tics
+***                    chosen as gnuplot chooses them, 5 minor x tics, the
+***                    axis labels, and a key with the series' titles.
+***                    "smooth bezier" is gnuplot's: one Bezier curve through
+***                    all the points as control points, sampled 100 times;
+***                    each sample only sums the binomial weights near their
+***                    peak, so long scans are still cheap.
+***                    PNGs are palette images, drawn without antialiasing
+***                    in a 5x8 bitmap font, and compressed with fixed
+***                    Huffman codes matching runs and the row above, which
+***                    suits plots' large blank areas.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "global.h"
+#include "scanline.h"
+#include "scanfile.h"
+#include "render.h"
+
+/* Space around the plot area for the tics, their labels and axis labels */
+#define MarginLeft 70
+#define MarginRight 20
+#define MarginTop 20
+#define MarginBottom 50
+
+/* gnuplot's default "samples" */
+#define BezierSamples 100
+
+/* Palette indices; series n is drawn in colour SeriesColour + n */
+#define White 0
+#define Black 1
+#define SeriesColour 2
+#define Colours 10
+
+/* gnuplot's default line colours, with linetype 1 set to blue by plot() */
+static const byte palette[Colours][3] = {
+  { 255, 255, 255 }, { 0, 0, 0 },
+  { 0, 0, 255 }, { 148, 0, 211 }, { 0, 158, 115 }, { 86, 180, 233 },
+  { 230, 159, 0 }, { 240, 228, 66 }, { 0, 114, 178 }, { 229, 30, 36 }
+};
+
+/* Text alignment */
+#define AlignLeft 0
+#define AlignCentre 1
+#define AlignRight 2
+
+/* 5x8 font for ' ' to '~', a byte per column, least significant bit at
+   the top */
+#define GlyphWidth 5
+#define GlyphHeight 8
+#define GlyphAdvance 6
+
+static const byte font[95][GlyphWidth] = {
+  { 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5F, 0x00, 0x00 },
+  { 0x00, 0x07, 0x00, 0x07, 0x00 }, { 0x14, 0x7F, 0x14, 0x7F, 0x14 },
+  { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 },
+  { 0x36, 0x49, 0x56, 0x20, 0x50 }, { 0x00, 0x08, 0x07, 0x03, 0x00 },
+  { 0x00, 0x1C, 0x22, 0x41, 0x00 }, { 0x00, 0x41, 0x22, 0x1C, 0x00 },
+  { 0x2A, 0x1C, 0x7F, 0x1C, 0x2A }, { 0x08, 0x08, 0x3E, 0x08, 0x08 },
+  { 0x00, 0x80, 0x70, 0x30, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 },
+  { 0x00, 0x00, 0x60, 0x60, 0x00 }, { 0x20, 0x10, 0x08, 0x04, 0x02 },
+  { 0x3E, 0x51, 0x49, 0x45, 0x3E }, { 0x00, 0x42, 0x7F, 0x40, 0x00 },
+  { 0x72, 0x49, 0x49, 0x49, 0x46 }, { 0x21, 0x41, 0x49, 0x4D, 0x33 },
+  { 0x18, 0x14, 0x12, 0x7F, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 },
+  { 0x3C, 0x4A, 0x49, 0x49, 0x31 }, { 0x41, 0x21, 0x11, 0x09, 0x07 },
+  { 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x46, 0x49, 0x49, 0x29, 0x1E },
+  { 0x00, 0x00, 0x14, 0x00, 0x00 }, { 0x00, 0x40, 0x34, 0x00, 0x00 },
+  { 0x00, 0x08, 0x14, 0x22, 0x41 }, { 0x14, 0x14, 0x14, 0x14, 0x14 },
+  { 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x59, 0x09, 0x06 },
+  { 0x3E, 0x41, 0x5D, 0x59, 0x4E }, { 0x7C, 0x12, 0x11, 0x12, 0x7C },
+  { 0x7F, 0x49, 0x49, 0x49, 0x36 }, { 0x3E, 0x41, 0x41, 0x41, 0x22 },
+  { 0x7F, 0x41, 0x41, 0x41, 0x3E }, { 0x7F, 0x49, 0x49, 0x49, 0x41 },
+  { 0x7F, 0x09, 0x09, 0x09, 0x01 }, { 0x3E, 0x41, 0x41, 0x51, 0x73 },
+  { 0x7F, 0x08, 0x08, 0x08, 0x7F }, { 0x00, 0x41, 0x7F, 0x41, 0x00 },
+  { 0x20, 0x40, 0x41, 0x3F, 0x01 }, { 0x7F, 0x08, 0x14, 0x22, 0x41 },
+  { 0x7F, 0x40, 0x40, 0x40, 0x40 }, { 0x7F, 0x02, 0x1C, 0x02, 0x7F },
+  { 0x7F, 0x04, 0x08, 0x10, 0x7F }, { 0x3E, 0x41, 0x41, 0x41, 0x3E },
+  { 0x7F, 0x09, 0x09, 0x09, 0x06 }, { 0x3E, 0x41, 0x51, 0x21, 0x5E },
+  { 0x7F, 0x09, 0x19, 0x29, 0x46 }, { 0x26, 0x49, 0x49, 0x49, 0x32 },
+  { 0x03, 0x01, 0x7F, 0x01, 0x03 }, { 0x3F, 0x40, 0x40, 0x40, 0x3F },
+  { 0x1F, 0x20, 0x40, 0x20, 0x1F }, { 0x3F, 0x40, 0x38, 0x40, 0x3F },
+  { 0x63, 0x14, 0x08, 0x14, 0x63 }, { 0x03, 0x04, 0x78, 0x04, 0x03 },
+  { 0x61, 0x59, 0x49, 0x4D, 0x43 }, { 0x00, 0x7F, 0x41, 0x41, 0x41 },
+  { 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x41, 0x7F },
+  { 0x04, 0x02, 0x01, 0x02, 0x04 }, { 0x40, 0x40, 0x40, 0x40, 0x40 },
+  { 0x00, 0x03, 0x07, 0x08, 0x00 }, { 0x20, 0x54, 0x54, 0x78, 0x40 },
+  { 0x7F, 0x28, 0x44, 0x44, 0x38 }, { 0x38, 0x44, 0x44, 0x44, 0x28 },
+  { 0x38, 0x44, 0x44, 0x28, 0x7F }, { 0x38, 0x54, 0x54, 0x54, 0x18 },
+  { 0x00, 0x08, 0x7E, 0x09, 0x02 }, { 0x18, 0xA4, 0xA4, 0x9C, 0x78 },
+  { 0x7F, 0x08, 0x04, 0x04, 0x78 }, { 0x00, 0x44, 0x7D, 0x40, 0x00 },
+  { 0x20, 0x40, 0x40, 0x3D, 0x00 }, { 0x7F, 0x10, 0x28, 0x44, 0x00 },
+  { 0x00, 0x41, 0x7F, 0x40, 0x00 }, { 0x7C, 0x04, 0x78, 0x04, 0x78 },
+  { 0x7C, 0x08, 0x04, 0x04, 0x78 }, { 0x38, 0x44, 0x44, 0x44, 0x38 },
+  { 0xFC, 0x18, 0x24, 0x24, 0x18 }, { 0x18, 0x24, 0x24, 0x18, 0xFC },
+  { 0x7C, 0x08, 0x04, 0x04, 0x08 }, { 0x48, 0x54, 0x54, 0x54, 0x24 },
+  { 0x04, 0x04, 0x3F, 0x44, 0x24 }, { 0x3C, 0x40, 0x40, 0x20, 0x7C },
+  { 0x1C, 0x20, 0x40, 0x20, 0x1C }, { 0x3C, 0x40, 0x30, 0x40, 0x3C },
+  { 0x44, 0x28, 0x10, 0x28, 0x44 }, { 0x4C, 0x90, 0x90, 0x90, 0x7C },
+  { 0x44, 0x64, 0x54, 0x4C, 0x44 }, { 0x00, 0x08, 0x36, 0x41, 0x00 },
+  { 0x00, 0x00, 0x77, 0x00, 0x00 }, { 0x00, 0x41, 0x36, 0x08, 0x00 },
+  { 0x02, 0x01, 0x02, 0x04, 0x02 }
+};
+
+/* Where the drawing goes: SVG elements written as they're drawn, or a
+   palette index per pixel, encoded when the plot is complete */
+typedef struct {
+  int Format;
+  FILE *Out;
+  byte *Pixels;
+} Canvas;
+
+/* An autoscaled axis */
+typedef struct {
+  double Min;
+  double Max;
+  double Tic;
+} Axis;
+
+
+/*******************************************************************************
+***
+*** Function         : render_format
+*** Preconditions    : None
+*** Postconditions   : render_format is RENDER_SVG or RENDER_PNG if the
+***                    gnuplot terminal Term can be rendered here, or -1.
+***
+*******************************************************************************/
+
+int render_format(const char *Term)
+{
+  if (strcmp(Term, "svg") == 0) {
+    return RENDER_SVG;
+  }
+  if (strcmp(Term, "png") == 0 || strcmp(Term, "pngcairo") == 0) {
+    return RENDER_PNG;
+  }
+  return -1;
+}
+
+
+static bool add_point(RenderData *Data, long *Size, double X, double Y)
+{
+  double *x, *y;
+
+  if (Data->Count == *Size) {
+    *Size = *Size == 0L ? 1024L : *Size * 2L;
+    x = realloc(Data->X, *Size * sizeof(double));
+    y = realloc(Data->Y, *Size * sizeof(double));
+    if (x != NULL) {
+      Data->X = x;
+    }
+    if (y != NULL) {
+      Data->Y = y;
+    }
+    if (x == NULL || y == NULL) {
+      return FALSE;
+    }
+  }
+  Data->X[Data->Count] = X;
+  Data->Y[Data->Count++] = Y;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : render_load
+*** Preconditions    : None
+*** Postconditions   : render_load is TRUE and Data holds what gnuplot would
+***                    plot from FileName: frequency (MHz) and VSWR from a
+***                    binary scan file, or the first two columns of a text
+***                    scan or capture file. Release it with render_free.
+***                    render_load is FALSE if the file can't be read.
+***
+*******************************************************************************/
+
+bool render_load(char *FileName, RenderData *Data)
+{
+  char line[256];
+  char *p, *end;
+  double x, y;
+  long size = 0L, index;
+  ScanFile scan;
+  ScanPoint point;
+  FILE *input;
+  bool ok = TRUE;
+
+  memset(Data, 0, sizeof(RenderData));
+  if (scanfile_is_binary(FileName)) {
+    if (!scanfile_map(FileName, &scan)) {
+      return FALSE;
+    }
+    strncpy(Data->Title, scan.Header.Title, RenderTitleMax - 1);
+    for (index = 0L; index < scan.Count && ok; index++) {
+      scanfile_record(&scan, index, &point);
+      ok = add_point(Data, &size, point.Freq / 100000000.0, point.Vswr / 1000.0);
+    }
+    scanfile_unmap(&scan);
+  } else {
+    if ((input = fopen(FileName, "r")) == NULL) {
+      return FALSE;
+    }
+    while (ok && fgets(line, sizeof(line), input) != NULL) {
+      x = strtod(line, &p);
+      if (p == line) {
+        continue;               /* comment, or blank */
+      }
+      y = strtod(p, &end);
+      if (end != p) {
+        ok = add_point(Data, &size, x, y);
+      }
+    }
+    fclose(input);
+  }
+  if (!ok) {
+    render_free(Data);
+  }
+  return ok;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : render_free
+*** Preconditions    : Data was loaded by render_load.
+*** Postconditions   : Its memory has been freed.
+***
+*******************************************************************************/
+
+void render_free(RenderData *Data)
+{
+  free(Data->X);
+  free(Data->Y);
+  Data->X = Data->Y = NULL;
+  Data->Count = 0L;
+}
+
+
+/* The Bezier curve with X/Y as its control points, at Samples values of
+   its parameter. The weights are binomial, so only those near the peak at
+   Count * t matter; they're summed outwards from it until negligible. */
+static void bezier(const double *X, const double *Y, long Count,
+  double *BX, double *BY, int Samples)
+{
+  long n = Count - 1L, peak, i;
+  double t, r, w, peakWeight, sum, sx, sy;
+  int s;
+
+  for (s = 0; s < Samples; s++) {
+    t = (double) s / (Samples - 1);
+    if (n == 0L || s == 0) {
+      BX[s] = X[0];
+      BY[s] = Y[0];
+      continue;
+    }
+    if (s == Samples - 1) {
+      BX[s] = X[n];
+      BY[s] = Y[n];
+      continue;
+    }
+    r = t / (1.0 - t);
+    peak = (long) floor(t * n + 0.5);
+    peakWeight = exp(lgamma(n + 1.0) - lgamma(peak + 1.0) - lgamma(n - peak + 1.0) +
+                     peak * log(t) + (n - peak) * log1p(-t));
+    sum = sx = sy = 0.0;
+    for (i = peak, w = peakWeight; i <= n && w > peakWeight * 1e-17; i++) {
+      sum += w;
+      sx += w * X[i];
+      sy += w * Y[i];
+      w *= (double) (n - i) / (i + 1) * r;
+    }
+    for (i = peak - 1L, w = peakWeight; i >= 0L; i--) {
+      w *= (double) (i + 1) / (n - i) / r;
+      if (w <= peakWeight * 1e-17) {
+        break;
+      }
+      sum += w;
+      sx += w * X[i];
+      sy += w * Y[i];
+    }
+    BX[s] = sx / sum;
+    BY[s] = sy / sum;
+  }
+}
+
+
+/* gnuplot's tic spacing for an autoscaled range (quantize_normal_tics,
+   with its default guide of 20) */
+static double tic_step(double Range)
+{
+  double power = pow(10.0, floor(log10(Range)));
+  double xnorm = Range / power;
+  double positions = 20.0 / xnorm;
+  double tics;
+
+  if (positions > 40.0) {
+    tics = 0.05;
+  } else if (positions > 20.0) {
+    tics = 0.1;
+  } else if (positions > 10.0) {
+    tics = 0.2;
+  } else if (positions > 4.0) {
+    tics = 0.5;
+  } else if (positions > 2.0) {
+    tics = 1.0;
+  } else if (positions > 0.5) {
+    tics = 2.0;
+  } else {
+    tics = ceil(xnorm);
+  }
+  return tics * power;
+}
+
+
+/* Autoscale to Min/Max, extended to whole tics */
+static void autoscale(Axis *A, double Min, double Max)
+{
+  if (Max <= Min) {
+    Min -= 1.0;
+    Max += 1.0;
+  }
+  A->Tic = tic_step(Max - Min);
+  A->Min = floor(Min / A->Tic + 1e-9) * A->Tic;
+  A->Max = ceil(Max / A->Tic - 1e-9) * A->Tic;
+}
+
+
+static double map_x(Axis *A, double X)
+{
+  return MarginLeft + (X - A->Min) / (A->Max - A->Min) * (RenderWidth - MarginLeft - MarginRight);
+}
+
+
+static double map_y(Axis *A, double Y)
+{
+  return RenderHeight - MarginBottom -
+    (Y - A->Min) / (A->Max - A->Min) * (RenderHeight - MarginTop - MarginBottom);
+}
+
+
+static void set_pixel(Canvas *C, int X, int Y, int Colour)
+{
+  if (X >= 0 && X < RenderWidth && Y >= 0 && Y < RenderHeight) {
+    C->Pixels[Y * RenderWidth + X] = Colour;
+  }
+}
+
+
+static void svg_colour(char *Out, int Colour)
+{
+  sprintf(Out, "#%02x%02x%02x", palette[Colour][0], palette[Colour][1], palette[Colour][2]);
+}
+
+
+static void svg_text(FILE *Out, const char *Text)
+{
+  for (; *Text != '\0'; Text++) {
+    switch (*Text) {
+      case '<': fputs("&lt;", Out); break;
+      case '>': fputs("&gt;", Out); break;
+      case '&': fputs("&amp;", Out); break;
+      case '"': fputs("&quot;", Out); break;
+      default: fputc(*Text, Out);
+    }
+  }
+}
+
+
+static void draw_line(Canvas *C, double X0, double Y0, double X1, double Y1, int Colour)
+{
+  char colour[8];
+  int x0 = (int) floor(X0 + 0.5), y0 = (int) floor(Y0 + 0.5);
+  int x1 = (int) floor(X1 + 0.5), y1 = (int) floor(Y1 + 0.5);
+  int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+  int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+  int error = dx + dy, e2;
+
+  if (C->Format == RENDER_SVG) {
+    svg_colour(colour, Colour);
+    fprintf(C->Out, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" stroke=\"%s\"/>\n",
+      X0, Y0, X1, Y1, colour);
+    return;
+  }
+  for (;;) {
+    set_pixel(C, x0, y0, Colour);
+    if (x0 == x1 && y0 == y1) {
+      break;
+    }
+    e2 = 2 * error;
+    if (e2 >= dy) {
+      error += dy;
+      x0 += sx;
+    }
+    if (e2 <= dx) {
+      error += dx;
+      y0 += sy;
+    }
+  }
+}
+
+
+/* Text centred vertically on Y, or running up the image from Y if
+   Vertical, centred on X */
+static void draw_text(Canvas *C, int X, int Y, const char *Text, int Align, bool Vertical)
+{
+  static const char *anchors[] = { "start", "middle", "end" };
+  int width = (int) strlen(Text) * GlyphAdvance - 1;
+  int start = Align == AlignLeft ? 0 : Align == AlignCentre ? width / 2 : width;
+  int i, column, row, ch;
+
+  if (C->Format == RENDER_SVG) {
+    if (Vertical) {
+      fprintf(C->Out, "<text x=\"%d\" y=\"%d\" text-anchor=\"%s\" transform=\"rotate(-90 %d %d)\">",
+        X + 4, Y, anchors[Align], X + 4, Y);
+    } else {
+      fprintf(C->Out, "<text x=\"%d\" y=\"%d\" text-anchor=\"%s\">", X, Y + 4, anchors[Align]);
+    }
+    svg_text(C->Out, Text);
+    fprintf(C->Out, "</text>\n");
+    return;
+  }
+  for (i = 0; Text[i] != '\0'; i++) {
+    ch = (byte) Text[i];
+    if (ch < ' ' || ch > '~') {
+      ch = '?';
+    }
+    for (column = 0; column < GlyphWidth; column++) {
+      for (row = 0; row < GlyphHeight; row++) {
+        if (font[ch - ' '][column] & (1 << row)) {
+          if (Vertical) {
+            set_pixel(C, X - 4 + row, Y + start - i * GlyphAdvance - column, Black);
+          } else {
+            set_pixel(C, X - start + i * GlyphAdvance + column, Y - 4 + row, Black);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+static void draw_curve(Canvas *C, const double *X, const double *Y, long Count, int Colour)
+{
+  char colour[8];
+  long i;
+
+  if (C->Format == RENDER_SVG) {
+    svg_colour(colour, Colour);
+    fprintf(C->Out, "<polyline fill=\"none\" stroke=\"%s\" points=\"", colour);
+    for (i = 0L; i < Count; i++) {
+      fprintf(C->Out, "%s%.1f,%.1f", i == 0L ? "" : " ", X[i], Y[i]);
+    }
+    fprintf(C->Out, "\"/>\n");
+    return;
+  }
+  for (i = 1L; i < Count; i++) {
+    draw_line(C, X[i - 1], Y[i - 1], X[i], Y[i], Colour);
+  }
+}
+
+
+/* gnuplot's point type 1, a plus */
+static void draw_points(Canvas *C, const double *X, const double *Y, long Count, int Colour)
+{
+  char colour[8];
+  long i;
+
+  if (C->Format == RENDER_SVG) {
+    svg_colour(colour, Colour);
+    fprintf(C->Out, "<path fill=\"none\" stroke=\"%s\" d=\"", colour);
+    for (i = 0L; i < Count; i++) {
+      fprintf(C->Out, "M%.1f %.1fh6M%.1f %.1fv6", X[i] - 3.0, Y[i], X[i], Y[i] - 3.0);
+    }
+    fprintf(C->Out, "\"/>\n");
+    return;
+  }
+  for (i = 0L; i < Count; i++) {
+    draw_line(C, X[i] - 3.0, Y[i], X[i] + 3.0, Y[i], Colour);
+    draw_line(C, X[i], Y[i] - 3.0, X[i], Y[i] + 3.0, Colour);
+  }
+}
+
+
+/* Tic values of an axis, with rounding error near zero removed */
+static double tic_value(Axis *A, int Index)
+{
+  double value = A->Min + Index * A->Tic;
+  return fabs(value) < A->Tic * 1e-6 ? 0.0 : value;
+}
+
+
+static void draw_axes(Canvas *C, Axis *XAxis, Axis *YAxis, const char *XLabel, const char *YLabel)
+{
+  const int left = MarginLeft, right = RenderWidth - MarginRight;
+  const int top = MarginTop, bottom = RenderHeight - MarginBottom;
+  char label[32];
+  double x, y, minor;
+  int i, m;
+
+  /* x tics: "scale 2,1", with 5 minor tics ... */
+  for (i = 0; (x = tic_value(XAxis, i)) <= XAxis->Max + XAxis->Tic * 1e-6; i++) {
+    draw_line(C, map_x(XAxis, x), bottom, map_x(XAxis, x), bottom - 12, Black);
+    draw_line(C, map_x(XAxis, x), top, map_x(XAxis, x), top + 12, Black);
+    sprintf(label, "%g", x);
+    draw_text(C, (int) floor(map_x(XAxis, x) + 0.5), bottom + 12, label, AlignCentre, FALSE);
+    for (m = 1; m < 5 && x < XAxis->Max - XAxis->Tic * 1e-6; m++) {
+      minor = map_x(XAxis, x + m * XAxis->Tic / 5.0);
+      draw_line(C, minor, bottom, minor, bottom - 6, Black);
+      draw_line(C, minor, top, minor, top + 6, Black);
+    }
+  }
+  /* ... y tics at the default scale, without minor tics */
+  for (i = 0; (y = tic_value(YAxis, i)) <= YAxis->Max + YAxis->Tic * 1e-6; i++) {
+    draw_line(C, left, map_y(YAxis, y), left + 6, map_y(YAxis, y), Black);
+    draw_line(C, right, map_y(YAxis, y), right - 6, map_y(YAxis, y), Black);
+    sprintf(label, "%g", y);
+    draw_text(C, left - 6, (int) floor(map_y(YAxis, y) + 0.5), label, AlignRight, FALSE);
+  }
+
+  draw_line(C, left, top, right, top, Black);
+  draw_line(C, right, top, right, bottom, Black);
+  draw_line(C, right, bottom, left, bottom, Black);
+  draw_line(C, left, bottom, left, top, Black);
+  draw_text(C, (left + right) / 2, RenderHeight - 14, XLabel, AlignCentre, FALSE);
+  draw_text(C, 12, (top + bottom) / 2, YLabel, AlignCentre, TRUE);
+}
+
+
+/* PNG encoding: a zlib stream of one fixed Huffman deflate block */
+
+typedef struct {
+  byte *Data;
+  size_t Length;
+  size_t Size;
+  word32 Bits;
+  int Count;
+} BitBuffer;
+
+static const int lengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int lengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const int distanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const int distanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static bool put_byte(BitBuffer *B, byte Byte)
+{
+  byte *data;
+
+  if (B->Length == B->Size) {
+    B->Size = B->Size == 0 ? 65536 : B->Size * 2;
+    if ((data = realloc(B->Data, B->Size)) == NULL) {
+      return FALSE;
+    }
+    B->Data = data;
+  }
+  B->Data[B->Length++] = Byte;
+  return TRUE;
+}
+
+/* Bits go in least significant first ... */
+static bool put_bits(BitBuffer *B, word32 Value, int Count)
+{
+  B->Bits |= Value << B->Count;
+  B->Count += Count;
+  while (B->Count >= 8) {
+    if (!put_byte(B, B->Bits & 0xff)) {
+      return FALSE;
+    }
+    B->Bits >>= 8;
+    B->Count -= 8;
+  }
+  return TRUE;
+}
+
+/* ... but Huffman codes most significant first */
+static bool put_code(BitBuffer *B, word32 Code, int Length)
+{
+  word32 reversed = 0;
+  int i;
+
+  for (i = 0; i < Length; i++) {
+    reversed = (reversed << 1) | ((Code >> i) & 1);
+  }
+  return put_bits(B, reversed, Length);
+}
+
+static bool put_symbol(BitBuffer *B, int Symbol)
+{
+  if (Symbol < 144) {
+    return put_code(B, 0x30 + Symbol, 8);
+  } else if (Symbol < 256) {
+    return put_code(B, 0x190 + Symbol - 144, 9);
+  } else if (Symbol < 280) {
+    return put_code(B, Symbol - 256, 7);
+  }
+  return put_code(B, 0xc0 + Symbol - 280, 8);
+}
+
+static bool put_match(BitBuffer *B, int Length, int Distance)
+{
+  int l = 28, d = 29;
+
+  while (lengthBase[l] > Length) {
+    l--;
+  }
+  while (distanceBase[d] > Distance) {
+    d--;
+  }
+  return put_symbol(B, 257 + l) &&
+         put_bits(B, Length - lengthBase[l], lengthExtra[l]) &&
+         put_code(B, d, 5) &&
+         put_bits(B, Distance - distanceBase[d], distanceExtra[d]);
+}
+
+static long match_length(const byte *Data, long Position, long Length, long Distance)
+{
+  long n = 0L;
+
+  if (Position < Distance) {
+    return 0L;
+  }
+  while (n < 258L && Position + n < Length && Data[Position + n] == Data[Position + n - Distance]) {
+    n++;
+  }
+  return n;
+}
+
+/* Compress Data, matching repeats of the previous byte or of the byte Row
+   before */
+static bool deflate_rows(BitBuffer *B, const byte *Data, long Length, long Row)
+{
+  word32 a = 1, b = 0;
+  long i, run, above, j;
+  bool ok;
+
+  ok = put_byte(B, 0x78) && put_byte(B, 0x01) &&
+       put_bits(B, 1, 1) && put_bits(B, 1, 2);
+  for (i = 0L; ok && i < Length; ) {
+    run = match_length(Data, i, Length, 1L);
+    above = match_length(Data, i, Length, Row);
+    if (above >= 3L && above >= run) {
+      ok = put_match(B, (int) above, (int) Row);
+      i += above;
+    } else if (run >= 3L) {
+      ok = put_match(B, (int) run, 1);
+      i += run;
+    } else {
+      ok = put_symbol(B, Data[i++]);
+    }
+  }
+  /* End of block, and pad to a byte */
+  ok = ok && put_symbol(B, 256) && (B->Count == 0 || put_bits(B, 0, 8 - B->Count));
+
+  for (j = 0L; j < Length; j++) {
+    a = (a + Data[j]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return ok && put_byte(B, b >> 8) && put_byte(B, b & 0xff) &&
+         put_byte(B, a >> 8) && put_byte(B, a & 0xff);
+}
+
+static word32 crcTable[256];
+
+static word32 crc32(word32 Crc, const byte *Data, size_t Length)
+{
+  word32 c;
+  int n, k;
+
+  if (crcTable[1] == 0) {
+    for (n = 0; n < 256; n++) {
+      c = (word32) n;
+      for (k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      crcTable[n] = c;
+    }
+  }
+  c = Crc ^ 0xffffffff;
+  while (Length-- > 0) {
+    c = crcTable[(c ^ *Data++) & 0xff] ^ (c >> 8);
+  }
+  return c ^ 0xffffffff;
+}
+
+static void put_word32(byte *Out, word32 Value)
+{
+  Out[0] = Value >> 24;
+  Out[1] = (Value >> 16) & 0xff;
+  Out[2] = (Value >> 8) & 0xff;
+  Out[3] = Value & 0xff;
+}
+
+static bool write_chunk(FILE *Out, const char *Type, const byte *Data, size_t Length)
+{
+  byte header[8], trailer[4];
+
+  put_word32(header, Length);
+  memcpy(header + 4, Type, 4);
+  put_word32(trailer, crc32(crc32(0, header + 4, 4), Data, Length));
+  return fwrite(header, 8, 1, Out) == 1 &&
+         (Length == 0 || fwrite(Data, Length, 1, Out) == 1) &&
+         fwrite(trailer, 4, 1, Out) == 1;
+}
+
+static bool write_png(FILE *Out, const byte *Pixels)
+{
+  static const byte signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  const long row = RenderWidth + 1L;
+  byte header[13], colours[Colours * 3];
+  byte *rows;
+  BitBuffer compressed;
+  bool ok;
+  int y;
+
+  /* Each row is preceded by its filter type, none */
+  if ((rows = malloc(row * RenderHeight)) == NULL) {
+    return FALSE;
+  }
+  for (y = 0; y < RenderHeight; y++) {
+    rows[y * row] = 0;
+    memcpy(rows + y * row + 1, Pixels + y * RenderWidth, RenderWidth);
+  }
+  memset(&compressed, 0, sizeof(BitBuffer));
+  ok = deflate_rows(&compressed, rows, row * RenderHeight, row);
+  free(rows);
+
+  put_word32(header, RenderWidth);
+  put_word32(header + 4, RenderHeight);
+  header[8] = 8;                /* bits per pixel */
+  header[9] = 3;                /* palette */
+  header[10] = header[11] = header[12] = 0;
+  memcpy(colours, palette, sizeof(colours));
+  ok = ok && fwrite(signature, sizeof(signature), 1, Out) == 1 &&
+       write_chunk(Out, "IHDR", header, sizeof(header)) &&
+       write_chunk(Out, "PLTE", colours, sizeof(colours)) &&
+       write_chunk(Out, "IDAT", compressed.Data, compressed.Length) &&
+       write_chunk(Out, "IEND", NULL, 0);
+  free(compressed.Data);
+  return ok;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : render_plot
+*** Preconditions    : Format is RENDER_SVG or RENDER_PNG. Series holds
+***                    SeriesCount series, not all empty. Title is shown
+***                    above the plot, unless it's "". Labels holds
+***                    LabelCount labels (Labels may be NULL if there are
+***                    none).
+*** Postconditions   : render_plot is TRUE and the plot of Series, with each
+***                    label's point marked and its text beside it, has
+***                    been written to FileName, or FALSE if it can't be
+***                    written or there's not enough memory.
+***
+*******************************************************************************/
+
+bool render_plot(char *FileName, int Format, const char *Title, const char *XLabel,
+  const char *YLabel, RenderSeries *Series, int SeriesCount, RenderLabel *Labels,
+  int LabelCount)
+{
+  double minX = 0.0, maxX = 0.0, minY = 0.0, maxY = 0.0;
+  double *x, *y, *bx, *by;
+  Axis xAxis, yAxis;
+  Canvas canvas;
+  RenderData *data;
+  long count, i, most = BezierSamples;
+  bool first = TRUE, ok;
+  int s, l, keyY, colour;
+
+  for (s = 0; s < SeriesCount; s++) {
+    data = Series[s].Data;
+    for (i = 0L; i < data->Count; i++, first = FALSE) {
+      if (first || data->X[i] < minX) minX = data->X[i];
+      if (first || data->X[i] > maxX) maxX = data->X[i];
+      if (first || data->Y[i] < minY) minY = data->Y[i];
+      if (first || data->Y[i] > maxY) maxY = data->Y[i];
+    }
+    if (data->Count > most) {
+      most = data->Count;
+    }
+  }
+  autoscale(&xAxis, minX, maxX);
+  autoscale(&yAxis, minY, maxY);
+
+  memset(&canvas, 0, sizeof(Canvas));
+  canvas.Format = Format;
+  if ((canvas.Out = fopen(FileName, Format == RENDER_PNG ? "wb" : "w")) == NULL) {
+    return FALSE;
+  }
+  x = malloc(most * sizeof(double));
+  y = malloc(most * sizeof(double));
+  bx = malloc(BezierSamples * sizeof(double));
+  by = malloc(BezierSamples * sizeof(double));
+  if (Format == RENDER_PNG) {
+    canvas.Pixels = calloc(RenderWidth * RenderHeight, 1);
+  }
+  if (x == NULL || y == NULL || bx == NULL || by == NULL ||
+      (Format == RENDER_PNG && canvas.Pixels == NULL)) {
+    free(x); free(y); free(bx); free(by); free(canvas.Pixels);
+    fclose(canvas.Out);
+    return FALSE;
+  }
+
+  if (Format == RENDER_SVG) {
+    fprintf(canvas.Out, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+    fprintf(canvas.Out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+      "viewBox=\"0 0 %d %d\" font-family=\"Arial\" font-size=\"12\">\n",
+      RenderWidth, RenderHeight, RenderWidth, RenderHeight);
+    fprintf(canvas.Out, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+  }
+  draw_axes(&canvas, &xAxis, &yAxis, XLabel, YLabel);
+  if (Title[0] != '\0') {
+    draw_text(&canvas, RenderWidth / 2, MarginTop / 2, Title, AlignCentre, FALSE);
+  }
+
+  for (s = 0; s < SeriesCount; s++) {
+    data = Series[s].Data;
+    if (data->Count == 0L) {
+      continue;
+    }
+    if (Series[s].Style == RENDER_BEZIER) {
+      bezier(data->X, data->Y, data->Count, bx, by, BezierSamples);
+      count = BezierSamples;
+    } else {
+      memcpy(x, data->X, data->Count * sizeof(double));
+      memcpy(y, data->Y, data->Count * sizeof(double));
+      count = data->Count;
+    }
+    for (i = 0L; i < count; i++) {
+      x[i] = map_x(&xAxis, Series[s].Style == RENDER_BEZIER ? bx[i] : x[i]);
+      y[i] = map_y(&yAxis, Series[s].Style == RENDER_BEZIER ? by[i] : y[i]);
+    }
+
+    colour = SeriesColour + s % (Colours - SeriesColour);
+    if (Series[s].Style == RENDER_POINTS) {
+      draw_points(&canvas, x, y, count, colour);
+    } else {
+      draw_curve(&canvas, x, y, count, colour);
+    }
+
+    /* The key, top right, for as many series as fit */
+    keyY = MarginTop + 14 + s * 14;
+    if (keyY > RenderHeight - MarginBottom - 8) {
+      continue;
+    }
+    draw_text(&canvas, RenderWidth - MarginRight - 50, keyY, Series[s].Title, AlignRight, FALSE);
+    if (Series[s].Style != RENDER_POINTS) {
+      draw_line(&canvas, RenderWidth - MarginRight - 44, keyY, RenderWidth - MarginRight - 10, keyY,
+        colour);
+    } else {
+      bx[0] = RenderWidth - MarginRight - 27;
+      by[0] = keyY;
+      draw_points(&canvas, bx, by, 1L, colour);
+    }
+  }
+
+  for (l = 0; l < LabelCount; l++) {
+    bx[0] = map_x(&xAxis, Labels[l].X);
+    by[0] = map_y(&yAxis, Labels[l].Y);
+    draw_points(&canvas, bx, by, 1L, Black);
+    draw_text(&canvas, (int) bx[0] + 6, (int) by[0] - 10, Labels[l].Text, AlignLeft, FALSE);
+  }
+
+  if (Format == RENDER_SVG) {
+    fprintf(canvas.Out, "</svg>\n");
+    ok = !ferror(canvas.Out);
+  } else {
+    ok = write_png(canvas.Out, canvas.Pixels);
+  }
+  ok = fclose(canvas.Out) == 0 && ok;
+  free(x); free(y); free(bx); free(by); free(canvas.Pixels);
+  return ok;
+}
@@ -0,0 +1,64 @@
+/*******************************************************************************
+***
+*** Filename         : render.h
+*** Purpose          : Definitions for the built-in SVG/PNG plot renderer
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "global.h"
+
+/* Image formats, as returned by render_format */
+#define RENDER_SVG 0
+#define RENDER_PNG 1
+
+/* How a series is drawn */
+#define RENDER_BEZIER 0         /* gnuplot's "smooth bezier" */
+#define RENDER_POINTS 1         /* ... "with points" */
+#define RENDER_LINES 2          /* ... and "with lines" */
+
+/* The same size as gnuplot is asked for */
+#define RenderWidth 600
+#define RenderHeight 400
+
+#define RenderTitleMax 80
+#define RenderLabelMax 40
+
+/* The first two columns of a scan or capture file */
+typedef struct {
+  double *X;
+  double *Y;
+  long Count;
+  char Title[RenderTitleMax];   /* A binary scan file's own title, or "" */
+} RenderData;
+
+/* One curve on a plot, and its entry in the key */
+typedef struct {
+  RenderData *Data;
+  int Style;
+  const char *Title;
+} RenderSeries;
+
+/* Text marking a point on a plot, as gnuplot's "set label ... point" */
+typedef struct {
+  double X;
+  double Y;
+  char Text[RenderLabelMax];
+} RenderLabel;
+
+int  render_format(const char *);
+bool render_load(char *, RenderData *);
+void render_free(RenderData *);
+bool render_plot(char *, int, const char *, const char *, const char *,
+  RenderSeries *, int, RenderLabel *, int);
+
+#endif /* RENDER_H */
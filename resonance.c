@@ -0,0 +1,265 @@
+/*******************************************************************************
+***
+*** Filename         : resonance.c
+*** Purpose          : Finding the resonances in a scan, more precisely than
+***                    its step size.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : Every local minimum of the SWR that stands out from
+***                    the noise is a resonance. Its frequency and SWR are
+***                    those of the vertex of a least squares parabola
+***                    through the points around it. The fit is to
+***                    |reflection coefficient|^2 rather than to SWR: for a
+***                    resonant (series RLC) load that's close to quadratic
+***                    in frequency near the minimum, whereas SWR has a
+***                    sharp V at a good match, which biases a parabola. So a
+***                    coarse scan locates the resonance as well as a much
+***                    finer one would.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "global.h"
+#include "resonance.h"
+
+/* The parabola is fitted to at least this many points each side of the
+   lowest, and more if need be to take in a rise in the SWR of at least
+   FitRise of its lowest: on a fine scan the few points nearest are all
+   much the same, to the analyser's resolution */
+#define FitPoints 2
+#define FitRise 0.05
+
+/* A minimum must be this fraction of its SWR below the peaks either side
+   to count, so ADC noise isn't reported as resonances */
+#define MinProminence 0.1
+
+
+/* |Gamma|^2 for an SWR */
+static double gamma_squared(double Vswr)
+{
+  double g = Vswr > 1.0 ? (Vswr - 1.0) / (Vswr + 1.0) : 0.0;
+  return g * g;
+}
+
+
+/* How far the minimum at Index is below the lower of the highest points
+   between it and lower points (or the ends) either side. Of equal minima,
+   only the first counts. */
+static double prominence(const double *Vswr, long Count, long Index)
+{
+  double left = Vswr[Index], right = Vswr[Index];
+  long i;
+
+  for (i = Index - 1L; i >= 0L && Vswr[i] > Vswr[Index]; i--) {
+    if (Vswr[i] > left) {
+      left = Vswr[i];
+    }
+  }
+  for (i = Index + 1L; i < Count && Vswr[i] >= Vswr[Index]; i++) {
+    if (Vswr[i] > right) {
+      right = Vswr[i];
+    }
+  }
+  return (left < right ? left : right) - Vswr[Index];
+}
+
+
+/* The vertex of the least squares parabola through |Gamma|^2 around Index,
+   if it's within the points fitted; otherwise Index itself */
+static void fit(const double *Freq, const double *Vswr, long Count, long Index, Resonance *R)
+{
+  double s[5], t[3], d, p, y, scale, det, b, c, x, g2;
+  double rise = Vswr[Index] * (1.0 + FitRise);
+  long lo = Index - FitPoints, hi = Index + FitPoints, j;
+  int k;
+
+  R->Freq = Freq[Index];
+  R->Vswr = Vswr[Index];
+  while (lo > 0L && Vswr[lo] < rise && Vswr[lo - 1] >= Vswr[Index]) {
+    lo--;
+  }
+  while (hi < Count - 1L && Vswr[hi] < rise && Vswr[hi + 1] >= Vswr[Index]) {
+    hi++;
+  }
+  if (lo < 0L) {
+    lo = 0L;
+  }
+  if (hi > Count - 1L) {
+    hi = Count - 1L;
+  }
+  scale = (Freq[hi] - Freq[lo]) / 2.0;
+  if (hi - lo < 2L || scale <= 0.0) {
+    return;
+  }
+
+  memset(s, 0, sizeof(s));
+  memset(t, 0, sizeof(t));
+  for (j = lo; j <= hi; j++) {
+    d = (Freq[j] - Freq[Index]) / scale;
+    y = gamma_squared(Vswr[j]);
+    for (k = 0, p = 1.0; k < 5; k++, p *= d) {
+      s[k] += p;
+      if (k < 3) {
+        t[k] += p * y;
+      }
+    }
+  }
+  /* The linear and square terms of the normal equations' solution, by
+     Cramer's rule */
+  det = s[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (s[1] * s[4] - s[3] * s[2]) +
+        s[2] * (s[1] * s[3] - s[2] * s[2]);
+  if (det == 0.0) {
+    return;
+  }
+  b = (s[0] * (t[1] * s[4] - s[3] * t[2]) - t[0] * (s[1] * s[4] - s[3] * s[2]) +
+       s[2] * (s[1] * t[2] - t[1] * s[2])) / det;
+  c = (s[0] * (s[2] * t[2] - t[1] * s[3]) - s[1] * (s[1] * t[2] - t[1] * s[2]) +
+       t[0] * (s[1] * s[3] - s[2] * s[2])) / det;
+  if (c <= 0.0) {
+    return;
+  }
+  x = -b / (2.0 * c);
+  if (Freq[Index] + x * scale < Freq[lo] || Freq[Index] + x * scale > Freq[hi]) {
+    return;
+  }
+
+  /* The fitted minimum, from the measured point nearest it */
+  g2 = gamma_squared(Vswr[Index]) + b * x + c * x * x;
+  g2 = g2 < 0.0 ? 0.0 : g2;
+  R->Freq = Freq[Index] + x * scale;
+  R->Vswr = (1.0 + sqrt(g2)) / (1.0 - sqrt(g2));
+  if (R->Vswr > Vswr[Index]) {
+    R->Vswr = Vswr[Index];
+  }
+}
+
+
+/* Where the SWR passes through 2:1 between points Inside and Outside */
+static double crossing(const double *Freq, const double *Vswr, long Inside, long Outside)
+{
+  return Freq[Inside] + (2.0 - Vswr[Inside]) / (Vswr[Outside] - Vswr[Inside]) *
+    (Freq[Outside] - Freq[Inside]);
+}
+
+
+static void bandwidth(const double *Freq, const double *Vswr, long Count, Resonance *R)
+{
+  long i;
+
+  R->Found = R->Open = FALSE;
+  if (Vswr[R->Index] > 2.0) {
+    return;
+  }
+  R->Found = TRUE;
+  for (i = R->Index; i > 0L && Vswr[i - 1] <= 2.0; i--)
+    ;
+  if (i == 0L) {
+    R->Low = Freq[0];
+    R->Open = TRUE;
+  } else {
+    R->Low = crossing(Freq, Vswr, i, i - 1L);
+  }
+  for (i = R->Index; i < Count - 1L && Vswr[i + 1] <= 2.0; i++)
+    ;
+  if (i == Count - 1L) {
+    R->High = Freq[i];
+    R->Open = TRUE;
+  } else {
+    R->High = crossing(Freq, Vswr, i, i + 1L);
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : resonance_find
+*** Preconditions    : Freq (MHz) and Vswr hold Count points in order of
+***                    frequency. Found has room for Max resonances.
+*** Postconditions   : resonance_find is the number of resonances in Found,
+***                    in order of frequency: each local minimum of the SWR
+***                    (not at the ends of the scan) that's clear of the
+***                    noise, with its fitted frequency and SWR and its 2:1
+***                    bandwidth. If there are more than Max, the Max with
+***                    the lowest SWR.
+***
+*******************************************************************************/
+
+int resonance_find(const double *Freq, const double *Vswr, long Count, Resonance *Found, int Max)
+{
+  Resonance r;
+  long i = 1L, j;
+  int n = 0, k, worst;
+
+  while (i < Count - 1L) {
+    if (Vswr[i] >= Vswr[i - 1]) {
+      i++;
+      continue;
+    }
+    /* The minimum may be flat */
+    for (j = i; j < Count - 1L && Vswr[j + 1] == Vswr[i]; j++)
+      ;
+    if (j == Count - 1L) {
+      break;
+    }
+    if (Vswr[j + 1] > Vswr[i]) {
+      r.Index = (i + j) / 2;
+      if (prominence(Vswr, Count, i) >= MinProminence * Vswr[i]) {
+        fit(Freq, Vswr, Count, r.Index, &r);
+        bandwidth(Freq, Vswr, Count, &r);
+        if (n < Max) {
+          Found[n++] = r;
+        } else {
+          for (k = 1, worst = 0; k < n; k++) {
+            if (Found[k].Vswr > Found[worst].Vswr) {
+              worst = k;
+            }
+          }
+          if (r.Vswr < Found[worst].Vswr) {
+            memmove(&Found[worst], &Found[worst + 1], (n - worst - 1) * sizeof(Resonance));
+            Found[n - 1] = r;
+          }
+        }
+      }
+    }
+    i = j + 1L;
+  }
+  return n;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : resonance_print
+*** Preconditions    : Found holds Count resonances from resonance_find.
+*** Postconditions   : They have been written to Out, a line each.
+***
+*******************************************************************************/
+
+void resonance_print(Resonance *Found, int Count, FILE *Out)
+{
+  int i;
+
+  if (Count == 0) {
+    fprintf(Out, "No resonances found\n");
+  }
+  for (i = 0; i < Count; i++) {
+    fprintf(Out, "Resonance %d: %f MHz, SWR %.3f, 2:1 bandwidth ", i + 1,
+      Found[i].Freq, Found[i].Vswr);
+    if (!Found[i].Found) {
+      fprintf(Out, "none\n");
+    } else {
+      fprintf(Out, "%f - %f MHz, %.1f kHz%s\n", Found[i].Low, Found[i].High,
+        (Found[i].High - Found[i].Low) * 1000.0,
+        Found[i].Open ? " or more (beyond the scan)" : "");
+    }
+  }
+}
@@ -0,0 +1,39 @@
+/*******************************************************************************
+***
+*** Filename         : resonance.h
+*** Purpose          : Definitions for finding resonances between scan steps
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef RESONANCE_H
+#define RESONANCE_H
+
+#include <stdio.h>
+
+#include "global.h"
+
+/* Most resonances reported from one scan */
+#define ResonanceMax 16
+
+/* A dip in the SWR, estimated between the scan's steps */
+typedef struct {
+  double Freq;                  /* MHz */
+  double Vswr;
+  long Index;                   /* The lowest scan point of the dip */
+  double Low;                   /* 2:1 bandwidth, MHz */
+  double High;
+  bool Found;                   /* The dip goes below 2:1 */
+  bool Open;                    /* ... and the scan ended before it rose */
+} Resonance;
+
+int  resonance_find(const double *, const double *, long, Resonance *, int);
+void resonance_print(Resonance *, int, FILE *);
+
+#endif /* RESONANCE_H */
@@ -0,0 +1,336 @@
+/*******************************************************************************
+***
+*** Filename         : scanfile.c
+*** Purpose          : Writing and memory-mapped reading of binary scan files
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : See scanfile.h for the layout.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "global.h"
+#include "util.h"
+#include "scanfile.h"
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_write_header
+*** Preconditions    : Output is open for writing, at its start.
+*** Postconditions   : scanfile_write_header is TRUE and Header has been
+***                    written, or FALSE on a write error.
+***
+*******************************************************************************/
+
+bool scanfile_write_header(FILE *Output, ScanFileHeader *Header)
+{
+  byte buf[ScanFileHeaderSize];
+
+  memset(buf, 0, sizeof(buf));
+  memcpy(buf, ScanFileMagic, 4);
+  write_word16(buf + 4, ScanFileVersion);
+  write_word16(buf + 6, ScanFileHeaderSize);
+  write_word32(buf + 8, (word32) Header->StartFreq);
+  write_word32(buf + 12, (word32) Header->StopFreq);
+  write_word32(buf + 16, (word32) Header->NumSteps);
+  write_word32(buf + 20, (word32) Header->SettleDelay);
+  write_word32(buf + 24, (word32) Header->Timestamp);
+  write_word32(buf + 28, (word32) Header->Records);
+  write_word16(buf + 32, ScanFileRecordSize);
+  strncpy((char *) buf + 48, Header->Title, ScanFileTitleMax - 1);
+
+  return fwrite(buf, 1, sizeof(buf), Output) == sizeof(buf);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_write_point
+*** Preconditions    : Output has had its header written.
+*** Postconditions   : scanfile_write_point is TRUE and a record for Point
+***                    has been appended, or FALSE on a write error. The
+***                    frequency is rounded to the nearest Hz.
+***
+*******************************************************************************/
+
+bool scanfile_write_point(FILE *Output, const ScanPoint *Point)
+{
+  byte buf[ScanFileRecordSize];
+
+  write_word32(buf, (word32) ((Point->Freq + 50L) / 100L));
+  write_word32(buf + 4, (word32) Point->Vswr);
+  write_word32(buf + 8, (word32) Point->Fwd);
+  write_word32(buf + 12, (word32) Point->Rev);
+
+  return fwrite(buf, 1, sizeof(buf), Output) == sizeof(buf);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_finish
+*** Preconditions    : Output has had its header and Records records written.
+*** Postconditions   : The header's record count is filled in, and Output is
+***                    left positioned at its end.
+***
+*******************************************************************************/
+
+bool scanfile_finish(FILE *Output, long Records)
+{
+  byte buf[4];
+  bool ok;
+
+  write_word32(buf, (word32) Records);
+  ok = fseek(Output, 28L, SEEK_SET) == 0 &&
+       fwrite(buf, 1, sizeof(buf), Output) == sizeof(buf);
+  (void) fseek(Output, 0L, SEEK_END);
+  return ok;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_begin
+*** Preconditions    : Output is open for writing, at its start.
+*** Postconditions   : For a binary scan file, a header describing the scan
+***                    and timestamped now has been written; text scan files
+***                    have no header. scanfile_begin is FALSE on a write
+***                    error.
+***
+*******************************************************************************/
+
+bool scanfile_begin(FILE *Output, int Format, long StartFreq, long StopFreq,
+  long NumSteps, long SettleDelay, char *Title)
+{
+  ScanFileHeader header;
+
+  if (Format != SCAN_FORMAT_BIN) {
+    return TRUE;
+  }
+  header.StartFreq = StartFreq;
+  header.StopFreq = StopFreq;
+  header.NumSteps = NumSteps;
+  header.SettleDelay = SettleDelay;
+  header.Timestamp = (long) time(NULL);
+  header.Records = 0L;
+  strncpy(header.Title, Title, ScanFileTitleMax - 1);
+  header.Title[ScanFileTitleMax - 1] = '\0';
+  return scanfile_write_header(Output, &header);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_write
+*** Preconditions    : Output is a scan file in Format, with its header
+***                    written if it's binary.
+*** Postconditions   : scanfile_write is TRUE and Point has been appended as
+***                    a gnuplot data line or a binary record, or FALSE on a
+***                    write error.
+***
+*******************************************************************************/
+
+bool scanfile_write(FILE *Output, int Format, const ScanPoint *Point)
+{
+  char line[FormattedLineMax];
+  int len;
+
+  if (Format == SCAN_FORMAT_BIN) {
+    return scanfile_write_point(Output, Point);
+  }
+  len = format_scan_point(line, Point);
+  return fwrite(line, 1, len, Output) == len;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_is_binary
+*** Preconditions    : None
+*** Postconditions   : scanfile_is_binary is TRUE if FileName starts with the
+***                    binary scan file magic number.
+***
+*******************************************************************************/
+
+bool scanfile_is_binary(char *FileName)
+{
+  char magic[4];
+  bool binary = FALSE;
+  int fd;
+
+  if ((fd = open(FileName, O_RDONLY)) != -1) {
+    binary = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+             memcmp(magic, ScanFileMagic, sizeof(magic)) == 0;
+    close(fd);
+  }
+  return binary;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_map
+*** Preconditions    : FileName names a binary scan file.
+*** Postconditions   : scanfile_map is TRUE, the file is mapped read-only
+***                    and Scan describes it; release it with
+***                    scanfile_unmap.
+***                    scanfile_map is FALSE if the file can't be mapped or
+***                    isn't a binary scan file.
+***                    If the scan was interrupted, the record count is
+***                    derived from the file's size.
+***
+*******************************************************************************/
+
+bool scanfile_map(char *FileName, ScanFile *Scan)
+{
+  struct stat st;
+  byte *map;
+  int fd, headerSize, recordSize;
+  long available;
+
+  if ((fd = open(FileName, O_RDONLY)) == -1) {
+    return FALSE;
+  }
+  if (fstat(fd, &st) == -1 || st.st_size < ScanFileHeaderSize) {
+    close(fd);
+    return FALSE;
+  }
+  map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return FALSE;
+  }
+
+  headerSize = read_word16(map + 6);
+  recordSize = read_word16(map + 32);
+  if (memcmp(map, ScanFileMagic, 4) != 0 || read_word16(map + 4) != ScanFileVersion ||
+      headerSize < ScanFileHeaderSize || headerSize > st.st_size ||
+      recordSize < ScanFileRecordSize) {
+    munmap(map, (size_t) st.st_size);
+    return FALSE;
+  }
+
+  Scan->Map = map;
+  Scan->MapLength = (size_t) st.st_size;
+  Scan->Records = map + headerSize;
+  Scan->Header.StartFreq = read_word32(map + 8);
+  Scan->Header.StopFreq = read_word32(map + 12);
+  Scan->Header.NumSteps = read_word32(map + 16);
+  Scan->Header.SettleDelay = read_word32(map + 20);
+  Scan->Header.Timestamp = read_word32(map + 24);
+  Scan->Header.Records = read_word32(map + 28);
+  memcpy(Scan->Header.Title, map + 48, ScanFileTitleMax);
+  Scan->Header.Title[ScanFileTitleMax - 1] = '\0';
+
+  available = (st.st_size - headerSize) / recordSize;
+  Scan->Count = Scan->Header.Records;
+  if (Scan->Count == 0L || Scan->Count > available) {
+    Scan->Count = available;
+  }
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_unmap
+*** Preconditions    : Scan was mapped by scanfile_map.
+*** Postconditions   : The mapping is released.
+***
+*******************************************************************************/
+
+void scanfile_unmap(ScanFile *Scan)
+{
+  if (Scan->Map != NULL) {
+    munmap(Scan->Map, Scan->MapLength);
+    Scan->Map = NULL;
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_record
+*** Preconditions    : 0 <= Index < Scan->Count
+*** Postconditions   : Point holds record Index, with its frequency in the
+***                    usual fixed point.
+***
+*******************************************************************************/
+
+void scanfile_record(ScanFile *Scan, long Index, ScanPoint *Point)
+{
+  byte *record = Scan->Records + Index * read_word16(Scan->Map + 32);
+
+  Point->Freq = (long) read_word32(record) * 100L;
+  Point->Vswr = read_word32(record + 4);
+  Point->Fwd = read_word32(record + 8);
+  Point->Rev = read_word32(record + 12);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : scanfile_append
+*** Preconditions    : Output is a scan file in Format, with its header
+***                    written if it's binary. FileName names a complete scan
+***                    file in the same Format.
+*** Postconditions   : scanfile_append is TRUE, FileName's points have been
+***                    appended to Output and Records incremented by their
+***                    number, or FALSE if FileName can't be read or Output
+***                    written.
+***
+*******************************************************************************/
+
+bool scanfile_append(FILE *Output, int Format, char *FileName, long *Records)
+{
+  char buf[BUFSIZ];
+  ScanFile scan;
+  ScanPoint point;
+  FILE *input;
+  size_t len, i;
+  long index;
+  bool ok = TRUE;
+
+  if (Format == SCAN_FORMAT_BIN) {
+    if (!scanfile_map(FileName, &scan)) {
+      return FALSE;
+    }
+    for (index = 0L; index < scan.Count && ok; index++) {
+      scanfile_record(&scan, index, &point);
+      ok = scanfile_write_point(Output, &point);
+    }
+    *Records += index;
+    scanfile_unmap(&scan);
+    return ok;
+  }
+
+  if ((input = fopen(FileName, "r")) == NULL) {
+    return FALSE;
+  }
+  while (ok && (len = fread(buf, 1, sizeof(buf), input)) > 0) {
+    for (i = 0; i < len; i++) {
+      if (buf[i] == '\n') {
+        (*Records)++;
+      }
+    }
+    ok = fwrite(buf, 1, len, Output) == len;
+  }
+  ok = ok && !ferror(input);
+  fclose(input);
+  return ok;
+}
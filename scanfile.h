@@ -0,0 +1,92 @@
+/*******************************************************************************
+***
+*** Filename         : scanfile.h
+*** Purpose          : Definitions for binary scan files
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef SCANFILE_H
+#define SCANFILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "global.h"
+#include "scanline.h"
+
+/*
+ * A binary scan file is a fixed size header followed by fixed size records,
+ * all little endian:
+ *
+ * Header
+ *   0  4  Magic "AASC"
+ *   4  2  Format version
+ *   6  2  Header size (offset of first record)
+ *   8  4  Start frequency, Hz
+ *  12  4  Stop frequency, Hz
+ *  16  4  Number of steps
+ *  20  4  Settle delay, ms
+ *  24  4  Timestamp, seconds since the epoch
+ *  28  4  Number of records, 0 if the scan was interrupted
+ *  32  2  Record size
+ *  34 14  Reserved, zero
+ *  48 80  Title, NUL padded
+ *
+ * Record
+ *   0  4  Frequency, Hz
+ *   4  4  VSWR x 1000
+ *   8  4  Forward detector reading x 100
+ *  12  4  Reverse detector reading x 100
+ */
+
+/* Scan file formats */
+#define SCAN_FORMAT_TEXT 0
+#define SCAN_FORMAT_BIN 1
+
+#define ScanFileMagic "AASC"
+#define ScanFileVersion 1
+#define ScanFileHeaderSize 128
+#define ScanFileRecordSize 16
+#define ScanFileTitleMax 80
+
+/* gnuplot's description of a record, for "binary format=" */
+#define ScanFileGnuplotFormat "%uint32%uint32%uint32%uint32"
+
+typedef struct {
+  long StartFreq;
+  long StopFreq;
+  long NumSteps;
+  long SettleDelay;
+  long Timestamp;
+  long Records;
+  char Title[ScanFileTitleMax];
+} ScanFileHeader;
+
+/* A binary scan file mapped into memory */
+typedef struct {
+  ScanFileHeader Header;
+  byte *Map;
+  size_t MapLength;
+  byte *Records;
+  long Count;
+} ScanFile;
+
+bool scanfile_write_header(FILE *, ScanFileHeader *);
+bool scanfile_write_point(FILE *, const ScanPoint *);
+bool scanfile_finish(FILE *, long);
+bool scanfile_begin(FILE *, int, long, long, long, long, char *);
+bool scanfile_write(FILE *, int, const ScanPoint *);
+bool scanfile_is_binary(char *);
+bool scanfile_map(char *, ScanFile *);
+void scanfile_unmap(ScanFile *);
+void scanfile_record(ScanFile *, long, ScanPoint *);
+bool scanfile_append(FILE *, int, char *, long *);
+
+#endif /* SCANFILE_H */
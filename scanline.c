@@ -0,0 +1,314 @@
+/*******************************************************************************
+***
+*** Filename         : scanline.c
+*** Purpose          : Parsing and formatting of analyser scan and
+***                    oscilloscope lines, without stdio or floating point.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : Scan lines look like "3500000.00,0,1234,567.00,89.00"
+***                    - frequency in Hz, a reserved field, VSWR x 1000, and
+***                    the forward and reverse detector readings. Values are
+***                    kept in fixed point (see scanline.h) so nothing after
+***                    the decimal point is lost.
+***                    The binary protocol's frames carry the same fields in
+***                    14 bytes rather than about 32.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <limits.h>
+#include <string.h>
+
+#include "global.h"
+#include "util.h"
+#include "scanline.h"
+
+static const long PowersOfTen[] = { 1L, 10L, 100L, 1000L, 10000L, 100000L, 1000000L,
+  10000000L, 100000000L, 1000000000L };
+
+
+/*******************************************************************************
+***
+*** Function         : parse_fixed
+*** Preconditions    : *Text points into a NUL-terminated line, Decimals is
+***                    0 to 9.
+*** Postconditions   : parse_fixed is TRUE, *Value holds the unsigned decimal
+***                    number at *Text scaled by 10^Decimals, and *Text points
+***                    past it. Fractional digits beyond Decimals are dropped.
+***                    parse_fixed is FALSE if there are no digits, or the
+***                    value would overflow a long.
+***
+*******************************************************************************/
+
+static bool parse_fixed(const char **Text, int Decimals, long *Value)
+{
+  const char *p = *Text;
+  long v = 0L;
+  int digits = 0, places = 0;
+
+  for (; *p >= '0' && *p <= '9'; p++, digits++) {
+    if (v > (LONG_MAX - 9L) / 10L) {
+      return FALSE;
+    }
+    v = v * 10L + (*p - '0');
+  }
+  if (*p == '.') {
+    for (p++; *p >= '0' && *p <= '9'; p++, digits++) {
+      if (places < Decimals) {
+        if (v > (LONG_MAX - 9L) / 10L) {
+          return FALSE;
+        }
+        v = v * 10L + (*p - '0');
+        places++;
+      }
+    }
+  }
+  if (digits == 0 || v > LONG_MAX / PowersOfTen[Decimals - places]) {
+    return FALSE;
+  }
+  *Value = v * PowersOfTen[Decimals - places];
+  *Text = p;
+  return TRUE;
+}
+
+
+static bool expect(const char **Text, char Ch)
+{
+  if (**Text != Ch) {
+    return FALSE;
+  }
+  (*Text)++;
+  return TRUE;
+}
+
+
+/* Only line endings (or nothing) may follow the last field */
+static bool at_end(const char *Text)
+{
+  while (*Text == '\r' || *Text == '\n') {
+    Text++;
+  }
+  return *Text == '\0';
+}
+
+
+/*******************************************************************************
+***
+*** Function         : parse_scan_line
+*** Preconditions    : Line is NUL-terminated.
+*** Postconditions   : parse_scan_line is TRUE and Point holds the line's
+***                    fields, or FALSE if the line is malformed, in which
+***                    case Point is unchanged.
+***
+*******************************************************************************/
+
+bool parse_scan_line(const char *Line, ScanPoint *Point)
+{
+  const char *p = Line;
+  ScanPoint parsed;
+  long reserved;
+
+  if (parse_fixed(&p, 2, &parsed.Freq) && expect(&p, ',') &&
+      parse_fixed(&p, 0, &reserved) && expect(&p, ',') &&
+      parse_fixed(&p, 0, &parsed.Vswr) && expect(&p, ',') &&
+      parse_fixed(&p, 2, &parsed.Fwd) && expect(&p, ',') &&
+      parse_fixed(&p, 2, &parsed.Rev) && at_end(p)) {
+    *Point = parsed;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : parse_osc_line
+*** Preconditions    : Line is NUL-terminated.
+*** Postconditions   : parse_osc_line is TRUE and Point holds the sample
+***                    number and value, or FALSE if the line is malformed,
+***                    in which case Point is unchanged.
+***
+*******************************************************************************/
+
+bool parse_osc_line(const char *Line, OscPoint *Point)
+{
+  const char *p = Line;
+  OscPoint parsed;
+
+  if (parse_fixed(&p, 0, &parsed.Sample) && expect(&p, ' ') &&
+      parse_fixed(&p, 0, &parsed.Value) && at_end(p)) {
+    *Point = parsed;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+
+/* Write an unsigned value, zero padded to at least Width digits. */
+static int put_digits(char *Out, unsigned long Value, int Width)
+{
+  char digits[24];
+  int n = 0, len;
+
+  do {
+    digits[n++] = '0' + (Value % 10UL);
+    Value /= 10UL;
+  } while (Value != 0UL);
+  while (n < Width) {
+    digits[n++] = '0';
+  }
+  for (len = 0; n > 0; len++) {
+    Out[len] = digits[--n];
+  }
+  return len;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : format_fixed
+*** Preconditions    : Out has room for 22 bytes, Decimals is 0 to 9.
+*** Postconditions   : Value / 10^Decimals is written at Out, with exactly
+***                    Decimals digits after the point (no point if 0). The
+***                    number of bytes written is returned; Out is not
+***                    NUL-terminated.
+***
+*******************************************************************************/
+
+int format_fixed(char *Out, long Value, int Decimals)
+{
+  int len = 0;
+  unsigned long v;
+
+  if (Value < 0L) {
+    Out[len++] = '-';
+    v = 0UL - (unsigned long) Value;
+  } else {
+    v = (unsigned long) Value;
+  }
+  len += put_digits(Out + len, v / PowersOfTen[Decimals], 1);
+  if (Decimals > 0) {
+    Out[len++] = '.';
+    len += put_digits(Out + len, v % PowersOfTen[Decimals], Decimals);
+  }
+  return len;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : format_scan_point
+*** Preconditions    : Out has room for FormattedLineMax bytes.
+*** Postconditions   : The gnuplot data line "MHz VSWR\n" for Point is written
+***                    at Out and NUL-terminated; its length is returned.
+***                    Frequencies are given to the Hz, as "%f" would, with
+***                    hundredths of a Hz appended only when non-zero.
+***
+*******************************************************************************/
+
+int format_scan_point(char *Out, const ScanPoint *Point)
+{
+  int len;
+  long hz = Point->Freq / 100L;
+  long centiHz = Point->Freq % 100L;
+
+  len = format_fixed(Out, hz, 6);
+  if (centiHz != 0L) {
+    len += put_digits(Out + len, centiHz, 2);
+  }
+  Out[len++] = ' ';
+  len += format_fixed(Out + len, Point->Vswr, 3);
+  /* "%f" precision */
+  Out[len++] = '0';
+  Out[len++] = '0';
+  Out[len++] = '0';
+  Out[len++] = '\n';
+  Out[len] = '\0';
+  return len;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : format_osc_point
+*** Preconditions    : Out has room for FormattedLineMax bytes.
+*** Postconditions   : The gnuplot data line "sample value\n" for Point is
+***                    written at Out and NUL-terminated; its length is
+***                    returned.
+***
+*******************************************************************************/
+
+int format_osc_point(char *Out, const OscPoint *Point)
+{
+  int len;
+
+  len = format_fixed(Out, Point->Sample, 0);
+  Out[len++] = ' ';
+  len += format_fixed(Out + len, Point->Value, 0);
+  Out[len++] = '\n';
+  Out[len] = '\0';
+  return len;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : parse_scan_frame
+*** Preconditions    : Frame holds ScanFrameSize bytes.
+*** Postconditions   : parse_scan_frame is SCAN_FRAME_POINT and Point holds
+***                    the frame's fields, or SCAN_FRAME_END, or
+***                    SCAN_FRAME_BAD if its CRC or type is wrong, in which
+***                    case Point is unchanged.
+***
+*******************************************************************************/
+
+int parse_scan_frame(byte *Frame, ScanPoint *Point)
+{
+  if (crc(Frame, ScanFrameSize - 2) != read_word16(Frame + ScanFrameSize - 2)) {
+    return SCAN_FRAME_BAD;
+  }
+  if (Frame[0] == SCAN_FRAME_END) {
+    return SCAN_FRAME_END;
+  }
+  if (Frame[0] != SCAN_FRAME_POINT) {
+    return SCAN_FRAME_BAD;
+  }
+  Point->Freq = (long) read_word32(Frame + 1);
+  Point->Vswr = (long) (read_word32(Frame + 5) & 0xffffffUL);
+  Point->Fwd = read_word16(Frame + 8) * 100L;
+  Point->Rev = read_word16(Frame + 10) * 100L;
+  return SCAN_FRAME_POINT;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : format_scan_frame
+*** Preconditions    : Out has room for ScanFrameSize bytes; Type is
+***                    SCAN_FRAME_POINT or SCAN_FRAME_END.
+*** Postconditions   : Out holds the frame of that type, with Point's fields
+***                    for a point.
+***
+*******************************************************************************/
+
+void format_scan_frame(byte *Out, int Type, const ScanPoint *Point)
+{
+  long vswr;
+
+  memset(Out, 0, ScanFrameSize);
+  Out[0] = (byte) Type;
+  if (Type == SCAN_FRAME_POINT) {
+    write_word32(Out + 1, (word32) Point->Freq);
+    vswr = Point->Vswr < 0xffffffL ? Point->Vswr : 0xffffffL;
+    write_word16(Out + 5, (word16) (vswr & 0xffffL));
+    Out[7] = (byte) (vswr >> 16);
+    write_word16(Out + 8, (word16) (Point->Fwd / 100L));
+    write_word16(Out + 10, (word16) (Point->Rev / 100L));
+  }
+  write_word16(Out + ScanFrameSize - 2, crc(Out, ScanFrameSize - 2));
+}
@@ -0,0 +1,63 @@
+/*******************************************************************************
+***
+*** Filename         : scanline.h
+*** Purpose          : Definitions for parsing and formatting analyser lines
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef SCANLINE_H
+#define SCANLINE_H
+
+#include "global.h"
+
+/* One scan step, as reported by the analyser, in fixed point. */
+typedef struct {
+  long Freq;          /* Hz x 100 */
+  long Vswr;          /* VSWR x 1000 */
+  long Fwd;           /* Forward detector reading x 100 */
+  long Rev;           /* Reverse detector reading x 100 */
+} ScanPoint;
+
+/* One oscilloscope sample. */
+typedef struct {
+  long Sample;
+  long Value;
+} OscPoint;
+
+/* Longest line the formatters can produce, including the NUL */
+#define FormattedLineMax 64
+
+/*
+ * In the binary protocol, each scan step is a fixed size frame, little
+ * endian, rather than a line:
+ *
+ *   0  1  Type: SCAN_FRAME_POINT, or SCAN_FRAME_END after the last point
+ *   1  4  Frequency, Hz x 100
+ *   5  3  VSWR x 1000
+ *   8  2  Forward detector reading (the ADC's, a whole number)
+ *  10  2  Reverse detector reading
+ *  12  2  CRC-16 (CCITT, as util.c's crc) of bytes 0 to 11
+ *
+ * The end frame's other fields are zero.
+ */
+#define ScanFrameSize 14
+#define SCAN_FRAME_POINT 'P'
+#define SCAN_FRAME_END 'E'
+#define SCAN_FRAME_BAD -1
+
+bool parse_scan_line(const char *, ScanPoint *);
+bool parse_osc_line(const char *, OscPoint *);
+int  format_scan_point(char *, const ScanPoint *);
+int  format_osc_point(char *, const OscPoint *);
+int  format_fixed(char *, long, int);
+int  parse_scan_frame(byte *, ScanPoint *);
+void format_scan_frame(byte *, int, const ScanPoint *);
+
+#endif /* SCANLINE_H */
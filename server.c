@@ -0,0 +1,520 @@
+/*******************************************************************************
+***
+*** Filename         : server.c
+*** Purpose          : Keep an analyser open and configured, and share it
+***                    between clients connecting to a Unix domain socket.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : Clients speak the analyser's own protocol, so the
+***                    driver (or a script) can use the socket in place of the
+***                    serial port. Each client has its own A/B/N/D/F/E
+***                    settings, starting as the analyser's own do when it's
+***                    reset, and all are sent with each of its requests, so
+***                    none are left over from another client. q is answered
+***                    at once, from the reply the analyser gave when the
+***                    server started. s and o are queued; the analyser
+***                    serves one at a time, taking clients in turn, and each
+***                    reply line is passed to the client as soon as it
+***                    arrives, up to and including End.
+***                    z cancels the client's queued requests, and stops the
+***                    analyser if it's serving that client.
+***                    Clients are written to without blocking: what a client
+***                    hasn't taken yet waits in its own buffer, and a client
+***                    that lets that fill is disconnected, rather than
+***                    holding up the analyser and everyone else.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "global.h"
+#include "asy.h"
+#include "server.h"
+
+#define AnalyserTimeoutMs 2000L /* The same as asy's DataTimeout */
+#define DrainMs 250L            /* Quiet time needed after a z */
+#define LineMax 256
+#define RequestMax 64
+#define QueryLines 2
+#define ArgMax 999999999L       /* The largest number the analyser takes */
+#define OutputMax 65536         /* Reply not yet taken by a client */
+
+/* Settings a client may give before s or o */
+#define SETTING_START 0
+#define SETTING_STOP 1
+#define SETTING_STEPS 2
+#define SETTING_SETTLE 3
+#define Settings 4
+
+static char SettingCommands[Settings] = { 'A', 'B', 'N', 'D' };
+
+/* The analyser's settings when it's reset */
+static long SettingDefaults[Settings] = { 1000000L, 30000000L, 100L, 10L };
+#define DetectorDefault 'F'
+
+typedef struct {
+  int Fd;                       /* -1 if this slot is free */
+  long Arg;                     /* Digits so far of the next command */
+  bool ArgTooLarge;             /* ... more than ArgMax */
+  long Setting[Settings];
+  char Detector;                /* F or E */
+  char Queue[MaxQueued][RequestMax];
+  int Head;
+  int Queued;
+  char Output[OutputMax];
+  int OutputLen;
+} Client;
+
+static Client Clients[MaxClients];
+static char Query[QueryLines][LineMax];
+static int AnalyserFd = -1;
+static int Active = -1;         /* Client being served, or -1 */
+static int LastServed = -1;
+static struct timeval LastHeard;
+static bool Draining = FALSE;
+static int serverBps = B57600;
+
+
+static long elapsed_ms(struct timeval *Since)
+{
+struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - Since->tv_sec) * 1000L + (now.tv_usec - Since->tv_usec) / 1000L;
+}
+
+
+/* Send as much of the client's buffered output as it will take now */
+static bool client_flush(Client *Peer)
+{
+int written;
+
+  while (Peer->OutputLen > 0) {
+    written = write(Peer->Fd, Peer->Output, Peer->OutputLen);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return TRUE;
+    }
+    if (written <= 0) {
+      return FALSE;
+    }
+    Peer->OutputLen -= written;
+    memmove(Peer->Output, Peer->Output + written, Peer->OutputLen);
+  }
+  return TRUE;
+}
+
+
+/* Buffer Data for the client, and send what it will take; FALSE if it
+   has gone, or has let too much build up */
+static bool client_write(Client *Peer, char *Data, int Length)
+{
+  if (Peer->OutputLen + Length > OutputMax) {
+    printf("Client is not keeping up with its replies\n");
+    return FALSE;
+  }
+  memcpy(Peer->Output + Peer->OutputLen, Data, Length);
+  Peer->OutputLen += Length;
+  return client_flush(Peer);
+}
+
+
+/* Stop the analyser mid-reply, and ignore whatever it was still sending */
+static void analyser_abort(void)
+{
+  (void) asy_write(AnalyserFd, (byte *) "z", 1);
+  asy_flush(AnalyserFd);
+  Draining = TRUE;
+  gettimeofday(&LastHeard, NULL);
+  Active = -1;
+}
+
+
+static void client_close(int Index, bool Verbose)
+{
+  if (Verbose) {
+    printf("Client %d disconnected\n", Index);
+  }
+  if (Active == Index) {
+    analyser_abort();
+  }
+  close(Clients[Index].Fd);
+  Clients[Index].Fd = -1;
+}
+
+
+static void client_accept(int Listener, bool Verbose)
+{
+int fd, i;
+
+  if ((fd = accept(Listener, NULL, NULL)) == -1) {
+    return;
+  }
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+    printf("Cannot make client non-blocking: %s\n", strerror(errno));
+    close(fd);
+    return;
+  }
+  for (i = 0; i < MaxClients; i++) {
+    if (Clients[i].Fd == -1) {
+      memset(&Clients[i], 0, sizeof(Client));
+      Clients[i].Fd = fd;
+      memcpy(Clients[i].Setting, SettingDefaults, sizeof(SettingDefaults));
+      Clients[i].Detector = DetectorDefault;
+      if (Verbose) {
+        printf("Client %d connected\n", i);
+      }
+      return;
+    }
+  }
+  printf("Too many clients; refusing another\n");
+  close(fd);
+}
+
+
+/* Queue the analyser commands that carry out the client's s or o */
+static void client_request(Client *Peer, char Command)
+{
+char *request;
+int i, len = 0;
+
+  if (Peer->Queued == MaxQueued) {
+    printf("Client has too many requests queued; ignoring %c\n", Command);
+    return;
+  }
+  request = Peer->Queue[(Peer->Head + Peer->Queued) % MaxQueued];
+  for (i = 0; i < Settings && len < RequestMax; i++) {
+    len += snprintf(request + len, RequestMax - len, "%ld%c", Peer->Setting[i],
+                    SettingCommands[i]);
+  }
+  if (len < RequestMax && Command == 'o') {
+    len += snprintf(request + len, RequestMax - len, "%c", Peer->Detector);
+  }
+  if (len < RequestMax) {
+    len += snprintf(request + len, RequestMax - len, "%c", Command);
+  }
+  if (len >= RequestMax) {
+    printf("Client's request is too long; ignoring %c\n", Command);
+    return;
+  }
+  Peer->Queued++;
+}
+
+
+/* Interpret the client's commands as the analyser would */
+static void client_receive(int Index, bool Verbose)
+{
+Client *peer = &Clients[Index];
+char buf[LineMax];
+int len, i, j;
+
+  len = read(peer->Fd, buf, sizeof(buf));
+  if (len == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  }
+  if (len <= 0) {
+    client_close(Index, Verbose);
+    return;
+  }
+  for (i = 0; i < len; i++) {
+    if (isdigit((unsigned char) buf[i])) {
+      if (peer->Arg > (ArgMax - (buf[i] - '0')) / 10L) {
+        peer->ArgTooLarge = TRUE;
+      } else {
+        peer->Arg = peer->Arg * 10L + (buf[i] - '0');
+      }
+      continue;
+    }
+    if (peer->ArgTooLarge) {
+      printf("Client %d: number too large; ignoring %c\n", Index, buf[i]);
+      peer->ArgTooLarge = FALSE;
+      peer->Arg = 0L;
+      continue;
+    }
+    switch (toupper((unsigned char) buf[i])) {
+      case 'A':
+      case 'B':
+      case 'N':
+      case 'D':
+        for (j = 0; j < Settings; j++) {
+          if (SettingCommands[j] == toupper((unsigned char) buf[i])) {
+            peer->Setting[j] = peer->Arg;
+          }
+        }
+        break;
+      case 'F':
+      case 'E':
+        peer->Detector = toupper((unsigned char) buf[i]);
+        break;
+      case 'S':
+      case 'O':
+        client_request(peer, tolower((unsigned char) buf[i]));
+        break;
+      case 'Q':
+        for (j = 0; j < QueryLines; j++) {
+          if (!client_write(peer, Query[j], strlen(Query[j]))) {
+            client_close(Index, Verbose);
+            return;
+          }
+        }
+        break;
+      case 'Z':
+        peer->Queued = 0;
+        if (Active == Index) {
+          analyser_abort();
+        }
+        break;
+      default:
+        /* Line endings, or something the analyser wouldn't understand */
+        break;
+    }
+    peer->Arg = 0L;
+  }
+}
+
+
+/* Start the next queued request, taking the clients in turn */
+static void dispatch(bool Verbose)
+{
+Client *peer;
+int i, index;
+
+  if (Active != -1 || Draining) {
+    return;
+  }
+  for (i = 1; i <= MaxClients; i++) {
+    index = (LastServed + i) % MaxClients;
+    peer = &Clients[index];
+    if (peer->Fd == -1 || peer->Queued == 0) {
+      continue;
+    }
+    if (Verbose) {
+      printf("Client %d: %s\n", index, peer->Queue[peer->Head]);
+    }
+    asy_flush(AnalyserFd);
+    if (asy_write(AnalyserFd, (byte *) peer->Queue[peer->Head],
+                  strlen(peer->Queue[peer->Head])) == -1) {
+      printf("Could not write to the analyser\n");
+    }
+    peer->Head = (peer->Head + 1) % MaxQueued;
+    peer->Queued--;
+    Active = LastServed = index;
+    gettimeofday(&LastHeard, NULL);
+    return;
+  }
+}
+
+
+/* Pass the analyser's reply lines to the client being served */
+static bool analyser_receive(bool Verbose)
+{
+char line[LineMax];
+int len;
+
+  if (asy_receive(AnalyserFd) <= 0) {
+    printf("Analyser disconnected\n");
+    return FALSE;
+  }
+  gettimeofday(&LastHeard, NULL);
+  while ((len = asy_nextline(AnalyserFd, line, LineMax)) >= 0) {
+    if (len == 0) {
+      printf("Buffer overflow detected\n");
+      continue;
+    }
+    if (Active == -1) {
+      /* Left over from a cancelled request */
+      continue;
+    }
+    if (!client_write(&Clients[Active], line, len)) {
+      client_close(Active, Verbose);
+      continue;
+    }
+    if (strncmp("End", line, 3) == 0) {
+      Active = -1;
+    }
+  }
+  return TRUE;
+}
+
+
+static int server_listen(char *SocketPath)
+{
+struct sockaddr_un address;
+int fd;
+
+  if (strlen(SocketPath) >= sizeof(address.sun_path)) {
+    printf("Socket path %s is too long\n", SocketPath);
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, SocketPath);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+    printf("Cannot create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  (void) unlink(SocketPath);
+  if (bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+      listen(fd, MaxClients) == -1) {
+    printf("Cannot listen on %s: %s\n", SocketPath, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : server_run
+*** Preconditions    : Port is the analyser's serial port. Quit is set
+***                    asynchronously (e.g. by a SIGINT handler) to stop.
+*** Postconditions   : The analyser has been opened and queried, and clients
+***                    connecting to SocketPath served, until Quit was set.
+***                    The socket has been removed and the port closed.
+***                    server_run is FALSE if the analyser could not be
+***                    opened or queried, the socket could not be created, or
+***                    the analyser went away.
+***
+*******************************************************************************/
+
+bool server_run(char *Port, char *SocketPath, bool HardwareFlowControl,
+  bool Verbose, int *Quit)
+{
+struct pollfd fds[MaxClients + 2];
+int which[MaxClients + 2];
+int listener, i, n, timeout;
+long waited;
+bool ok = TRUE;
+
+  if ((AnalyserFd = asy_open(Port, serverBps, HardwareFlowControl)) == -1) {
+    printf("port %s open failed\n", Port);
+    return FALSE;
+  }
+  (void) asy_write(AnalyserFd, (byte *) "q", 1);
+  for (i = 0; i < QueryLines; i++) {
+    if (asy_readline(AnalyserFd, Query[i], LineMax) <= 0) {
+      printf("Did not read the query data from the analyser\n");
+      asy_close(AnalyserFd);
+      return FALSE;
+    }
+    if (Verbose) {
+      printf("Query from analyser: %s", Query[i]);
+    }
+  }
+
+  if ((listener = server_listen(SocketPath)) == -1) {
+    asy_close(AnalyserFd);
+    return FALSE;
+  }
+  for (i = 0; i < MaxClients; i++) {
+    Clients[i].Fd = -1;
+  }
+  /* A client going away mid-reply must not take us with it */
+  signal(SIGPIPE, SIG_IGN);
+  printf("Serving %s on %s\n", Port, SocketPath);
+  fflush(stdout);
+
+  while (!*Quit) {
+    timeout = -1;
+    if (Active != -1 || Draining) {
+      waited = elapsed_ms(&LastHeard);
+      if (Draining && waited >= DrainMs) {
+        Draining = FALSE;
+      } else if (Active != -1 && waited >= AnalyserTimeoutMs) {
+        printf("Timeout!\n");
+        client_close(Active, Verbose);
+      }
+    }
+    dispatch(Verbose);
+    if (Active != -1) {
+      timeout = AnalyserTimeoutMs - elapsed_ms(&LastHeard);
+    } else if (Draining) {
+      timeout = DrainMs - elapsed_ms(&LastHeard);
+    }
+    if (timeout < -1) {
+      timeout = 0;
+    }
+
+    n = 0;
+    fds[n].fd = AnalyserFd;
+    fds[n].events = POLLIN;
+    which[n++] = -1;
+    fds[n].fd = listener;
+    fds[n].events = POLLIN;
+    which[n++] = -1;
+    for (i = 0; i < MaxClients; i++) {
+      if (Clients[i].Fd != -1) {
+        fds[n].fd = Clients[i].Fd;
+        fds[n].events = Clients[i].OutputLen > 0 ? POLLIN | POLLOUT : POLLIN;
+        which[n++] = i;
+      }
+    }
+
+    if (poll(fds, n, timeout) == -1) {
+      if (errno != EINTR) {
+        printf("poll failed: %s\n", strerror(errno));
+        ok = FALSE;
+        break;
+      }
+      continue;
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      if (!analyser_receive(Verbose)) {
+        ok = FALSE;
+        break;
+      }
+    }
+    for (i = 2; i < n; i++) {
+      // The slot may have been closed since the poll
+      if ((fds[i].revents & POLLOUT) && Clients[which[i]].Fd == fds[i].fd &&
+          !client_flush(&Clients[which[i]])) {
+        client_close(which[i], Verbose);
+      }
+      if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+          Clients[which[i]].Fd == fds[i].fd) {
+        client_receive(which[i], Verbose);
+      }
+    }
+    // Only once the clients polled are done with, so a slot freed in this
+    // pass isn't taken for one of them
+    if (fds[1].revents & POLLIN) {
+      client_accept(listener, Verbose);
+    }
+  }
+
+  if (Active != -1) {
+    analyser_abort();
+  }
+  for (i = 0; i < MaxClients; i++) {
+    if (Clients[i].Fd != -1) {
+      close(Clients[i].Fd);
+      Clients[i].Fd = -1;
+    }
+  }
+  close(listener);
+  unlink(SocketPath);
+  asy_close(AnalyserFd);
+  AnalyserFd = -1;
+  return ok;
+}
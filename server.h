@@ -0,0 +1,26 @@
+/*******************************************************************************
+***
+*** Filename         : server.h
+*** Purpose          : Definitions for sharing one analyser between clients
+***                    over a Unix domain socket
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "global.h"
+
+#define MaxClients 16
+#define MaxQueued 4             /* Outstanding s/o requests per client */
+
+bool server_run(char *, char *, bool, bool, int *);
+
+#endif /* SERVER_H */
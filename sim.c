@@ -0,0 +1,488 @@
+/*******************************************************************************
+***
+*** Filename         : sim.c
+*** Purpose          : Simulated K6BEZ/M0CUV antenna analyser on a
+***                    pseudo-terminal, for testing and benchmarking the
+***                    driver without hardware.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The simulator speaks the same command set as the
+***                    modified firmware: a decimal argument followed by a
+***                    single letter command, e.g. 3500000A. Replies are
+***                    CR/LF terminated lines, scans and oscilloscope
+***                    captures are terminated by an "End" line. P scans
+***                    like s, but replies with binary protocol frames (see
+***                    scanline.h), unless the simulator is set to be the
+***                    firmware from before them.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#if defined(DEBIAN) || defined(REDHAT) || defined(RASPBIAN)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <math.h>
+
+#include "global.h"
+#include "scanline.h"
+#include "sim.h"
+
+#define WriteTimeout 2000 /* ms to wait for the driver to drain the pty */
+#define InputMax 256
+
+static int SlaveFd = -1;
+static unsigned long NoiseSeed = 1;
+
+/* The detectors' outputs, which follow the readings for the DDS frequency
+   with time constant DetectorTau */
+static double DdsFreq = -1.0;
+static double FwdLevel, RevLevel;
+static struct timeval LevelTime;
+
+/* Commands received while a scan is in progress, replayed afterwards. */
+static char PendingInput[InputMax];
+static int PendingInputLen = 0;
+
+
+/*******************************************************************************
+***
+*** Function         : sim_defaults
+*** Preconditions    : Params points to a SimParams
+*** Postconditions   : Params is set to an unthrottled 80m dipole.
+***
+*******************************************************************************/
+
+void sim_defaults(SimParams *Params)
+{
+  Params->LineRate = 0L;
+  Params->StepLatency = 0L;
+  Params->Resonance = 3650000.0;
+  Params->Drift = 0.0;
+  Params->MinSwr = 1.2;
+  Params->Q = 12.0;
+  Params->Samples = 1000L;
+  Params->DropAfter = 0L;
+  Params->DetectorTau = 0L;
+  Params->Load = -1.0;
+  Params->Leakage = 0.0;
+  Params->AsciiOnly = FALSE;
+  Params->LoseEvery = 0L;
+  Params->Verbose = FALSE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : sim_open
+*** Preconditions    : SlaveName is a buffer of SlaveNameMax bytes.
+*** Postconditions   : sim_open is positive, the master side of a new raw
+***                    pseudo-terminal, and SlaveName holds the device the
+***                    driver should open with -p.
+***                    sim_open is -1, and no pseudo-terminal could be made.
+***
+*******************************************************************************/
+
+int sim_open(char *SlaveName, int SlaveNameMax)
+{
+  struct termios Raw;
+  int fd;
+  char *name;
+
+  if ((fd = posix_openpt(O_RDWR | O_NOCTTY)) == -1) {
+    return -1;
+  }
+  if (grantpt(fd) == -1 || unlockpt(fd) == -1 || (name = ptsname(fd)) == NULL) {
+    close(fd);
+    return -1;
+  }
+  strncpy(SlaveName, name, SlaveNameMax - 1);
+  SlaveName[SlaveNameMax - 1] = '\0';
+
+  /* Hold the slave open ourselves, so the master doesn't see EIO between
+     driver runs, and so we can put it into raw mode up front. */
+  if ((SlaveFd = open(SlaveName, O_RDWR | O_NOCTTY)) == -1) {
+    close(fd);
+    return -1;
+  }
+  if (tcgetattr(SlaveFd, &Raw) == 0) {
+    cfmakeraw(&Raw);
+    (void) tcsetattr(SlaveFd, TCSANOW, &Raw);
+  }
+  return fd;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : sim_model
+*** Preconditions    : Freq is in Hz.
+*** Postconditions   : Fwd and Rev are the detector readings the analyser
+***                    would take for a series RLC antenna with the
+***                    configured resonance, Q and minimum SWR (or the
+***                    configured load in its place), through a bridge with
+***                    the configured directivity error.
+***
+*******************************************************************************/
+
+void sim_model(SimParams *Params, double Freq, long *Fwd, long *Rev)
+{
+  double r = 50.0 * (Params->MinSwr < 1.0 ? 1.0 : Params->MinSwr);
+  double x = 0.0;
+  double gamma, leak;
+  long noise;
+
+  if (Params->Load >= 0.0) {
+    r = Params->Load;
+  } else if (Freq > 0.0) {
+    x = r * Params->Q * (Freq / Params->Resonance - Params->Resonance / Freq);
+  }
+  gamma = sqrt(((r - 50.0) * (r - 50.0) + x * x) /
+               ((r + 50.0) * (r + 50.0) + x * x));
+  leak = Params->Leakage * Freq / Params->Resonance;
+  gamma = leak + (1.0 - 2.0 * leak) * gamma;
+
+  /* Small, repeatable ADC noise */
+  NoiseSeed = NoiseSeed * 1103515245UL + 12345UL;
+  noise = (long) ((NoiseSeed >> 16) % 5) - 2;
+
+  *Fwd = 800L + noise;
+  *Rev = (long) (*Fwd * gamma + 0.5);
+}
+
+
+static void sim_sleep_us(long Micros)
+{
+struct timespec ts;
+  ts.tv_sec = Micros / 1000000L;
+  ts.tv_nsec = (Micros % 1000000L) * 1000L;
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR) ;
+}
+
+
+static long elapsed_us(struct timeval *Since)
+{
+struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - Since->tv_sec) * 1000000L + (now.tv_usec - Since->tv_usec);
+}
+
+
+/* Bring the detector levels up to now, at the current DDS frequency. */
+static void sim_detect(SimParams *Params)
+{
+long fwd, rev;
+double decay;
+
+  sim_model(Params, DdsFreq, &fwd, &rev);
+  decay = exp(-(double) elapsed_us(&LevelTime) / Params->DetectorTau);
+  FwdLevel = fwd + (FwdLevel - fwd) * decay;
+  RevLevel = rev + (RevLevel - rev) * decay;
+  gettimeofday(&LevelTime, NULL);
+}
+
+
+/* Set the DDS to Freq. The first time, the detectors start settled. */
+static void sim_tune(SimParams *Params, double Freq)
+{
+long fwd, rev;
+
+  if (Params->DetectorTau > 0L && DdsFreq < 0.0) {
+    sim_model(Params, Freq, &fwd, &rev);
+    FwdLevel = fwd;
+    RevLevel = rev;
+    gettimeofday(&LevelTime, NULL);
+  } else if (Params->DetectorTau > 0L) {
+    sim_detect(Params);
+  }
+  DdsFreq = Freq;
+}
+
+
+/* Read the detectors. */
+static void sim_read(SimParams *Params, long *Fwd, long *Rev)
+{
+  if (Params->DetectorTau > 0L) {
+    sim_detect(Params);
+    *Fwd = (long) (FwdLevel + 0.5);
+    *Rev = (long) (RevLevel + 0.5);
+  } else {
+    sim_model(Params, DdsFreq, Fwd, Rev);
+  }
+}
+
+
+/* Write a reply line, pacing it to the simulated line rate. Returns FALSE if
+   the driver has stopped reading. */
+static bool sim_write(int Fd, SimParams *Params, byte *Data, int len)
+{
+struct pollfd pfd;
+struct timeval started;
+int done = 0;
+int status;
+long pace;
+
+  gettimeofday(&started, NULL);
+  while (done < len) {
+    pfd.fd = Fd;
+    pfd.events = POLLOUT;
+    if (poll(&pfd, 1, WriteTimeout) <= 0) {
+      /* Nobody is draining the pty; discard what we've queued. */
+      if (SlaveFd != -1) {
+        (void) tcflush(SlaveFd, TCIFLUSH);
+      }
+      return FALSE;
+    }
+    status = write(Fd, Data + done, len - done);
+    if (status == -1) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return FALSE;
+    }
+    done += status;
+  }
+
+  /* 8/N/1 framing: ten bits on the wire per byte */
+  if (Params->LineRate > 0L) {
+    pace = (long) ((len * 10.0 * 1000000.0) / Params->LineRate) - elapsed_us(&started);
+    if (pace > 0L) {
+      sim_sleep_us(pace);
+    }
+  }
+  return TRUE;
+}
+
+
+static bool sim_write_line(int Fd, SimParams *Params, char *Line)
+{
+  if (!sim_write(Fd, Params, (byte *) Line, strlen(Line))) {
+    return FALSE;
+  }
+  if (Params->Verbose) {
+    fprintf(stderr, "sim: > %s", Line);
+  }
+  return TRUE;
+}
+
+
+/* Send a binary protocol frame, dropping a byte of every LoseEvery'th */
+static bool sim_write_frame(int Fd, SimParams *Params, int Type, ScanPoint *Point,
+  long Index)
+{
+byte frame[ScanFrameSize];
+int len = ScanFrameSize;
+
+  format_scan_frame(frame, Type, Point);
+  if (Params->LoseEvery > 0L && Index % Params->LoseEvery == Params->LoseEvery - 1L) {
+    memmove(frame + 5, frame + 6, ScanFrameSize - 6);
+    len--;
+  }
+  if (Params->Verbose) {
+    fprintf(stderr, "sim: > frame %c %ld %ld %ld %ld%s\n", Type, Point->Freq, Point->Vswr,
+      Point->Fwd, Point->Rev, len < ScanFrameSize ? " (losing a byte)" : "");
+  }
+  return sim_write(Fd, Params, frame, len);
+}
+
+
+/* Poll for input arriving mid-capture. Returns TRUE if the driver asked us
+   to stop (z). Anything else is kept to be processed afterwards. */
+static bool sim_abort_requested(int Fd)
+{
+struct pollfd pfd;
+char buf[InputMax];
+int status, i;
+bool abort = FALSE;
+
+  pfd.fd = Fd;
+  pfd.events = POLLIN;
+  while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+    status = read(Fd, buf, sizeof(buf));
+    if (status <= 0) {
+      break;
+    }
+    for (i = 0; i < status; i++) {
+      if (buf[i] == 'z' || buf[i] == 'Z') {
+        abort = TRUE;
+      } else if (PendingInputLen < InputMax) {
+        PendingInput[PendingInputLen++] = buf[i];
+      }
+    }
+  }
+  return abort;
+}
+
+
+static void sim_scan(int Fd, SimParams *Params, long StartFreq, long StopFreq,
+  long NumSteps, long Settle, bool Binary)
+{
+char line[InputMax];
+double freq, stepSize;
+long i, fwd, rev, vswr;
+ScanPoint point;
+
+  if (NumSteps < 1L) {
+    NumSteps = 1L;
+  }
+  stepSize = (double) (StopFreq - StartFreq) / NumSteps;
+
+  for (i = 0; i <= NumSteps; i++) {
+    if (sim_abort_requested(Fd) || (Params->DropAfter > 0L && i == Params->DropAfter)) {
+      return;
+    }
+    freq = StartFreq + i * stepSize;
+    sim_tune(Params, freq);
+    if (Settle > 0L || Params->StepLatency > 0L) {
+      sim_sleep_us(Settle * 1000L + Params->StepLatency);
+    }
+    sim_read(Params, &fwd, &rev);
+    vswr = (rev >= fwd) ? 999000L : (long) (((double) (fwd + rev) / (fwd - rev)) * 1000.0);
+    if (Binary) {
+      point.Freq = (long) (freq * 100.0 + 0.5);
+      point.Vswr = vswr;
+      point.Fwd = fwd * 100L;
+      point.Rev = rev * 100L;
+      if (!sim_write_frame(Fd, Params, SCAN_FRAME_POINT, &point, i)) {
+        return;
+      }
+      continue;
+    }
+    sprintf(line, "%.2f,0,%ld,%ld.00,%ld.00\r\n", freq, vswr, fwd, rev);
+    if (!sim_write_line(Fd, Params, line)) {
+      return;
+    }
+  }
+  if (Binary) {
+    memset(&point, 0, sizeof(point));
+    (void) sim_write_frame(Fd, Params, SCAN_FRAME_END, &point, i);
+  } else {
+    (void) sim_write_line(Fd, Params, "End\r\n");
+  }
+}
+
+
+static void sim_oscilloscope(int Fd, SimParams *Params, long Freq, long Settle,
+  bool Reverse)
+{
+char line[InputMax];
+long i, fwd, rev;
+
+  sim_tune(Params, (double) (Freq != 0L ? Freq : Params->Resonance));
+  for (i = 0; i < Params->Samples; i++) {
+    if (sim_abort_requested(Fd)) {
+      return;
+    }
+    if (Settle > 0L || Params->StepLatency > 0L) {
+      sim_sleep_us(Settle * 1000L + Params->StepLatency);
+    }
+    sim_read(Params, &fwd, &rev);
+    sprintf(line, "%ld %ld\r\n", i, Reverse ? rev : fwd);
+    if (!sim_write_line(Fd, Params, line)) {
+      return;
+    }
+  }
+  (void) sim_write_line(Fd, Params, "End\r\n");
+}
+
+
+/*******************************************************************************
+***
+*** Function         : sim_serve
+*** Preconditions    : Fd is the master returned by sim_open.
+*** Postconditions   : Never returns; commands from the driver are
+***                    answered until the process is killed.
+***
+*******************************************************************************/
+
+void sim_serve(int Fd, SimParams *Params)
+{
+char buf[InputMax];
+long arg = 0L;
+long startFreq = 1000000L, stopFreq = 30000000L, numSteps = 100L, settle = 10L;
+bool reverse = FALSE;
+int status, i;
+
+  for (;;) {
+    if (PendingInputLen > 0) {
+      memcpy(buf, PendingInput, PendingInputLen);
+      status = PendingInputLen;
+      PendingInputLen = 0;
+    } else {
+      status = read(Fd, buf, sizeof(buf));
+      if (status == -1 && errno == EINTR) {
+        continue;
+      }
+      if (status <= 0) {
+        sim_sleep_us(10000L);
+        continue;
+      }
+    }
+
+    for (i = 0; i < status; i++) {
+      if (Params->Verbose) {
+        fprintf(stderr, "sim: < %c\n", isprint(buf[i]) ? buf[i] : '?');
+      }
+      if (isdigit(buf[i])) {
+        arg = arg * 10L + (buf[i] - '0');
+        continue;
+      }
+      switch (toupper(buf[i])) {
+        case 'A':
+          startFreq = arg;
+          break;
+        case 'B':
+          stopFreq = arg;
+          break;
+        case 'N':
+          numSteps = arg;
+          break;
+        case 'D':
+          settle = arg;
+          break;
+        case 'F':
+          reverse = FALSE;
+          break;
+        case 'E':
+          reverse = TRUE;
+          break;
+        case 'S':
+        case 'P':
+          sim_scan(Fd, Params, startFreq, stopFreq, numSteps, settle,
+            toupper(buf[i]) == 'P' && !Params->AsciiOnly);
+          Params->Resonance += Params->Drift;
+          break;
+        case 'O':
+          sim_oscilloscope(Fd, Params, startFreq, settle, reverse);
+          break;
+        case 'Q':
+          (void) sim_write_line(Fd, Params, "K6BEZ Antenna Analyser, modifications by M0CUV (simulated)\r\n");
+          (void) sim_write_line(Fd, Params, Params->AsciiOnly ? "Commands: ABDEFNOQSZ\r\n" :
+                                                                "Commands: ABDEFNOPQSZ\r\n");
+          break;
+        case 'Z':
+        default:
+          /* Reset, line endings, or something we don't understand. */
+          break;
+      }
+      arg = 0L;
+    }
+  }
+}
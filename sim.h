@@ -0,0 +1,53 @@
+/*******************************************************************************
+***
+*** Filename         : sim.h
+*** Purpose          : Definitions for the simulated antenna analyser
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "global.h"
+
+/* An open circuit, as a resistance */
+#define SimOpen 1e12
+
+typedef struct {
+  long LineRate;      /* Simulated line rate in bits/sec, 0 for unlimited */
+  long StepLatency;   /* DDS programming latency per step, microseconds */
+  double Resonance;   /* Resonant frequency of the antenna model, Hz */
+  double Drift;       /* Change in Resonance after each scan, Hz */
+  double MinSwr;      /* SWR at resonance */
+  double Q;           /* Loaded Q of the antenna model */
+  long Samples;       /* Number of samples per oscilloscope capture */
+  long DropAfter;     /* Stop replying this many points into each scan, as if
+                         the link dropped out, 0 for never */
+  long DetectorTau;   /* Detector settling time constant after a frequency
+                         change, microseconds, 0 for instant */
+  double Load;        /* Resistor connected in place of the antenna, ohms:
+                         -1 for the antenna, 0 a short, SimOpen an open */
+  double Leakage;     /* Bridge directivity error, as the reflection
+                         coefficient it reads with a matched load at the
+                         resonance; it rises with frequency, and the
+                         bridge's tracking falls twice as fast. 0 for a
+                         perfect bridge */
+  bool AsciiOnly;     /* Firmware without the binary protocol */
+  long LoseEvery;     /* Lose a byte of every this many binary frames, as
+                         if the link were noisy, 0 for never */
+  bool Verbose;
+} SimParams;
+
+void sim_defaults(SimParams *);
+int  sim_open(char *, int);
+void sim_serve(int, SimParams *);
+void sim_model(SimParams *, double, long *, long *);
+
+#endif /* SIM_H */
@@ -0,0 +1,302 @@
+/*******************************************************************************
+***
+*** Filename         : smooth.c
+*** Purpose          : Smoothing scans and oscilloscope captures, and
+***                    resampling them to a curve of fixed size for plotting.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : gnuplot's "smooth bezier" uses every point as a
+***                    control point, so it costs more the more steps are
+***                    scanned, and the curve doesn't go through the
+***                    measurements. Here the points are filtered once,
+***                    in O(points x window), and resampled to
+***                    SmoothCurvePoints, so whatever plots the curve has the
+***                    same small amount to draw however long the scan.
+***                    Points needn't be evenly spaced (adaptive scans
+***                    aren't), but must be in order of X.
+***                    Long oscilloscope captures are decimated before
+***                    plotting, to the lowest and highest sample of each
+***                    pixel column: the envelope that drawing every sample
+***                    would show, at a fraction of the points.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "smooth.h"
+
+
+/*******************************************************************************
+***
+*** Function         : smooth_method
+*** Preconditions    : None
+*** Postconditions   : smooth_method is the SMOOTH_ method called Name
+***                    ("bezier", "sg", "spline" or "median"), or -1.
+***
+*******************************************************************************/
+
+int smooth_method(const char *Name)
+{
+  if (strcmp(Name, "bezier") == 0) {
+    return SMOOTH_NONE;
+  } else if (strcmp(Name, "sg") == 0) {
+    return SMOOTH_SAVGOL;
+  } else if (strcmp(Name, "spline") == 0) {
+    return SMOOTH_SPLINE;
+  } else if (strcmp(Name, "median") == 0) {
+    return SMOOTH_MEDIAN;
+  }
+  return -1;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : smooth_default_window
+*** Preconditions    : None
+*** Postconditions   : smooth_default_window is the window, in points, to
+***                    use with Method when none is given.
+***
+*******************************************************************************/
+
+int smooth_default_window(int Method)
+{
+  return Method == SMOOTH_MEDIAN ? 5 : 11;
+}
+
+
+/* Savitzky-Golay: each point replaced by the value at its X of the least
+   squares quadratic through the Window points around it (shifted inwards
+   at the ends). Solved directly rather than with precomputed coefficients,
+   so uneven spacing is handled. */
+static void savgol(const double *X, const double *Y, long Count, int Window, double *Out)
+{
+  double s[5], t[3], d, p, scale, det, a;
+  long i, j, lo, hi;
+  int k;
+
+  for (i = 0L; i < Count; i++) {
+    lo = i - Window / 2;
+    if (lo > Count - Window) {
+      lo = Count - Window;
+    }
+    if (lo < 0L) {
+      lo = 0L;
+    }
+    hi = lo + Window - 1L;
+    if (hi > Count - 1L) {
+      hi = Count - 1L;
+    }
+    scale = X[hi] - X[lo];
+    if (hi - lo < 2L || scale <= 0.0) {
+      Out[i] = Y[i];
+      continue;
+    }
+    memset(s, 0, sizeof(s));
+    memset(t, 0, sizeof(t));
+    for (j = lo; j <= hi; j++) {
+      d = (X[j] - X[i]) / scale;
+      for (k = 0, p = 1.0; k < 5; k++, p *= d) {
+        s[k] += p;
+        if (k < 3) {
+          t[k] += p * Y[j];
+        }
+      }
+    }
+    /* The constant term of the normal equations' solution, by Cramer */
+    det = s[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (s[1] * s[4] - s[3] * s[2]) +
+          s[2] * (s[1] * s[3] - s[2] * s[2]);
+    a = t[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (t[1] * s[4] - s[3] * t[2]) +
+        s[2] * (t[1] * s[3] - s[2] * t[2]);
+    Out[i] = det != 0.0 ? a / det : Y[i];
+  }
+}
+
+
+/* Median of the Window points around each (fewer at the ends) */
+static void median(const double *Y, long Count, int Window, double *Out)
+{
+  double sorted[SmoothWindowMax], v;
+  long i, j, lo, hi;
+  int n, k;
+
+  for (i = 0L; i < Count; i++) {
+    lo = i - Window / 2 < 0L ? 0L : i - Window / 2;
+    hi = i + Window / 2 > Count - 1L ? Count - 1L : i + Window / 2;
+    for (j = lo, n = 0; j <= hi; j++, n++) {
+      v = Y[j];
+      for (k = n; k > 0 && sorted[k - 1] > v; k--) {
+        sorted[k] = sorted[k - 1];
+      }
+      sorted[k] = v;
+    }
+    Out[i] = n % 2 == 1 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+  }
+}
+
+
+/* Second derivatives of the natural cubic spline through the points, by
+   the tridiagonal (Thomas) algorithm; Work has room for Count doubles */
+static void spline(const double *X, const double *Y, long Count, double *M, double *Work)
+{
+  double h0, h1, w;
+  long i;
+
+  M[0] = M[Count - 1] = 0.0;
+  Work[0] = 0.0;
+  for (i = 1L; i < Count - 1L; i++) {
+    h0 = X[i] - X[i - 1];
+    h1 = X[i + 1] - X[i];
+    w = 2.0 * (h0 + h1) - h0 * Work[i - 1];
+    Work[i] = h1 / w;
+    M[i] = (6.0 * ((Y[i + 1] - Y[i]) / h1 - (Y[i] - Y[i - 1]) / h0) - h0 * M[i - 1]) / w;
+  }
+  for (i = Count - 2L; i > 0L; i--) {
+    M[i] -= Work[i] * M[i + 1];
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : smooth_curve
+*** Preconditions    : X/Y hold Count > 0 points in order of X. Method is a
+***                    SMOOTH_ method other than SMOOTH_NONE; Window is
+***                    odd and at most SmoothWindowMax (it's ignored for
+***                    splines). CX/CY have room for Points > 1 points.
+*** Postconditions   : smooth_curve is TRUE, and CX/CY hold Points evenly
+***                    spaced points from the first X to the last on the
+***                    smoothed curve: the spline through the points, or
+***                    through their Savitzky-Golay filtered values, or
+***                    straight lines between their medians. FALSE if
+***                    there's not enough memory.
+***
+*******************************************************************************/
+
+bool smooth_curve(int Method, int Window, const double *X, const double *Y, long Count,
+  double *CX, double *CY, int Points)
+{
+  double *x = malloc(Count * sizeof(double));
+  double *y = malloc(Count * sizeof(double));
+  double *m = malloc(Count * sizeof(double));
+  double *work = malloc(Count * sizeof(double));
+  double at, h, a, b;
+  long i, n = 0L, j;
+  int p;
+
+  if (x == NULL || y == NULL || m == NULL || work == NULL) {
+    free(x); free(y); free(m); free(work);
+    return FALSE;
+  }
+
+  if (Method == SMOOTH_SAVGOL) {
+    savgol(X, Y, Count, Window, m);
+  } else if (Method == SMOOTH_MEDIAN) {
+    median(Y, Count, Window, m);
+  } else {
+    memcpy(m, Y, Count * sizeof(double));
+  }
+  /* Points at the same X (e.g. repeated by an adaptive scan) are merged,
+     as interpolation needs them strictly increasing */
+  for (i = 0L; i < Count; i++) {
+    if (n > 0L && X[i] <= x[n - 1]) {
+      continue;
+    }
+    x[n] = X[i];
+    y[n++] = m[i];
+  }
+  if (Method != SMOOTH_MEDIAN && n > 2L) {
+    spline(x, y, n, m, work);
+  } else {
+    memset(m, 0, n * sizeof(double));
+  }
+
+  for (p = 0, j = 0L; p < Points; p++) {
+    at = x[0] + (x[n - 1] - x[0]) * p / (Points - 1);
+    while (j < n - 2L && x[j + 1] < at) {
+      j++;
+    }
+    CX[p] = at;
+    if (n == 1L) {
+      CY[p] = y[0];
+      continue;
+    }
+    h = x[j + 1] - x[j];
+    a = (x[j + 1] - at) / h;
+    b = 1.0 - a;
+    CY[p] = a * y[j] + b * y[j + 1] +
+            ((a * a * a - a) * m[j] + (b * b * b - b) * m[j + 1]) * h * h / 6.0;
+  }
+
+  free(x); free(y); free(m); free(work);
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : smooth_decimate
+*** Preconditions    : X is in order; Columns > 0.
+*** Postconditions   : smooth_decimate is the new count of X/Y, which have
+***                    been reduced in place to the first and the lowest and
+***                    highest points (in their order) of each of Columns
+***                    equal slices of X, and the last point: at most
+***                    2 x Columns + 2 points, but every peak and glitch a
+***                    plot that wide could show. Unchanged if already no
+***                    more than that.
+***
+*******************************************************************************/
+
+long smooth_decimate(double *X, double *Y, long Count, long Columns)
+{
+  double first, span;
+  long i, n = 0L, column, current = -1L, low = 0L, high = 0L, keep[2];
+  int k;
+
+  if (Count <= 2L * Columns + 2L) {
+    return Count;
+  }
+  first = X[0];
+  span = X[Count - 1] - first;
+  /* Each slice is written once all of it has been read, no further on than
+     its first point, so the points can be moved down in place */
+  for (i = 1L; i <= Count - 1L; i++) {
+    column = i == Count - 1L || span <= 0.0 ? Columns :
+             (long) ((X[i] - first) / span * Columns);
+    if (column > Columns - 1L && i < Count - 1L) {
+      column = Columns - 1L;
+    }
+    if (column == current) {
+      if (Y[i] < Y[low]) {
+        low = i;
+      }
+      if (Y[i] > Y[high]) {
+        high = i;
+      }
+      continue;
+    }
+    if (current == -1L) {
+      n = 1L;                   /* The first point stays where it is */
+    } else {
+      keep[0] = low < high ? low : high;
+      keep[1] = low < high ? high : low;
+      for (k = 0; k < (keep[0] == keep[1] ? 1 : 2); k++) {
+        X[n] = X[keep[k]];
+        Y[n++] = Y[keep[k]];
+      }
+    }
+    current = column;
+    low = high = i;
+  }
+  X[n] = X[Count - 1];
+  Y[n++] = Y[Count - 1];
+  return n;
+}
@@ -0,0 +1,37 @@
+/*******************************************************************************
+***
+*** Filename         : smooth.h
+*** Purpose          : Definitions for smoothing and resampling plot curves
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef SMOOTH_H
+#define SMOOTH_H
+
+#include "global.h"
+
+/* Smoothing methods, as returned by smooth_method */
+#define SMOOTH_NONE 0           /* gnuplot's smooth bezier, as before */
+#define SMOOTH_SAVGOL 1         /* Savitzky-Golay, quadratic */
+#define SMOOTH_SPLINE 2         /* Natural cubic spline through the points */
+#define SMOOTH_MEDIAN 3         /* Median of a window, for oscilloscope noise */
+
+/* Points in every smoothed curve, however many were measured */
+#define SmoothCurvePoints 200
+
+/* Largest window, in points */
+#define SmoothWindowMax 101
+
+int  smooth_method(const char *);
+int  smooth_default_window(int);
+bool smooth_curve(int, int, const double *, const double *, long, double *, double *, int);
+long smooth_decimate(double *, double *, long, long);
+
+#endif /* SMOOTH_H */
@@ -0,0 +1,335 @@
+/*******************************************************************************
+***
+*** Filename         : trace.c
+*** Purpose          : Timing each command sent to the analyser and each line
+***                    received, to see where a sweep's time goes.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : The trace file is JSON: an "events" array of every
+***                    command (tx) and line (rx) with its time in seconds
+***                    since the trace was opened, from the monotonic clock,
+***                    written as they happen; then a "summary" written when
+***                    it's closed. The summary's latencies come from
+***                    histograms of fixed size (log-linear bins, as in
+***                    HdrHistogram, within 1/16 of the value), so the
+***                    memory used is the same for any length of capture.
+***                    The latencies are:
+***                    - time to first point: from the command that starts
+***                      a sweep (s or o) to its first point, which includes
+***                      the settle delay and setting the DDS,
+***                    - point gaps: between points of a sweep,
+***                    - host: from receiving a line to starting to read the
+***                      next, i.e. the driver's own time per line.
+***                    Binary protocol frames are traced as the line they
+***                    stand for, but counted at their own size.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "global.h"
+#include "trace.h"
+
+
+/* Seconds since the trace was opened */
+static double now(Trace *T)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec - T->Opened.tv_sec) + (ts.tv_nsec - T->Opened.tv_nsec) / 1e9;
+}
+
+
+static int bucket(double Us)
+{
+  unsigned long v = Us < 0.0 ? 0UL : (unsigned long) Us;
+  int e = 0, b;
+
+  if (v < TraceSubBuckets) {
+    return (int) v;
+  }
+  while ((v >> e) >= 2 * TraceSubBuckets) {
+    e++;
+  }
+  b = TraceSubBuckets * (e + 1) + (int) (v >> e) - TraceSubBuckets;
+  return b < TraceBuckets ? b : TraceBuckets - 1;
+}
+
+
+/* The middle of bucket B, in us */
+static double bucket_value(int B)
+{
+  int e = B / TraceSubBuckets - 1;
+
+  if (B < 2 * TraceSubBuckets) {
+    return B;
+  }
+  return (double) ((TraceSubBuckets + B % TraceSubBuckets) << e) + ((1 << e) - 1) / 2.0;
+}
+
+
+static void add(TraceHistogram *H, double Us)
+{
+  if (H->Count == 0L || Us < H->Min) {
+    H->Min = Us;
+  }
+  if (H->Count == 0L || Us > H->Max) {
+    H->Max = Us;
+  }
+  H->Count++;
+  H->Total += Us;
+  H->Counts[bucket(Us)]++;
+}
+
+
+static double percentile(TraceHistogram *H, double P)
+{
+  long rank = (long) (P * H->Count + 0.999999), seen = 0L;
+  double v;
+  int b;
+
+  for (b = 0; b < TraceBuckets; b++) {
+    seen += H->Counts[b];
+    if (seen >= rank && seen > 0L) {
+      break;
+    }
+  }
+  v = bucket_value(b);
+  return v < H->Min ? H->Min : v > H->Max ? H->Max : v;
+}
+
+
+static void write_string(FILE *Out, const char *Text)
+{
+  fputc('"', Out);
+  for (; *Text != '\0'; Text++) {
+    switch (*Text) {
+      case '"': fputs("\\\"", Out); break;
+      case '\\': fputs("\\\\", Out); break;
+      case '\n': fputs("\\n", Out); break;
+      case '\r': fputs("\\r", Out); break;
+      default:
+        if ((byte) *Text < ' ') {
+          fprintf(Out, "\\u%04x", (byte) *Text);
+        } else {
+          fputc(*Text, Out);
+        }
+    }
+  }
+  fputc('"', Out);
+}
+
+
+static void write_event(Trace *T, double At, const char *Direction, const char *Text)
+{
+  fprintf(T->Out, "%s    {\"t\": %.6f, \"%s\": ", T->FirstEvent ? "" : ",\n", At, Direction);
+  write_string(T->Out, Text);
+  fputc('}', T->Out);
+  T->FirstEvent = FALSE;
+}
+
+
+static void write_histogram(FILE *Out, const char *Name, TraceHistogram *H)
+{
+  int b;
+  bool first = TRUE;
+
+  fprintf(Out, "    \"%s\": {\"count\": %ld", Name, H->Count);
+  if (H->Count > 0L) {
+    fprintf(Out, ", \"mean\": %.1f, \"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+      "\"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f,\n      \"histogram\": [",
+      H->Total / H->Count, H->Min, percentile(H, 0.5), percentile(H, 0.9),
+      percentile(H, 0.99), percentile(H, 0.999), H->Max);
+    for (b = 0; b < TraceBuckets; b++) {
+      if (H->Counts[b] > 0L) {
+        fprintf(Out, "%s[%.1f, %ld]", first ? "" : ", ", bucket_value(b), H->Counts[b]);
+        first = FALSE;
+      }
+    }
+    fputc(']', Out);
+  }
+  fputc('}', Out);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : trace_open
+*** Preconditions    : None
+*** Postconditions   : trace_open is TRUE and T is tracing to FileName, with
+***                    the clock started, or FALSE if it can't be opened.
+***
+*******************************************************************************/
+
+bool trace_open(Trace *T, const char *FileName)
+{
+  memset(T, 0, sizeof(Trace));
+  if ((T->Out = fopen(FileName, "w")) == NULL) {
+    return FALSE;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &T->Opened);
+  T->FirstEvent = TRUE;
+  T->LastPoint = T->LastLine = T->FirstPoint = -1.0;
+  fprintf(T->Out, "{\n  \"events\": [\n");
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : trace_command
+*** Preconditions    : T is open.
+*** Postconditions   : Line has been traced as sent to the analyser.
+***
+*******************************************************************************/
+
+void trace_command(Trace *T, const char *Line)
+{
+  write_event(T, now(T), "tx", Line);
+  T->Commands++;
+  T->BytesOut += strlen(Line);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : trace_start
+*** Preconditions    : T is open, and the command starting a sweep or
+***                    oscilloscope capture has just been traced.
+*** Postconditions   : Lines received from now on, until one starting "End",
+***                    are timed as that sweep's points.
+***
+*******************************************************************************/
+
+void trace_start(Trace *T)
+{
+  T->Started = now(T);
+  T->LastPoint = -1.0;
+  T->Sweeps++;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : trace_reading
+*** Preconditions    : T is open.
+*** Postconditions   : The driver's time since the last line received has
+***                    been recorded, as it is about to read another.
+***
+*******************************************************************************/
+
+void trace_reading(Trace *T)
+{
+  if (T->LastLine >= 0.0) {
+    add(&T->Host, (now(T) - T->LastLine) * 1e6);
+    T->LastLine = -1.0;
+  }
+}
+
+
+/*******************************************************************************
+***
+*** Function         : trace_line
+*** Preconditions    : T is open.
+*** Postconditions   : Line has been traced as received from the analyser,
+***                    and timed as a point if a sweep is under way.
+***
+*******************************************************************************/
+
+void trace_line(Trace *T, const char *Line)
+{
+  trace_frame(T, Line, strlen(Line));
+}
+
+
+/*******************************************************************************
+***
+*** Function         : trace_frame
+*** Preconditions    : T is open; Line is the text of a frame of Length bytes.
+*** Postconditions   : The frame has been traced as trace_line would the
+***                    line, but counted as Length bytes received.
+***
+*******************************************************************************/
+
+void trace_frame(Trace *T, const char *Line, long Length)
+{
+  double at = now(T);
+
+  write_event(T, at, "rx", Line);
+  T->Lines++;
+  T->BytesIn += Length;
+  T->LastLine = at;
+  if (T->Sweeps == 0L || T->Started < 0.0) {
+    return;
+  }
+  if (strncmp(Line, "End", 3) == 0) {
+    T->Started = -1.0;
+    return;
+  }
+  T->Points++;
+  if (T->LastPoint < 0.0) {
+    add(&T->ToFirstPoint, (at - T->Started) * 1e6);
+    if (T->FirstPoint < 0.0) {
+      T->FirstPoint = at - T->Started;
+    }
+  } else {
+    add(&T->Gaps, (at - T->LastPoint) * 1e6);
+    T->GapBytes += Length;
+  }
+  T->LastPoint = at;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : trace_close
+*** Preconditions    : T is open.
+*** Postconditions   : The summary has been written and the trace file
+***                    closed. trace_close is FALSE if there was a write
+***                    error.
+***
+*******************************************************************************/
+
+bool trace_close(Trace *T)
+{
+  double elapsed = now(T), gapSeconds = T->Gaps.Total / 1e6;
+  bool ok;
+
+  fprintf(T->Out, "\n  ],\n  \"summary\": {\n");
+  fprintf(T->Out, "    \"elapsed_s\": %.6f,\n", elapsed);
+  fprintf(T->Out, "    \"commands\": %ld,\n    \"bytes_out\": %ld,\n", T->Commands, T->BytesOut);
+  fprintf(T->Out, "    \"lines\": %ld,\n    \"bytes_in\": %ld,\n", T->Lines, T->BytesIn);
+  fprintf(T->Out, "    \"sweeps\": %ld,\n    \"points\": %ld,\n", T->Sweeps, T->Points);
+  if (T->FirstPoint >= 0.0) {
+    fprintf(T->Out, "    \"time_to_first_point_s\": %.6f,\n", T->FirstPoint);
+  } else {
+    fprintf(T->Out, "    \"time_to_first_point_s\": null,\n");
+  }
+  /* Over the points after each sweep's first, so the settle delay before
+     the first doesn't count */
+  if (gapSeconds > 0.0) {
+    fprintf(T->Out, "    \"points_per_sec\": %.1f,\n    \"bytes_per_sec\": %.1f,\n",
+      T->Gaps.Count / gapSeconds, T->GapBytes / gapSeconds);
+  } else {
+    fprintf(T->Out, "    \"points_per_sec\": null,\n    \"bytes_per_sec\": null,\n");
+  }
+  write_histogram(T->Out, "first_point_us", &T->ToFirstPoint);
+  fprintf(T->Out, ",\n");
+  write_histogram(T->Out, "point_gap_us", &T->Gaps);
+  fprintf(T->Out, ",\n");
+  write_histogram(T->Out, "host_us", &T->Host);
+  fprintf(T->Out, "\n  }\n}\n");
+  ok = !ferror(T->Out);
+  ok = fclose(T->Out) == 0 && ok;
+  T->Out = NULL;
+  return ok;
+}
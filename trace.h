@@ -0,0 +1,64 @@
+/*******************************************************************************
+***
+*** Filename         : trace.h
+*** Purpose          : Definitions for timing the analyser protocol
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "global.h"
+
+/* Latencies are binned in microseconds: exactly below 2 x TraceSubBuckets,
+   then TraceSubBuckets bins per power of two, up to about 2^41 us */
+#define TraceSubBuckets 16
+#define TraceBuckets (TraceSubBuckets * 38)
+
+typedef struct {
+  long Counts[TraceBuckets];
+  long Count;
+  double Total;                 /* us */
+  double Min;
+  double Max;
+} TraceHistogram;
+
+typedef struct {
+  FILE *Out;
+  struct timespec Opened;
+  bool FirstEvent;
+  long Commands;
+  long BytesOut;
+  long Lines;
+  long BytesIn;
+  long Sweeps;
+  long Points;
+  long GapBytes;                /* Received over the gaps between points */
+  double Started;               /* s since opening, of the last sweep's start */
+  double LastPoint;             /* ... of its last point, or -1 if none yet */
+  double LastLine;              /* ... of the last line received, or -1 */
+  double FirstPoint;            /* Time to first point of the first sweep */
+  TraceHistogram ToFirstPoint;  /* Each sweep's start to its first point */
+  TraceHistogram Gaps;          /* Between points of a sweep */
+  TraceHistogram Host;          /* A line received to the next read */
+} Trace;
+
+bool trace_open(Trace *, const char *);
+void trace_command(Trace *, const char *);
+void trace_start(Trace *);
+void trace_reading(Trace *);
+void trace_line(Trace *, const char *);
+void trace_frame(Trace *, const char *, long);
+bool trace_close(Trace *);
+
+#endif /* TRACE_H */
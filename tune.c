@@ -0,0 +1,316 @@
+/*******************************************************************************
+***
+*** Filename         : tune.c
+*** Purpose          : The interactive tuning mode: keeping a narrow window
+***                    around the SWR dip swept at a steady rate, and drawing
+***                    it in the terminal.
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+*** Notes            : A sweep's time is its points times the settle delay
+***                    plus each point's share of the rest (setting the DDS,
+***                    sending the point, the commands around the sweep),
+***                    which is measured from each sweep as it's made. The
+***                    next sweep gets as many points as fit in the time a
+***                    sweep has at the rate wanted. If TuneMinPoints don't
+***                    fit at the settle delay given, it's cut to make them
+***                    fit: the window's steps are small, so the detectors
+***                    have little to settle.
+***                    The window only moves when the dip strays an eighth
+***                    of its width from the centre, so the plot holds still
+***                    while an element is being trimmed.
+***                    The display is redrawn by comparing it cell by cell
+***                    with what was last drawn, and only sending (with ANSI
+***                    cursor moves) the runs that have changed: a few dozen
+***                    bytes a sweep rather than the whole screen, so even a
+***                    slow link to the shack keeps up.
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "global.h"
+#include "resonance.h"
+#include "tune.h"
+
+/* The time per point is smoothed over a few sweeps, so one slow sweep
+   doesn't halve the next */
+#define PointSecondsWeight 0.3
+
+/* Left of the plot: the SWR axis labels */
+#define AxisWidth 6
+
+
+/*******************************************************************************
+***
+*** Function         : tune_init
+*** Preconditions    : Rate > 0; MinFreq < MaxFreq (Hz).
+*** Postconditions   : T sweeps a window Span Hz wide (all of MinFreq to
+***                    MaxFreq if that's narrower) centred between them, at
+***                    up to Settle ms settle delay, Rate times a second.
+***
+*******************************************************************************/
+
+void tune_init(Tuner *T, double Rate, long MinFreq, long MaxFreq, long Span, int Settle)
+{
+  memset(T, 0, sizeof(Tuner));
+  T->Rate = Rate;
+  T->MinFreq = MinFreq;
+  T->MaxFreq = MaxFreq;
+  T->Span = Span < MaxFreq - MinFreq ? Span : MaxFreq - MinFreq;
+  T->Centre = MinFreq + (MaxFreq - MinFreq) / 2L;
+  T->MaxSettle = Settle;
+  T->Settle = Settle;
+  T->Points = TuneMinPoints;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : tune_plan
+*** Preconditions    : A sweep of Points points with Settle ms settle delay
+***                    took Seconds.
+*** Postconditions   : T's Points and Settle are those for the next sweep to
+***                    take 1 / Rate seconds.
+***
+*******************************************************************************/
+
+void tune_plan(Tuner *T, double Seconds, long Points, int Settle)
+{
+  double budget = 1.0 / T->Rate, rest, points;
+  int settle;
+
+  rest = Seconds / Points - Settle / 1000.0;
+  if (rest < 0.0) {
+    rest = 0.0;
+  }
+  T->PointSeconds = T->PointSeconds == 0.0 ? rest :
+                    T->PointSeconds + PointSecondsWeight * (rest - T->PointSeconds);
+  T->Achieved = Seconds > 0.0 ? 1.0 / Seconds : 0.0;
+
+  settle = T->MaxSettle;
+  points = budget / (settle / 1000.0 + T->PointSeconds);
+  if (points < TuneMinPoints) {
+    settle = (int) ((budget / TuneMinPoints - T->PointSeconds) * 1000.0);
+    settle = settle < 0 ? 0 : settle;
+    points = TuneMinPoints;
+  } else if (points > TuneMaxPoints) {
+    points = TuneMaxPoints;
+  }
+  T->Settle = settle;
+  T->Points = (int) points;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : tune_recentre
+*** Preconditions    : Freq is where the dip is now, in Hz.
+*** Postconditions   : tune_recentre is TRUE and the window has been centred
+***                    on Freq (as near as the limits allow) if it had
+***                    strayed far enough from the centre; FALSE if not.
+***
+*******************************************************************************/
+
+bool tune_recentre(Tuner *T, long Freq)
+{
+  long centre = Freq;
+
+  if (labs(Freq - T->Centre) <= T->Span / 8L) {
+    return FALSE;
+  }
+  if (centre - T->Span / 2L < T->MinFreq) {
+    centre = T->MinFreq + T->Span / 2L;
+  }
+  if (centre + T->Span / 2L > T->MaxFreq) {
+    centre = T->MaxFreq - T->Span / 2L;
+  }
+  if (centre == T->Centre) {
+    return FALSE;
+  }
+  T->Centre = centre;
+  return TRUE;
+}
+
+
+/*******************************************************************************
+***
+*** Function         : tune_start, tune_stop
+*** Preconditions    : None
+*** Postconditions   : The start and stop frequencies of the window, in Hz.
+***
+*******************************************************************************/
+
+long tune_start(Tuner *T)
+{
+  return T->Centre - T->Span / 2L;
+}
+
+
+long tune_stop(Tuner *T)
+{
+  return T->Centre - T->Span / 2L + T->Span;
+}
+
+
+/* Put Text on a line of the screen at Column, clipped to its width */
+static void put_text(TuneScreen *S, int Line, int Column, const char *Text)
+{
+  int len = strlen(Text);
+
+  if (Column + len > TuneWidth) {
+    len = TuneWidth - Column;
+  }
+  if (len > 0) {
+    memcpy(&S->Cells[Line][Column], Text, len);
+  }
+}
+
+
+/* The SWR at Freq (MHz), by linear interpolation, from *J on */
+static double vswr_at(const double *X, const double *Y, long Count, double Freq, long *J)
+{
+  while (*J < Count - 2L && X[*J + 1] < Freq) {
+    (*J)++;
+  }
+  if (Count == 1L || X[*J + 1] <= X[*J]) {
+    return Y[*J];
+  }
+  return Y[*J] + (Y[*J + 1] - Y[*J]) * (Freq - X[*J]) / (X[*J + 1] - X[*J]);
+}
+
+
+/* Draw what's changed since the last time */
+static void show(TuneScreen *S, FILE *Out)
+{
+  int line, column, run;
+
+  if (!S->Drawn) {
+    fputs("\033[?25l\033[H\033[2J", Out);
+    memset(S->Shown, 0, sizeof(S->Shown));
+    S->Drawn = TRUE;
+  }
+  for (line = 0; line < TuneLines; line++) {
+    for (column = 0; column < TuneWidth; column += run) {
+      if (S->Cells[line][column] == S->Shown[line][column]) {
+        run = 1;
+        continue;
+      }
+      for (run = 1; column + run < TuneWidth &&
+                    S->Cells[line][column + run] != S->Shown[line][column + run]; run++) {
+        /* to the end of the changes */
+      }
+      fprintf(Out, "\033[%d;%dH", line + 1, column + 1);
+      fwrite(&S->Cells[line][column], 1, run, Out);
+      memcpy(&S->Shown[line][column], &S->Cells[line][column], run);
+    }
+  }
+  fflush(Out);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : tune_draw
+*** Preconditions    : X (MHz) and Y (SWR) hold the Count > 0 points of the
+***                    sweep of T's window just made, in order of frequency;
+***                    Dip is its resonance, or NULL if it has none.
+*** Postconditions   : The sweep and the readout have been drawn on Out,
+***                    sending only what's changed since the last draw.
+***
+*******************************************************************************/
+
+void tune_draw(TuneScreen *S, FILE *Out, Tuner *T, const double *X, const double *Y,
+  long Count, Resonance *Dip)
+{
+  char text[TuneWidth + 1];
+  double start = tune_start(T) / 1e6, stop = tune_stop(T) / 1e6, freq, vswr, top;
+  int line, row, column, dipColumn = -1;
+  long j, lowest = 0L, highest = 0L;
+
+  for (j = 1L; j < Count; j++) {
+    lowest = Y[j] < Y[lowest] ? j : lowest;
+    highest = Y[j] > Y[highest] ? j : highest;
+  }
+  /* The SWR scale, to the next half above the sweep's highest */
+  top = ceil(Y[highest] * 2.0) / 2.0;
+  top = top < TuneMinTopVswr ? TuneMinTopVswr : top > TuneMaxTopVswr ? TuneMaxTopVswr : top;
+
+  for (line = 0; line < TuneLines; line++) {
+    memset(S->Cells[line], ' ', TuneWidth);
+    S->Cells[line][TuneWidth] = '\0';
+  }
+
+  if (Dip != NULL && Dip->Found && !Dip->Open) {
+    snprintf(text, sizeof(text), "Resonance %.5f MHz  SWR %.2f:1  2:1 from %.4f to %.4f MHz",
+      Dip->Freq, Dip->Vswr, Dip->Low, Dip->High);
+  } else if (Dip != NULL) {
+    snprintf(text, sizeof(text), "Resonance %.5f MHz  SWR %.2f:1", Dip->Freq, Dip->Vswr);
+  } else {
+    snprintf(text, sizeof(text), "No dip in the window: lowest SWR %.2f:1 at %.5f MHz",
+      Y[lowest], X[lowest]);
+  }
+  put_text(S, 0, 0, text);
+  freq = Dip != NULL ? Dip->Freq : X[lowest];
+  dipColumn = (int) ((freq - start) / (stop - start) * (TunePlotColumns - 1) + 0.5);
+  snprintf(text, sizeof(text), "%.4f-%.4f MHz  %d points  %d ms settle  %.1f sweeps/s of %.1f",
+    start, stop, T->Points, T->Settle, T->Achieved, T->Rate);
+  put_text(S, 1, 0, text);
+
+  for (row = 0; row < TunePlotRows; row++) {
+    line = row + 3;
+    if (row % 5 == 0 || row == TunePlotRows - 1) {
+      snprintf(text, sizeof(text), "%5.2f|", top - (top - 1.0) * row / (TunePlotRows - 1));
+    } else {
+      strcpy(text, "     |");
+    }
+    put_text(S, line, 0, text);
+  }
+  for (column = 0, j = 0L; column < TunePlotColumns; column++) {
+    freq = start + (stop - start) * column / (TunePlotColumns - 1);
+    vswr = vswr_at(X, Y, Count, freq, &j);
+    row = (int) ((top - vswr) / (top - 1.0) * (TunePlotRows - 1) + 0.5);
+    if (row < 0) {
+      S->Cells[3][AxisWidth + column] = '^';
+      continue;
+    }
+    row = row < TunePlotRows ? row : TunePlotRows - 1;
+    S->Cells[3 + row][AxisWidth + column] = column == dipColumn ? 'O' : '*';
+  }
+  line = TunePlotRows + 3;
+  put_text(S, line, 0, "     +");
+  memset(&S->Cells[line][AxisWidth], '-', TunePlotColumns);
+  snprintf(text, sizeof(text), "%.4f", start);
+  put_text(S, line + 1, AxisWidth - 3, text);
+  snprintf(text, sizeof(text), "%.4f", (start + stop) / 2.0);
+  put_text(S, line + 1, AxisWidth + TunePlotColumns / 2 - 3, text);
+  snprintf(text, sizeof(text), "%.4f MHz", stop);
+  put_text(S, line + 1, TuneWidth - strlen(text), text);
+
+  show(S, Out);
+}
+
+
+/*******************************************************************************
+***
+*** Function         : tune_end
+*** Preconditions    : None
+*** Postconditions   : The cursor is back, below the display.
+***
+*******************************************************************************/
+
+void tune_end(TuneScreen *S, FILE *Out)
+{
+  if (S->Drawn) {
+    fprintf(Out, "\033[%d;1H\033[?25h\n", TuneLines + 1);
+    fflush(Out);
+  }
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+***
+*** Filename         : tune.h
+*** Purpose          : Definitions for the interactive tuning mode
+*** Author           : agent
+*** Created          : 16/10/26
+*** Last updated     : 16/10/26
+***
+********************************************************************************
+***
+*** Modification Record
+***
+*******************************************************************************/
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stdio.h>
+
+#include "global.h"
+#include "resonance.h"
+
+/* Points per window sweep: enough to fit the dip, no more than the
+   display has columns for twice over */
+#define TuneMinPoints 21
+#define TuneMaxPoints 141
+
+/* The terminal display: a plot of TunePlotColumns x TunePlotRows cells
+   with the SWR axis down its left, the frequencies under it, and two
+   lines of readout above */
+#define TunePlotColumns 70
+#define TunePlotRows 16
+#define TuneWidth (TunePlotColumns + 8)
+#define TuneLines (TunePlotRows + 5)
+#define TuneMinTopVswr 1.5      /* The SWR at the top of the plot: the */
+#define TuneMaxTopVswr 10.0     /* sweep's highest, within these */
+
+/* The window being swept, and how it's swept to keep up the rate */
+typedef struct {
+  double Rate;                  /* Sweeps/sec wanted */
+  long MinFreq;                 /* Hz: the window stays within these */
+  long MaxFreq;
+  long Span;                    /* Width of the window */
+  long Centre;
+  int MaxSettle;                /* ms: the settle delay to use if there's time */
+  int Settle;                   /* ... and that planned for the next sweep */
+  int Points;                   /* Planned for the next sweep */
+  double PointSeconds;          /* Time per point besides settling, measured */
+  double Achieved;              /* Sweeps/sec of the last sweep */
+} Tuner;
+
+/* The terminal as last drawn, so only what changes is drawn again */
+typedef struct {
+  char Cells[TuneLines][TuneWidth + 1];
+  char Shown[TuneLines][TuneWidth + 1];
+  bool Drawn;
+} TuneScreen;
+
+void tune_init(Tuner *, double, long, long, long, int);
+void tune_plan(Tuner *, double, long, int);
+bool tune_recentre(Tuner *, long);
+long tune_start(Tuner *);
+long tune_stop(Tuner *);
+void tune_draw(TuneScreen *, FILE *, Tuner *, const double *, const double *, long,
+  Resonance *);
+void tune_end(TuneScreen *, FILE *);
+
+#endif /* TUNE_H */